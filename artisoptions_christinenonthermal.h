@@ -85,6 +85,40 @@ constexpr bool USE_LUT_PHOTOION = false;
 
 constexpr bool USE_LUT_BFHEATING = false;
 
+constexpr size_t CELLCACHE_MAXBYTES = 4UL * 1024 * 1024 * 1024;
+
+constexpr bool USE_LUT_CONTOPACITY = false;
+
+constexpr int CONTOPACITY_LUT_NPTS = 1024;
+
+constexpr bool USE_LUT_GAMMA_OPACITY = false;
+
+constexpr bool USE_LUT_COMPTON_SCATTER = false;
+
+constexpr bool USE_LUT_PLANCK_SAMPLING = false;
+
+constexpr bool DYNAMIC_LOAD_BALANCING_ON = false;
+
+constexpr bool NODESHARED_ESTIMATORS_ON = false;
+
+constexpr bool ACTIVE_LINES_ON = false;
+
+constexpr double ACTIVE_LINES_MIN_TAU_SOBOLEV = 1e-4;
+
+constexpr bool EXPANSION_OPACITIES_ON = false;
+
+constexpr int EXPANSION_OPACITIES_NBINS = 1000;
+
+constexpr bool MACROATOM_ALIAS_TABLES_ON = false;
+
+constexpr size_t MA_ALIAS_MAXBYTES_PERTHREAD = 512UL * 1024 * 1024;
+
+constexpr bool KPKT_COOLING_CDF_ON = false;
+
+constexpr bool NLTE_SPARSE_SOLVER_ON = false;
+
+constexpr bool NLTE_ITERATIVE_SOLVER_ON = false;
+
 #define SEPARATE_STIMRECOMB false
 
 constexpr bool NT_ON = true;
@@ -116,6 +150,10 @@ constexpr bool SF_AUGER_CONTRIBUTION_ON = true;
 
 constexpr bool SF_AUGER_CONTRIBUTION_DISTRIBUTE_EN = false;
 
+constexpr bool SF_PACKED_TRIANGULAR_SOLVER_ON = false;
+
+constexpr bool SF_PRECOMPUTED_OPERATORS_ON = false;
+
 constexpr double TEMPERATURE_SOLVER_ACCURACY = 1e-3;
 
 constexpr double CONTINUUM_NU_INTEGRAL_ACCURACY = 1e-3;
@@ -55,10 +55,8 @@ auto get_tau_sobolev(const int modelgridindex, const int lineindex, const double
   const double n_l = get_levelpop(modelgridindex, element, ion, lower);
   const double n_u = get_levelpop(modelgridindex, element, ion, upper);
 
-  const double nu_trans = (epsilon(element, ion, upper) - epsilon(element, ion, lower)) / H;
-  const double A_ul = einstein_spontaneous_emission(lineindex);
-  const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nu_trans, 3) * A_ul;
-  const double B_lu = stat_weight(element, ion, upper) / stat_weight(element, ion, lower) * B_ul;
+  const double B_ul = globals::linelist_B_ul[lineindex];
+  const double B_lu = globals::linelist_B_lu[lineindex];
 
   const double tau_sobolev = (B_lu * n_l - B_ul * n_u) * HCLIGHTOVERFOURPI * t_current;
   return tau_sobolev;
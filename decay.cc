@@ -722,6 +722,8 @@ void init_nuclides(const std::vector<int> &custom_zlist, const std::vector<int>
 
   /// Read in data for gamma ray lines and make a list of them in energy order.
   gammapkt::init_gamma_linelist();
+  gammapkt::init_gamma_opacity_lut();
+  gammapkt::init_compton_lut();
 
   // TODO: generalise this to all included nuclides
   printout("decayenergy(NI56), decayenergy(CO56), decayenergy_gamma(CO56): %g, %g, %g\n",
@@ -18,7 +18,7 @@
 FILE *output_file = nullptr;
 int tid = 0;
 bool use_cellhist = false;
-std::mt19937 stdrng(std::random_device{}());
+struct rngstate rngstate;
 gsl_integration_workspace *gslworkspace = nullptr;
 
 static void do_angle_bin(const int a, packet *pkts, bool load_allrank_packets, struct spec &rpkt_spectra,
@@ -216,7 +216,8 @@ auto main(int argc, char *argv[]) -> int {
   // nprocs_exspec is the number of rank output files to process with expec
   // however, we might be running exspec with 1 or just a few ranks
 
-  auto *pkts = static_cast<struct packet *>(malloc(globals::nprocs_exspec * globals::npkts * sizeof(struct packet)));
+  auto *pkts = static_cast<struct packet *>(
+      std::aligned_alloc(alignof(struct packet), globals::nprocs_exspec * globals::npkts * sizeof(struct packet)));
   const bool load_allrank_packets = (pkts != nullptr);
   if (load_allrank_packets) {
     printout("mem_usage: loading %d packets from each %d processes simultaneously (total %d packets, %.1f MB memory)\n",
@@ -228,7 +229,8 @@ auto main(int argc, char *argv[]) -> int {
         "mem_usage: loading %d packets from each of %d processes sequentially (total %d packets, %.1f MB memory)\n",
         globals::npkts, globals::nprocs_exspec, globals::nprocs_exspec * globals::npkts,
         globals::nprocs_exspec * globals::npkts * sizeof(struct packet) / 1024. / 1024.);
-    pkts = static_cast<struct packet *>(malloc(globals::npkts * sizeof(struct packet)));
+    pkts = static_cast<struct packet *>(
+        std::aligned_alloc(alignof(struct packet), globals::npkts * sizeof(struct packet)));
     assert_always(pkts != nullptr);
   }
 
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <fstream>
 #include <memory>
+#include <random>
 #include <vector>
 
 #include "decay.h"
@@ -202,16 +203,35 @@ void normalise_grey(int nts) {
   globals::timesteps[nts].gamma_dep_pathint = 0.;
   for (int nonemptymgi = 0; nonemptymgi < grid::get_nonempty_npts_model(); nonemptymgi++) {
     const int mgi = grid::get_mgi_of_nonemptymgi(nonemptymgi);
+    globals::timesteps[nts].gamma_dep_pathint += globals::rpkt_emiss[mgi] / globals::nprocs;
+  }
+
+  // node-shared estimators are normalised by one rank per node after every rank has read the unnormalised values
+  const bool normalise_rpkt_emiss = !grid::get_estimators_nodeshared() || globals::rank_in_node == 0;
+#ifdef MPI_ON
+  if constexpr (grid::get_estimators_nodeshared()) {
+    MPI_Barrier(globals::mpi_comm_node);
+  }
+#endif
 
-    const double dV = grid::get_modelcell_assocvolume_tmin(mgi) * pow(globals::timesteps[nts].mid / globals::tmin, 3);
+  if (normalise_rpkt_emiss) {
+    for (int nonemptymgi = 0; nonemptymgi < grid::get_nonempty_npts_model(); nonemptymgi++) {
+      const int mgi = grid::get_mgi_of_nonemptymgi(nonemptymgi);
 
-    globals::timesteps[nts].gamma_dep_pathint += globals::rpkt_emiss[mgi] / globals::nprocs;
+      const double dV = grid::get_modelcell_assocvolume_tmin(mgi) * pow(globals::timesteps[nts].mid / globals::tmin, 3);
+
+      globals::rpkt_emiss[mgi] = globals::rpkt_emiss[mgi] * ONEOVER4PI / dV / dt / globals::nprocs;
 
-    globals::rpkt_emiss[mgi] = globals::rpkt_emiss[mgi] * ONEOVER4PI / dV / dt / globals::nprocs;
+      assert_testmodeonly(globals::rpkt_emiss[mgi] >= 0.);
+      assert_testmodeonly(isfinite(globals::rpkt_emiss[mgi]));
+    }
+  }
 
-    assert_testmodeonly(globals::rpkt_emiss[mgi] >= 0.);
-    assert_testmodeonly(isfinite(globals::rpkt_emiss[mgi]));
+#ifdef MPI_ON
+  if constexpr (grid::get_estimators_nodeshared()) {
+    MPI_Barrier(globals::mpi_comm_node);
   }
+#endif
 }
 
 static void choose_gamma_ray(struct packet *pkt_ptr) {
@@ -317,21 +337,94 @@ constexpr auto sigma_compton_partial(const double x, const double f) -> double
   return (3 * SIGMA_T * (term1 + term2 + term3) / (8 * x));
 }
 
-static auto get_chi_compton_rf(const struct packet *pkt_ptr) -> double {
-  // calculate the absorption coefficient [cm^-1] for Compton scattering in the observer reference frame
-  // Start by working out the compton x-section in the co-moving frame.
+constexpr auto meanf_sigma(const double x) -> double
+// Routine to compute the mean energy converted to non-thermal electrons times
+// the Klein-Nishina cross section.
+{
+  const double f = 1 + (2 * x);
 
-  const double xx = H * pkt_ptr->nu_cmf / ME / CLIGHT / CLIGHT;
+  const double term0 = 2 / x;
+  const double term1 = (1 - (2 / x) - (3 / (x * x))) * log(f);
+  const double term2 = ((4 / x) + (3 / (x * x)) - 1) * 2 * x / f;
+  const double term3 = (1 - (2 / x) - (1 / (x * x))) * 2 * x * (1 + x) / f / f;
+  const double term4 = -2. * x * ((4 * x * x) + (6 * x) + 3) / 3 / f / f / f;
+
+  const double tot = 3 * SIGMA_T * (term0 + term1 + term2 + term3 + term4) / (8 * x);
+
+  return tot;
+}
+
+// With USE_LUT_GAMMA_OPACITY, the cross sections below are interpolated from a table with GAMMA_OPACITY_LUT_NPTS
+// frequencies spaced evenly in log(nu). The cells only differ in the electron and nucleus densities that multiply
+// them, so one table serves every cell and timestep
+constexpr int GAMMA_OPACITY_LUT_NPTS = 4096;
+constexpr double GAMMA_OPACITY_LUT_NUMIN = 1e-3 * MEV / H;
+constexpr double GAMMA_OPACITY_LUT_NUMAX = 100. * MEV / H;
+
+struct gamma_crosssections {
+  double compton;            // Klein-Nishina cross section per electron [cm^2]
+  double compton_meanf;      // as above, times the mean fraction of the energy given to the electron
+  double photo_electric_si;  // photoabsorption cross section per Si nucleus [cm^2]
+  double photo_electric_fe;  // photoabsorption cross section per Fe nucleus [cm^2]
+};
+
+static std::vector<struct gamma_crosssections> gamma_crosssections_lut;
+static double gamma_opacity_lut_delta_lognu = 0.;
+
+static auto calculate_gamma_crosssections(const double nu_cmf) -> struct gamma_crosssections {
+  const double xx = H * nu_cmf / ME / CLIGHT / CLIGHT;
 
-  // Use this to decide whether the Thompson limit is acceptable.
+  // Cross sections from Equation 2 of Ambwani & Sutherland (1988), attributed to Veigele (1973)
+  // 2.41326e19 Hz = 100 keV / H
+  const double hnu_over_100kev = nu_cmf / 2.41326e+19;
 
-  const double sigma_cmf = (xx < THOMSON_LIMIT) ? SIGMA_T : sigma_compton_partial(xx, 1 + (2 * xx));
+  return {.compton = (xx < THOMSON_LIMIT) ? SIGMA_T : sigma_compton_partial(xx, 1 + (2 * xx)),
+          .compton_meanf = meanf_sigma(xx),
+          .photo_electric_si = 1.16e-24 * pow(hnu_over_100kev, -3.13),
+          .photo_electric_fe = 25.7e-24 * pow(hnu_over_100kev, -3.0)};
+}
+
+void init_gamma_opacity_lut() {
+  if constexpr (!USE_LUT_GAMMA_OPACITY) {
+    return;
+  }
 
-  // Now need to multiply by the electron number density.
-  const double chi_cmf = sigma_cmf * grid::get_nnetot(grid::get_cell_modelgridindex(pkt_ptr->where));
+  gamma_opacity_lut_delta_lognu =
+      std::log(GAMMA_OPACITY_LUT_NUMAX / GAMMA_OPACITY_LUT_NUMIN) / (GAMMA_OPACITY_LUT_NPTS - 1);
+  gamma_crosssections_lut.resize(GAMMA_OPACITY_LUT_NPTS);
+  for (int i = 0; i < GAMMA_OPACITY_LUT_NPTS; i++) {
+    const double nu = GAMMA_OPACITY_LUT_NUMIN * std::exp(i * gamma_opacity_lut_delta_lognu);
+    gamma_crosssections_lut[i] = calculate_gamma_crosssections(nu);
+  }
+}
+
+static auto get_gamma_crosssections(const double nu_cmf) -> struct gamma_crosssections {
+  if constexpr (USE_LUT_GAMMA_OPACITY) {
+    if (nu_cmf >= GAMMA_OPACITY_LUT_NUMIN && nu_cmf < GAMMA_OPACITY_LUT_NUMAX) {
+      const double x = std::log(nu_cmf / GAMMA_OPACITY_LUT_NUMIN) / gamma_opacity_lut_delta_lognu;
+      const int i = std::min(static_cast<int>(x), GAMMA_OPACITY_LUT_NPTS - 2);
+      const double frac = x - i;
+      const auto &lower = gamma_crosssections_lut[i];
+      const auto &upper = gamma_crosssections_lut[i + 1];
+      return {.compton = lower.compton + frac * (upper.compton - lower.compton),
+              .compton_meanf = lower.compton_meanf + frac * (upper.compton_meanf - lower.compton_meanf),
+              .photo_electric_si =
+                  lower.photo_electric_si + frac * (upper.photo_electric_si - lower.photo_electric_si),
+              .photo_electric_fe =
+                  lower.photo_electric_fe + frac * (upper.photo_electric_fe - lower.photo_electric_fe)};
+    }
+  }
+  return calculate_gamma_crosssections(nu_cmf);
+}
+
+static auto get_chi_compton_rf(const struct packet *pkt_ptr, const struct gamma_crosssections &sigmas,
+                               const double dopplerfactor) -> double {
+  // calculate the absorption coefficient [cm^-1] for Compton scattering in the observer reference frame
+  // Start by working out the compton x-section in the co-moving frame and multiply by the electron number density.
+  const double chi_cmf = sigmas.compton * grid::get_nnetot(grid::get_cell_modelgridindex(pkt_ptr->where));
 
   // convert between frames
-  const double chi_rf = chi_cmf * doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  const double chi_rf = chi_cmf * dopplerfactor;
 
   assert_testmodeonly(std::isfinite(chi_rf));
 
@@ -374,6 +467,112 @@ static auto choose_f(const double xx, const double zrand) -> double
   return ftry;
 }
 
+// With USE_LUT_COMPTON_SCATTER, the energy loss factor f is interpolated from an inverse CDF table over log(x) and the
+// random number, which replaces the bisection in choose_f() for THOMSON_LIMIT <= x < COMPTON_LUT_XMAX. The table
+// holds (f - 1) / 2x, which rises smoothly from 0 to 1 with the random number at every x
+constexpr int COMPTON_LUT_NX = 128;
+constexpr int COMPTON_LUT_NZRAND = 257;
+constexpr double COMPTON_LUT_XMAX = 1000.;
+
+static std::vector<double> compton_lut_fracloss;  // [ix * COMPTON_LUT_NZRAND + izrand]
+static double compton_lut_delta_logx = 0.;
+
+static auto choose_f_lut(const double xx, const double zrand) -> double
+// bilinear interpolation of the inverse CDF table
+{
+  const double ix_real = std::log(xx / THOMSON_LIMIT) / compton_lut_delta_logx;
+  const int ix = std::clamp(static_cast<int>(ix_real), 0, COMPTON_LUT_NX - 2);
+  const double frac_x = ix_real - ix;
+
+  const double iz_real = zrand * (COMPTON_LUT_NZRAND - 1);
+  const int iz = std::min(static_cast<int>(iz_real), COMPTON_LUT_NZRAND - 2);
+  const double frac_z = iz_real - iz;
+
+  const double *const row_lower = &compton_lut_fracloss[ix * COMPTON_LUT_NZRAND];
+  const double *const row_upper = row_lower + COMPTON_LUT_NZRAND;
+  const double fracloss = (1. - frac_x) * ((1. - frac_z) * row_lower[iz] + frac_z * row_lower[iz + 1]) +
+                          frac_x * ((1. - frac_z) * row_upper[iz] + frac_z * row_upper[iz + 1]);
+
+  return 1. + 2. * xx * fracloss;
+}
+
+static void test_compton_lut()
+// two-sample Kolmogorov-Smirnov test of f sampled from the table against f sampled with choose_f() at several x,
+// including x between the table points. Uses its own random number generator so that the packet streams are unchanged
+{
+  constexpr int NSAMPLES = 20000;
+  // critical value at a significance level of 0.001
+  const double ks_critical = 1.95 * std::sqrt(2. / NSAMPLES);
+
+  std::mt19937_64 testrng(1234);
+  std::uniform_real_distribution<double> testdist(0., 1.);
+  std::vector<double> f_lut(NSAMPLES);
+  std::vector<double> f_ref(NSAMPLES);
+  for (const double xx : {0.02, 0.137, 1., 7.3, 250.}) {
+    for (int i = 0; i < NSAMPLES; i++) {
+      f_lut[i] = choose_f_lut(xx, testdist(testrng));
+      f_ref[i] = choose_f(xx, testdist(testrng));
+    }
+    std::ranges::sort(f_lut);
+    std::ranges::sort(f_ref);
+
+    // largest difference between the empirical CDFs
+    double ks_d = 0.;
+    int i_lut = 0;
+    int i_ref = 0;
+    while (i_lut < NSAMPLES && i_ref < NSAMPLES) {
+      if (f_lut[i_lut] <= f_ref[i_ref]) {
+        i_lut++;
+      } else {
+        i_ref++;
+      }
+      ks_d = std::max(ks_d, std::fabs(i_lut - i_ref) / NSAMPLES);
+    }
+
+    printout("Compton scattering f table test: x %g KS statistic %g (critical value %g)\n", xx, ks_d, ks_critical);
+    assert_always(ks_d < ks_critical);
+  }
+}
+
+void init_compton_lut()
+// the table is also built in TESTMODE, where it is tested against choose_f()
+{
+  if constexpr (!USE_LUT_COMPTON_SCATTER && !TESTMODE) {
+    return;
+  }
+
+  compton_lut_delta_logx = std::log(COMPTON_LUT_XMAX / THOMSON_LIMIT) / (COMPTON_LUT_NX - 1);
+  compton_lut_fracloss.resize(COMPTON_LUT_NX * COMPTON_LUT_NZRAND);
+  for (int ix = 0; ix < COMPTON_LUT_NX; ix++) {
+    const double xx = THOMSON_LIMIT * std::exp(ix * compton_lut_delta_logx);
+    double *const row = &compton_lut_fracloss[ix * COMPTON_LUT_NZRAND];
+    // the end points are exact and would make the relative tolerance of choose_f() undefined
+    row[0] = 0.;
+    row[COMPTON_LUT_NZRAND - 1] = 1.;
+    for (int iz = 1; iz < COMPTON_LUT_NZRAND - 1; iz++) {
+      const double zrand = static_cast<double>(iz) / (COMPTON_LUT_NZRAND - 1);
+      row[iz] = (choose_f(xx, zrand) - 1.) / (2. * xx);
+    }
+  }
+
+  // compare the interpolated values against choose_f() between the table points
+  double maxrelerror = 0.;
+  for (int ix = 0; ix < COMPTON_LUT_NX - 1; ix++) {
+    const double xx = THOMSON_LIMIT * std::exp((ix + 0.5) * compton_lut_delta_logx);
+    for (int iz = 0; iz < COMPTON_LUT_NZRAND - 1; iz++) {
+      const double zrand = (iz + 0.5) / (COMPTON_LUT_NZRAND - 1);
+      const double f = choose_f(xx, zrand);
+      maxrelerror = std::max(maxrelerror, std::fabs(choose_f_lut(xx, zrand) / f - 1.));
+    }
+  }
+  printout("Compton scattering f table: %d x values up to %g, %d random numbers, max relative error %g\n",
+           COMPTON_LUT_NX, COMPTON_LUT_XMAX, COMPTON_LUT_NZRAND, maxrelerror);
+
+  if constexpr (TESTMODE) {
+    test_compton_lut();
+  }
+}
+
 static auto thomson_angle() -> double {
   // For Thomson scattering we can get the new angle from a random number very easily.
 
@@ -424,7 +623,7 @@ static void compton_scatter(struct packet *pkt_ptr)
     stay_gamma = true;
   } else {
     const double zrand = rng_uniform();
-    f = choose_f(xx, zrand);
+    f = (USE_LUT_COMPTON_SCATTER && xx < COMPTON_LUT_XMAX) ? choose_f_lut(xx, zrand) : choose_f(xx, zrand);
 
     // Check that f lies between 1.0 and (2xx  + 1)
 
@@ -505,7 +704,8 @@ static void compton_scatter(struct packet *pkt_ptr)
   }
 }
 
-static auto get_chi_photo_electric_rf(const struct packet *pkt_ptr) -> double {
+static auto get_chi_photo_electric_rf(const struct packet *pkt_ptr, const struct gamma_crosssections &sigmas,
+                                      const double dopplerfactor) -> double {
   // calculate the absorption coefficient [cm^-1] for photo electric effect scattering in the observer reference frame
 
   double chi_cmf = NAN;
@@ -515,16 +715,11 @@ static auto get_chi_photo_electric_rf(const struct packet *pkt_ptr) -> double {
   const double rho = grid::get_rho(mgi);
 
   if (globals::gamma_kappagrey < 0) {
-    // Cross sections from Equation 2 of Ambwani & Sutherland (1988), attributed to Veigele (1973)
-
-    // 2.41326e19 Hz = 100 keV / H
-    const double hnu_over_100kev = pkt_ptr->nu_cmf / 2.41326e+19;
-
     // double sigma_cmf_cno = 0.0448e-24 * pow(hnu_over_100kev, -3.2);
 
-    const double sigma_cmf_si = 1.16e-24 * pow(hnu_over_100kev, -3.13);
+    const double sigma_cmf_si = sigmas.photo_electric_si;
 
-    const double sigma_cmf_fe = 25.7e-24 * pow(hnu_over_100kev, -3.0);
+    const double sigma_cmf_fe = sigmas.photo_electric_fe;
 
     // Now need to multiply by the particle number density.
 
@@ -543,11 +738,11 @@ static auto get_chi_photo_electric_rf(const struct packet *pkt_ptr) -> double {
 
   // Now convert between frames.
 
-  const double chi_rf = chi_cmf * doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  const double chi_rf = chi_cmf * dopplerfactor;
   return chi_rf;
 }
 
-static auto sigma_pair_prod_rf(const struct packet *pkt_ptr) -> double {
+static auto sigma_pair_prod_rf(const struct packet *pkt_ptr, const double dopplerfactor) -> double {
   // calculate the absorption coefficient [cm^-1] for pair production in the observer reference frame
 
   const int mgi = grid::get_cell_modelgridindex(pkt_ptr->where);
@@ -600,7 +795,7 @@ static auto sigma_pair_prod_rf(const struct packet *pkt_ptr) -> double {
 
   // Now need to convert between frames.
 
-  double chi_rf = chi_cmf * doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  double chi_rf = chi_cmf * dopplerfactor;
 
   if (chi_rf < 0) {
     printout("Negative pair production sigma. Setting to zero. Abort? %g\n", chi_rf);
@@ -610,23 +805,6 @@ static auto sigma_pair_prod_rf(const struct packet *pkt_ptr) -> double {
   return chi_rf;
 }
 
-constexpr auto meanf_sigma(const double x) -> double
-// Routine to compute the mean energy converted to non-thermal electrons times
-// the Klein-Nishina cross section.
-{
-  const double f = 1 + (2 * x);
-
-  const double term0 = 2 / x;
-  const double term1 = (1 - (2 / x) - (3 / (x * x))) * log(f);
-  const double term2 = ((4 / x) + (3 / (x * x)) - 1) * 2 * x / f;
-  const double term3 = (1 - (2 / x) - (1 / (x * x))) * 2 * x * (1 + x) / f / f;
-  const double term4 = -2. * x * ((4 * x * x) + (6 * x) + 3) / 3 / f / f / f;
-
-  const double tot = 3 * SIGMA_T * (term0 + term1 + term2 + term3 + term4) / (8 * x);
-
-  return tot;
-}
-
 static void rlc_emiss_gamma(const struct packet *pkt_ptr, const double dist) {
   // Subroutine to record the heating rate in a cell due to gamma rays.
   // By heating rate I mean, for now, really the rate at which the code is making
@@ -648,9 +826,11 @@ static void rlc_emiss_gamma(const struct packet *pkt_ptr, const double dist) {
   const double doppler_sq = doppler_squared_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
 
   const int mgi = grid::get_cell_modelgridindex(pkt_ptr->where);
-  const double xx = H * pkt_ptr->nu_cmf / ME / CLIGHT / CLIGHT;
-  double heating_cont = ((meanf_sigma(xx) * grid::get_nnetot(mgi)) + get_chi_photo_electric_rf(pkt_ptr) +
-                         (sigma_pair_prod_rf(pkt_ptr) * (1. - (2.46636e+20 / pkt_ptr->nu_cmf))));
+  const auto sigmas = get_gamma_crosssections(pkt_ptr->nu_cmf);
+  const double dopplerfactor = doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  double heating_cont = ((sigmas.compton_meanf * grid::get_nnetot(mgi)) +
+                         get_chi_photo_electric_rf(pkt_ptr, sigmas, dopplerfactor) +
+                         (sigma_pair_prod_rf(pkt_ptr, dopplerfactor) * (1. - (2.46636e+20 / pkt_ptr->nu_cmf))));
   heating_cont = heating_cont * pkt_ptr->e_rf * dist * doppler_sq;
 
   // The terms in the above are for Compton, photoelectric and pair production. The pair production one
@@ -664,7 +844,7 @@ static void rlc_emiss_gamma(const struct packet *pkt_ptr, const double dist) {
   //  This will all be done later
   assert_testmodeonly(heating_cont >= 0.);
   assert_testmodeonly(isfinite(heating_cont));
-  safeadd(globals::rpkt_emiss[mgi], heating_cont);
+  safeadd_nodeshared(globals::rpkt_emiss[mgi], heating_cont);
 }
 
 void pair_prod(struct packet *pkt_ptr) {
@@ -767,13 +947,16 @@ void do_gamma(struct packet *pkt_ptr, double t2)
   // Compton scattering - need to determine the scattering co-efficient.
   // Routine returns the value in the rest frame.
 
+  const auto sigmas = get_gamma_crosssections(pkt_ptr->nu_cmf);
+  const double dopplerfactor = doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+
   double chi_compton = 0.0;
   if (globals::gamma_kappagrey < 0) {
-    chi_compton = get_chi_compton_rf(pkt_ptr);
+    chi_compton = get_chi_compton_rf(pkt_ptr, sigmas, dopplerfactor);
   }
 
-  const double chi_photo_electric = get_chi_photo_electric_rf(pkt_ptr);
-  const double chi_pair_prod = sigma_pair_prod_rf(pkt_ptr);
+  const double chi_photo_electric = get_chi_photo_electric_rf(pkt_ptr, sigmas, dopplerfactor);
+  const double chi_pair_prod = sigma_pair_prod_rf(pkt_ptr, dopplerfactor);
   const double chi_tot = chi_compton + chi_photo_electric + chi_pair_prod;
 
   assert_testmodeonly(std::isfinite(chi_compton));
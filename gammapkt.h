@@ -5,6 +5,8 @@
 
 namespace gammapkt {
 void init_gamma_linelist();
+void init_gamma_opacity_lut();
+void init_compton_lut();
 void pellet_gamma_decay(struct packet *pkt_ptr);
 void do_gamma(struct packet *pkt_ptr, double t2);
 void normalise_grey(int nts);
@@ -53,6 +53,9 @@ int opacity_case;  // 0 normally, 1 for Fe-grp dependence.
 int nlines = -1;
 std::vector<struct elementlist_entry> elements;
 const struct linelist_entry *linelist = nullptr;
+const double *linelist_nu = nullptr;
+const double *linelist_B_ul = nullptr;
+const double *linelist_B_lu = nullptr;
 struct bflist_t *bflist = nullptr;
 
 // for USE_LUT_BFHEATING = true
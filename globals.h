@@ -132,8 +132,9 @@ struct elementlist_entry {
   bool has_nlte_levels;
 };
 
+// line metadata. The frequencies and Einstein B coefficients are in separate arrays (globals::linelist_nu etc.)
+// with the same indexing, so that scanning through line frequencies only touches the frequency array
 struct linelist_entry {
-  double nu;  /// Frequency of the line transition
   float einstein_A;
   int elementindex;     /// It's a transition of element (not its atomic number,
                         /// but the (x-1)th element included in the simulation.
@@ -157,6 +158,7 @@ struct rpkt_continuum_absorptioncoeffs {
   double ffheating = 0.;
   // double bfheating;
   int modelgridindex = -1;
+  int lutpoint = -1;  // point of the continuum opacity table for bound-free events (USE_LUT_CONTOPACITY), or -1
   bool recalculate_required = true;  // e.g. when cell or timestep has changed
 };
 
@@ -179,7 +181,6 @@ struct chlevels {
   std::array<double, MA_ACTION_COUNT> processrates;
   chphixstargets_t *chphixstargets;
   double bfheatingcoeff;
-  double population;
   double *sum_epstrans_rad_deexc;
   double *sum_internal_down_same;
   double *sum_internal_up_same;
@@ -193,13 +194,21 @@ struct chelements {
   struct chions *chions;  /// Pointer to the elements ionlist.
 };
 
+// number of lines in each block of the cellhistory tau_line_over_t cache
+constexpr int LINE_TAUBLOCKSIZE = 64;
+
 struct cellhistory {
   double *cooling_contrib;  /// Cooling contributions by the different processes.
   struct chelements *chelements;
   struct chlevels *ch_all_levels;
   double *ch_allcont_departureratios;
+  const double *levelpops;   /// level populations of the cell, indexed by uniquelevelindex
+  double *tau_line_over_t;   /// Sobolev optical depth divided by prop_time for each line, in linelist order
+  int *tau_line_blockstamp;  /// tau_line_stamp if a block of tau_line_over_t is valid, -tau_line_stamp while filling
+  int tau_line_stamp;        /// identifies the cell contents the tau_line_over_t blocks are valid for
   int cellnumber;  /// Identifies the cell the data is valid for.
   int bfheating_mgi;
+  const double *contopacity_lut;  /// continuum opacity table of the cell (USE_LUT_CONTOPACITY)
 };
 
 namespace globals {
@@ -248,6 +257,9 @@ extern int nlines;
 extern std::vector<struct elementlist_entry> elements;
 
 extern const struct linelist_entry *linelist;
+extern const double *linelist_nu;    /// Frequency of each line transition, sorted in descending order
+extern const double *linelist_B_ul;  /// Einstein B coefficient for stimulated emission
+extern const double *linelist_B_lu;  /// Einstein B coefficient for absorption
 extern struct bflist_t *bflist;
 
 // for USE_LUT_BFHEATING = true
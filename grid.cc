@@ -9,9 +9,12 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <numeric>
+#include <queue>
 #include <span>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "artisoptions.h"
@@ -76,6 +79,12 @@ std::vector<int> ranks_ndo;
 std::vector<int> ranks_ndo_nonempty;
 int maxndo = -1;
 
+// the rank that updates each model grid cell, and the cells of each rank in increasing order. These start as the
+// contiguous ranges above, and with DYNAMIC_LOAD_BALANCING_ON the non-empty cells are reassigned after each grid update
+std::vector<int> modelcell_rank;
+std::vector<std::vector<int>> ranks_modelcells;
+std::vector<double> modelcell_update_seconds;  // wall time of the last update of each cell
+
 auto wid_init(const int cellindex, const int axis) -> double
 // for a uniform grid this is the extent along the x,y,z coordinate (x_2 - x_1, etc.)
 // for spherical grid this is the radial extent (r_outer - r_inner)
@@ -878,6 +887,28 @@ static void allocate_composition_cooling()
   }
 }
 
+static auto alloc_estimator_array(const size_t count) -> double *
+// allocate a zeroed estimator array, which is a single copy in node-shared memory if get_estimators_nodeshared()
+{
+#ifdef MPI_ON
+  if constexpr (get_estimators_nodeshared()) {
+    MPI_Aint size = (globals::rank_in_node == 0) ? static_cast<MPI_Aint>(count * sizeof(double)) : 0;
+    int disp_unit = sizeof(double);
+    double *estimarray = nullptr;
+    MPI_Win win = MPI_WIN_NULL;
+    assert_always(MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &estimarray, &win) ==
+                  MPI_SUCCESS);
+    assert_always(MPI_Win_shared_query(win, 0, &size, &disp_unit, &estimarray) == MPI_SUCCESS);
+    if (globals::rank_in_node == 0) {
+      std::fill_n(estimarray, count, 0.);
+    }
+    MPI_Barrier(globals::mpi_comm_node);
+    return estimarray;
+  }
+#endif
+  return static_cast<double *>(calloc(count, sizeof(double)));
+}
+
 static void allocate_nonemptymodelcells() {
   /// This is the placeholder for empty cells. Temperatures must be positive
   /// as long as ff opacities are calculated.
@@ -952,9 +983,9 @@ static void allocate_nonemptymodelcells() {
 
   allocate_composition_cooling();
 
-  globals::rpkt_emiss = static_cast<double *>(calloc((get_npts_model() + 1), sizeof(double)));
+  globals::rpkt_emiss = alloc_estimator_array(get_npts_model() + 1);
 
-  size_t ionestimsize = get_nonempty_npts_model() * get_includedions() * sizeof(double);
+  const size_t nionestims = get_nonempty_npts_model() * get_includedions();
 
 #ifdef MPI_ON
   if constexpr (USE_LUT_PHOTOION) {
@@ -973,27 +1004,27 @@ static void allocate_nonemptymodelcells() {
   }
 #else
   if constexpr (USE_LUT_PHOTOION) {
-    globals::corrphotoionrenorm = static_cast<double *>(malloc(ionestimsize));
+    globals::corrphotoionrenorm = static_cast<double *>(malloc(nionestims * sizeof(double)));
   }
 #endif
 
   if constexpr (USE_LUT_BFHEATING) {
-    globals::bfheatingestimator = static_cast<double *>(malloc(ionestimsize));
+    globals::bfheatingestimator = alloc_estimator_array(nionestims);
 #ifdef DO_TITER
-    globals::bfheatingestimator_save = static_cast<double *>(malloc(ionestimsize));
+    globals::bfheatingestimator_save = static_cast<double *>(malloc(nionestims * sizeof(double)));
 #endif
   }
 
   if constexpr (USE_LUT_PHOTOION) {
-    globals::gammaestimator = static_cast<double *>(malloc(ionestimsize));
+    globals::gammaestimator = alloc_estimator_array(nionestims);
 
 #ifdef DO_TITER
-    globals::gammaestimator_save = static_cast<double *>(malloc(ionestimsize));
+    globals::gammaestimator_save = static_cast<double *>(malloc(nionestims * sizeof(double)));
 #endif
   }
 
-  globals::ffheatingestimator = static_cast<double *>(malloc((get_npts_model() + 1) * sizeof(double)));
-  globals::colheatingestimator = static_cast<double *>(malloc((get_npts_model() + 1) * sizeof(double)));
+  globals::ffheatingestimator = alloc_estimator_array(get_npts_model() + 1);
+  globals::colheatingestimator = alloc_estimator_array(get_npts_model() + 1);
 #ifdef DO_TITER
   globals::ffheatingestimator_save = static_cast<double *>(malloc((get_npts_model() + 1) * sizeof(double)));
   globals::colheatingestimator_save = static_cast<double *>(malloc((get_npts_model() + 1) * sizeof(double)));
@@ -1707,6 +1738,69 @@ void read_ejecta_model() {
   read_possible_yefile();
 }
 
+static void assign_modelcell_ranks_by_cost()
+// longest processing time first: each non-empty cell, from the most to the least expensive, goes to the rank with the
+// lowest total cost so far. Empty cells are cheap and stay on their initial rank. The assignment only depends on
+// modelcell_update_seconds, so every rank computes the same one
+{
+  const int nprocesses = globals::nprocs;
+
+  // every rank must keep at least one non-empty cell, since the per-rank output files are only opened by ranks that
+  // start with non-empty cells
+  if (nprocesses < 2 || nprocesses > get_nonempty_npts_model()) {
+    return;
+  }
+
+  std::vector<int> nonemptycells(get_nonempty_npts_model());
+  for (int nonemptymgi = 0; nonemptymgi < get_nonempty_npts_model(); nonemptymgi++) {
+    nonemptycells[nonemptymgi] = get_mgi_of_nonemptymgi(nonemptymgi);
+  }
+  std::ranges::stable_sort(nonemptycells, [](const int mgi_a, const int mgi_b) {
+    return modelcell_update_seconds[mgi_a] > modelcell_update_seconds[mgi_b];
+  });
+
+  // ranks are ordered by total cost, then by number of cells (in case of cells with zero cost), then by rank
+  std::vector<double> rank_cost(nprocesses, 0.);
+  std::vector<int> rank_ncells(nprocesses, 0);
+  using rank_load = std::tuple<double, int, int>;
+  std::priority_queue<rank_load, std::vector<rank_load>, std::greater<>> rank_queue;
+  for (int r = 0; r < nprocesses; r++) {
+    rank_queue.emplace(0., 0, r);
+  }
+
+  for (const int mgi : nonemptycells) {
+    const int rank = std::get<2>(rank_queue.top());
+    rank_queue.pop();
+    modelcell_rank[mgi] = rank;
+    rank_cost[rank] += modelcell_update_seconds[mgi];
+    rank_ncells[rank]++;
+    rank_queue.emplace(rank_cost[rank], rank_ncells[rank], rank);
+  }
+
+  maxndo = 0;
+  for (int r = 0; r < nprocesses; r++) {
+    ranks_modelcells[r].clear();
+    ranks_ndo[r] = 0;
+    ranks_ndo_nonempty[r] = 0;
+  }
+  for (int mgi = 0; mgi < get_npts_model(); mgi++) {
+    const int rank = modelcell_rank[mgi];
+    ranks_modelcells[rank].push_back(mgi);
+    ranks_ndo[rank]++;
+    maxndo = std::max(maxndo, ranks_ndo[rank]);
+    if (get_numassociatedcells(mgi) > 0) {
+      ranks_ndo_nonempty[rank]++;
+    }
+  }
+
+  const double cost_total = std::accumulate(rank_cost.begin(), rank_cost.end(), 0.);
+  printout(
+      "load balancing: assigned %d non-empty cells with a total update cost of %.2fs. The rank costs will be %.2fs "
+      "(max) and %.2fs (mean), with this rank (%d) updating %d cells\n",
+      get_nonempty_npts_model(), cost_total, *std::ranges::max_element(rank_cost), cost_total / nprocesses,
+      globals::rank_global, ranks_ndo_nonempty[globals::rank_global]);
+}
+
 static void read_grid_restart_data(const int timestep) {
   char filename[MAXFILENAMELENGTH];
   snprintf(filename, MAXFILENAMELENGTH, "gridsave_ts%d.tmp", timestep);
@@ -1774,14 +1868,20 @@ static void read_grid_restart_data(const int timestep) {
     set_W(mgi, W);
     set_TJ(mgi, T_J);
     modelgrid[mgi].thick = thick;
-    globals::rpkt_emiss[mgi] = rpkt_emiss;
+    if (!get_estimators_nodeshared() || globals::rank_in_node == 0) {
+      globals::rpkt_emiss[mgi] = rpkt_emiss;
+    }
 
     if constexpr (USE_LUT_PHOTOION) {
       for (int element = 0; element < get_nelements(); element++) {
         for (int ion = 0; ion < (get_nions(element) - 1); ion++) {
           const int estimindex = get_ionestimindex(mgi, element, ion);
+          double gammaestimator = 0.;
           assert_always(fscanf(gridsave_file, " %la %la", &globals::corrphotoionrenorm[estimindex],
-                               &globals::gammaestimator[estimindex]) == 2);
+                               &gammaestimator) == 2);
+          if (!get_estimators_nodeshared() || globals::rank_in_node == 0) {
+            globals::gammaestimator[estimindex] = gammaestimator;
+          }
         }
       }
     }
@@ -1791,6 +1891,16 @@ static void read_grid_restart_data(const int timestep) {
   radfield::read_restart_data(gridsave_file);
   nonthermal::read_restart_data(gridsave_file);
   nltepop_read_restart_data(gridsave_file);
+
+  if constexpr (DYNAMIC_LOAD_BALANCING_ON) {
+    // every rank reads the same cell costs, so they all continue with the same cell assignments
+    for (int mgi = 0; mgi < get_npts_model(); mgi++) {
+      int mgi_in = -1;
+      assert_always(fscanf(gridsave_file, "%d %la ", &mgi_in, &modelcell_update_seconds[mgi]) == 2);
+      assert_always(mgi_in == mgi);
+    }
+    assign_modelcell_ranks_by_cost();
+  }
   fclose(gridsave_file);
 }
 
@@ -1844,6 +1954,12 @@ void write_grid_restart_data(const int timestep) {
   radfield::write_restart_data(gridsave_file);
   nonthermal::write_restart_data(gridsave_file);
   nltepop_write_restart_data(gridsave_file);
+
+  if constexpr (DYNAMIC_LOAD_BALANCING_ON) {
+    for (int mgi = 0; mgi < get_npts_model(); mgi++) {
+      fprintf(gridsave_file, "%d %la\n", mgi, modelcell_update_seconds[mgi]);
+    }
+  }
   fclose(gridsave_file);
   printout("done in %ld seconds.\n", time(nullptr) - sys_time_start_write_restart);
 }
@@ -1961,6 +2077,16 @@ static void setup_nstart_ndo() {
   assert_always(npts_assigned == get_npts_model());
   assert_always(npts_nonempty_assigned == get_nonempty_npts_model());
 
+  modelcell_rank = std::vector<int>(get_npts_model(), -1);
+  ranks_modelcells = std::vector<std::vector<int>>(nprocesses);
+  modelcell_update_seconds = std::vector<double>(get_npts_model(), 0.);
+  for (int r = 0; r < nprocesses; r++) {
+    for (int mgi = ranks_nstart[r]; mgi < ranks_nstart[r] + ranks_ndo[r]; mgi++) {
+      modelcell_rank[mgi] = r;
+      ranks_modelcells[r].push_back(mgi);
+    }
+  }
+
   if (globals::rank_global == 0) {
     auto fileout = std::ofstream("modelgridrankassignments.out");
     assert_always(fileout.is_open());
@@ -1999,6 +2125,47 @@ auto get_ndo_nonempty(const int rank) -> int {
   return ranks_ndo_nonempty[rank];
 }
 
+auto get_modelcell_rank(const int mgi) -> int
+// the rank that updates the cell in update_grid
+{
+  if (ranks_ndo.empty()) {
+    setup_nstart_ndo();
+  }
+  return modelcell_rank[mgi];
+}
+
+auto get_rank_modelcells(const int rank) -> const std::vector<int> &
+// the cells updated by a rank, in increasing order
+{
+  if (ranks_ndo.empty()) {
+    setup_nstart_ndo();
+  }
+  return ranks_modelcells[rank];
+}
+
+void set_modelcell_update_seconds(const int mgi, const double seconds) { modelcell_update_seconds[mgi] = seconds; }
+
+void rebalance_modelcell_ranks()
+// after the grid properties have been exchanged, gather the update costs of all cells and reassign the cells for the
+// next update_grid
+{
+  if constexpr (!DYNAMIC_LOAD_BALANCING_ON) {
+    return;
+  }
+
+  // each cell was only timed by the rank that updated it
+  std::vector<double> cellcost(get_npts_model(), 0.);
+  for (const int mgi : get_rank_modelcells(globals::rank_global)) {
+    cellcost[mgi] = modelcell_update_seconds[mgi];
+  }
+#ifdef MPI_ON
+  MPI_Allreduce(MPI_IN_PLACE, cellcost.data(), get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+  modelcell_update_seconds = cellcost;
+
+  assign_modelcell_ranks_by_cost();
+}
+
 static void setup_grid_cartesian_3d()
 /// Routine for doing a uniform cuboidal grid.
 {
@@ -3,6 +3,7 @@
 
 #include <cinttypes>
 #include <span>
+#include <vector>
 
 #include "artisoptions.h"
 #include "constants.h"
@@ -130,11 +131,25 @@ auto get_maxndo() -> int;
 auto get_nstart(int rank) -> int;
 auto get_ndo(int rank) -> int;
 auto get_ndo_nonempty(int rank) -> int;
+auto get_modelcell_rank(int mgi) -> int;
+auto get_rank_modelcells(int rank) -> const std::vector<int> &;
+void set_modelcell_update_seconds(int mgi, double seconds);
+void rebalance_modelcell_ranks();
 auto get_totmassradionuclide(int z, int a) -> double;
 double boundary_distance(std::span<const double, 3> dir, std::span<const double, 3> pos, double tstart, int cellindex,
                          int *snext, enum cell_boundary *pkt_last_cross);
 void change_cell(struct packet *pkt_ptr, int snext);
 
+constexpr auto get_estimators_nodeshared() -> bool
+// true if the ff/col/bf heating, gamma, and rpkt_emiss estimators have one copy per node (updated by all of its ranks)
+{
+#ifdef MPI_ON
+  return NODESHARED_ESTIMATORS_ON;
+#else
+  return false;
+#endif
+}
+
 static inline auto get_elem_abundance(int modelgridindex, int element) -> float
 // mass fraction of an element (all isotopes combined)
 {
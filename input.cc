@@ -10,6 +10,7 @@
 #include <fstream>
 #include <limits>
 #include <memory>
+#include <random>
 #include <sstream>
 #include <vector>
 
@@ -18,6 +19,7 @@
 #include "grid.h"
 #include "kpkt.h"
 #include "ratecoeff.h"
+#include "rpkt.h"
 #include "sn3d.h"
 #include "vpkt.h"
 
@@ -36,6 +38,11 @@ struct transitiontable_entry {
   bool forbidden;
 };  /// only used temporarily during input
 
+struct unsorted_line {
+  double nu;
+  struct linelist_entry line;
+};  /// only used temporarily during input, before the line list is sorted and split into arrays
+
 constexpr std::array<std::string_view, 24> inputlinecomments = {
     " 0: pre_zseed: specific random number seed if > 0 or random if negative",
     " 1: ntimesteps: number of timesteps",
@@ -490,7 +497,7 @@ static void read_ion_transitions(std::fstream &ftransitiondata, const int tottra
 static void add_transitions_to_unsorted_linelist(const int element, const int ion, const int nlevelsmax,
                                                  const std::vector<struct transitiontable_entry> &transitiontable,
                                                  struct transitions *transitions, int *lineindex,
-                                                 std::vector<struct linelist_entry> &temp_linelist) {
+                                                 std::vector<struct unsorted_line> &temp_linelist) {
   const int lineindex_initial = *lineindex;
   const auto tottransitions = transitiontable.size();
   size_t totupdowntrans = 0;
@@ -512,8 +519,8 @@ static void add_transitions_to_unsorted_linelist(const int element, const int io
         my_rank_trans += totupdowntrans - (my_rank_trans * globals::node_nprocs);
       }
 
-      MPI_Aint size = my_rank_trans * sizeof(linelist_entry);
-      int disp_unit = sizeof(linelist_entry);
+      MPI_Aint size = my_rank_trans * sizeof(struct level_transition);
+      int disp_unit = sizeof(struct level_transition);
       MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &alltransblock, &win);
 
       MPI_Win_shared_query(win, 0, &size, &disp_unit, &alltransblock);
@@ -583,11 +590,14 @@ static void add_transitions_to_unsorted_linelist(const int element, const int io
 
           temp_linelist.push_back({
               .nu = nu_trans,
-              .einstein_A = A_ul,
-              .elementindex = element,
-              .ionindex = ion,
-              .upperlevelindex = level,
-              .lowerlevelindex = targetlevel,
+              .line =
+                  {
+                      .einstein_A = A_ul,
+                      .elementindex = element,
+                      .ionindex = ion,
+                      .upperlevelindex = level,
+                      .lowerlevelindex = targetlevel,
+                  },
           });
 
           // the line list has not been sorted yet, so the store the level index for now and
@@ -623,9 +633,9 @@ static void add_transitions_to_unsorted_linelist(const int element, const int io
         const auto g_ratio = stat_weight(element, ion, level) / stat_weight(element, ion, targetlevel);
         const float f_ul = g_ratio * ME * pow(CLIGHT, 3) / (8 * pow(QE * nu_trans * PI, 2)) * A_ul;
 
-        if ((temp_linelist[linelistindex].elementindex != element) || (temp_linelist[linelistindex].ionindex != ion) ||
-            (temp_linelist[linelistindex].upperlevelindex != level) ||
-            (temp_linelist[linelistindex].lowerlevelindex != targetlevel)) {
+        const auto &existingline = temp_linelist[linelistindex].line;
+        if ((existingline.elementindex != element) || (existingline.ionindex != ion) ||
+            (existingline.upperlevelindex != level) || (existingline.lowerlevelindex != targetlevel)) {
           printout("[input] Failure to identify level pair for duplicate bb-transition ... going to abort now\n");
           printout("[input]   element %d ion %d targetlevel %d level %d\n", element, ion, targetlevel, level);
           printout("[input]   transitions[level].to[level-targetlevel-1]=linelistindex %d\n",
@@ -635,8 +645,8 @@ static void add_transitions_to_unsorted_linelist(const int element, const int io
               "[input]   globals::linelist[linelistindex].elementindex %d, "
               "globals::linelist[linelistindex].ionindex %d, globals::linelist[linelistindex].upperlevelindex "
               "%d, globals::linelist[linelistindex].lowerlevelindex %d\n",
-              temp_linelist[linelistindex].elementindex, temp_linelist[linelistindex].ionindex,
-              temp_linelist[linelistindex].upperlevelindex, temp_linelist[linelistindex].lowerlevelindex);
+              existingline.elementindex, existingline.ionindex, existingline.upperlevelindex,
+              existingline.lowerlevelindex);
           abort();
         }
         const int nupperdowntrans = get_ndowntrans(element, ion, level) + 1;
@@ -717,7 +727,7 @@ static void read_atomicdata_files() {
   set_nelements(nelements_in);
 
   /// Initialize the linelist
-  std::vector<struct linelist_entry> temp_linelist;
+  std::vector<struct unsorted_line> temp_linelist;
 
   std::vector<struct transitiontable_entry> transitiontable;
 
@@ -950,25 +960,28 @@ static void read_atomicdata_files() {
       const double nu = temp_linelist[i].nu;
       const double nu_next = temp_linelist[i + 1].nu;
       if (fabs(nu_next - nu) < (1.e-10 * nu)) {
-        auto *a1 = &temp_linelist[i];
-        auto *a2 = &temp_linelist[i + 1];
+        const auto *a1 = &temp_linelist[i].line;
+        const auto *a2 = &temp_linelist[i + 1].line;
 
         if ((a1->elementindex == a2->elementindex) && (a1->ionindex == a2->ionindex) &&
             (a1->lowerlevelindex == a2->lowerlevelindex) && (a1->upperlevelindex == a2->upperlevelindex)) {
-          printout("Duplicate transition line? %s\n", a1->nu == a2->nu ? "nu match exact" : "close to nu match");
+          printout("Duplicate transition line? %s\n", nu == nu_next ? "nu match exact" : "close to nu match");
           printout("a: Z=%d ionstage %d lower %d upper %d nu %g lambda %g\n", get_atomicnumber(a1->elementindex),
-                   get_ionstage(a1->elementindex, a1->ionindex), a1->lowerlevelindex, a1->upperlevelindex, a1->nu,
-                   1e8 * CLIGHT / a1->nu);
+                   get_ionstage(a1->elementindex, a1->ionindex), a1->lowerlevelindex, a1->upperlevelindex, nu,
+                   1e8 * CLIGHT / nu);
           printout("b: Z=%d ionstage %d lower %d upper %d nu %g lambda %g\n", get_atomicnumber(a2->elementindex),
-                   get_ionstage(a2->elementindex, a2->ionindex), a2->lowerlevelindex, a2->upperlevelindex, a2->nu,
-                   1e8 * CLIGHT / a2->nu);
+                   get_ionstage(a2->elementindex, a2->ionindex), a2->lowerlevelindex, a2->upperlevelindex, nu_next,
+                   1e8 * CLIGHT / nu_next);
         }
       }
     }
   }
 
-  // create a linelist shared on node and then copy data across, freeing the local copy
-  struct linelist_entry *nonconstlinelist = nullptr;
+  // create a linelist shared on node and then copy data across, freeing the local copy.
+  // The line list is split into parallel arrays (frequencies, Einstein B coefficients, and the remaining metadata)
+  // that all live in one shared block. The double arrays come first to keep them aligned.
+  const size_t linelist_bytes_per_line = 3 * sizeof(double) + sizeof(struct linelist_entry);
+  char *linelistblock = nullptr;
 #ifdef MPI_ON
   MPI_Win win = MPI_WIN_NULL;
 
@@ -978,17 +991,32 @@ static void read_atomicdata_files() {
     my_rank_lines += globals::nlines - (my_rank_lines * globals::node_nprocs);
   }
 
-  MPI_Aint size = my_rank_lines * sizeof(linelist_entry);
-  int disp_unit = sizeof(linelist_entry);
-  MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &nonconstlinelist, &win);
+  MPI_Aint size = my_rank_lines * linelist_bytes_per_line;
+  int disp_unit = 1;
+  MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &linelistblock, &win);
 
-  MPI_Win_shared_query(win, 0, &size, &disp_unit, &nonconstlinelist);
+  MPI_Win_shared_query(win, 0, &size, &disp_unit, &linelistblock);
 #else
-  nonconstlinelist = static_cast<struct linelist_entry *>(malloc(globals::nlines * sizeof(linelist_entry)));
+  linelistblock = static_cast<char *>(malloc(globals::nlines * linelist_bytes_per_line));
 #endif
 
+  auto *nonconstlinelist_nu = reinterpret_cast<double *>(linelistblock);
+  auto *nonconstlinelist_B_ul = nonconstlinelist_nu + globals::nlines;
+  auto *nonconstlinelist_B_lu = nonconstlinelist_B_ul + globals::nlines;
+  auto *nonconstlinelist = reinterpret_cast<struct linelist_entry *>(nonconstlinelist_B_lu + globals::nlines);
+
   if (globals::rank_in_node == 0) {
-    memcpy(static_cast<void *>(nonconstlinelist), temp_linelist.data(), globals::nlines * sizeof(linelist_entry));
+    for (int i = 0; i < globals::nlines; i++) {
+      const auto &line = temp_linelist[i].line;
+      const double nu = temp_linelist[i].nu;
+      const double A_ul = line.einstein_A;
+      const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nu, 3) * A_ul;
+      nonconstlinelist_nu[i] = nu;
+      nonconstlinelist_B_ul[i] = B_ul;
+      nonconstlinelist_B_lu[i] = stat_weight(line.elementindex, line.ionindex, line.upperlevelindex) /
+                                 stat_weight(line.elementindex, line.ionindex, line.lowerlevelindex) * B_ul;
+      nonconstlinelist[i] = line;
+    }
     temp_linelist.clear();
   }
 
@@ -996,9 +1024,13 @@ static void read_atomicdata_files() {
   MPI_Barrier(MPI_COMM_WORLD);
 #endif
   globals::linelist = nonconstlinelist;
-  nonconstlinelist = nullptr;
+  globals::linelist_nu = nonconstlinelist_nu;
+  globals::linelist_B_ul = nonconstlinelist_B_ul;
+  globals::linelist_B_lu = nonconstlinelist_B_lu;
   printout("[info] mem_usage: linelist occupies %.3f MB (node shared memory)\n",
-           globals::nlines * sizeof(struct linelist_entry) / 1024. / 1024);
+           globals::nlines * linelist_bytes_per_line / 1024. / 1024);
+
+  setup_linelist_buckets();
 
   /// Save sorted linelist into a file
   // if (rank_global == 0)
@@ -1301,6 +1333,13 @@ static void setup_cellhistory() {
         static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
     mem_usage_cellhistory += globals::nbfcontinua * sizeof(double);
 
+    // these point into the cell cache (see init_cellcache()) after a cellhistory_reset()
+    globals::cellhistory[tid].levelpops = nullptr;
+    globals::cellhistory[tid].tau_line_over_t = nullptr;
+    globals::cellhistory[tid].tau_line_blockstamp = nullptr;
+    globals::cellhistory[tid].tau_line_stamp = 0;
+    globals::cellhistory[tid].contopacity_lut = nullptr;
+
     printout("[info] mem_usage: cellhistory for thread %d occupies %.3f MB\n", tid,
              mem_usage_cellhistory / 1024. / 1024.);
 #ifdef _OPENMP
@@ -1598,6 +1637,7 @@ static void read_atomicdata() {
   }
 
   kpkt::setup_coolinglist();
+  kpkt::init_planck_lut();
 
   setup_cellhistory();
 
@@ -1774,16 +1814,10 @@ void read_parameterfile(int rank)
 #pragma omp parallel
   {
 #endif
-    /// For MPI parallelisation, the random seed is changed based on the rank of the process
-    /// For OpenMP parallelisation rng is a threadprivate variable and the seed changed according
-    /// to the thread-ID tid.
-    const auto zseed = pre_zseed + 13 * (rank * get_num_threads() + tid);
-    printout("rank %d: thread %d has zseed %lu\n", rank, tid, zseed);
-    rng_init(zseed);
-    /// call it a few times
-    for (int n = 0; n < 100; n++) {
-      rng_uniform();
-    }
+    /// All threads share the seed. Each packet draws from its own stream (see rng_set_stream()), and anything else
+    /// uses a stream that depends on the rank and thread-ID tid.
+    printout("rank %d: thread %d has zseed %lu\n", rank, tid, pre_zseed);
+    rng_init(pre_zseed, rank, tid);
 #ifdef _OPENMP
   }
 #endif
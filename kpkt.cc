@@ -3,7 +3,9 @@
 #include <gsl/gsl_integration.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <vector>
 
 #include "atomic.h"
 #include "grid.h"
@@ -12,6 +14,7 @@
 #include "radfield.h"
 #include "ratecoeff.h"
 #include "rpkt.h"
+#include "sn3d.h"
 #include "stats.h"
 #include "thermalbalance.h"
 #include "vectors.h"
@@ -36,16 +39,25 @@ struct cellhistorycoolinglist {
 
 static struct cellhistorycoolinglist *coolinglist;
 
+// with KPKT_COOLING_CDF_ON, the cumulative cooling contributions of each cell in coolinglist order (over all ions
+// without restarting from zero) in node-shared memory, indexed by [nonemptymgi * ncoolingterms + i]. The table of a
+// cell is built by the first thread on the node that needs it after each grid update, from cell properties that every
+// rank already has, so the tables are never sent between ranks
+static double *cellcooling_cdf = nullptr;
+// for each cell, cellcooling_cdf_generation if the table is valid, or -cellcooling_cdf_generation while it is built
+static int *cellcooling_cdf_stamp = nullptr;
+static int cellcooling_cdf_generation = 0;  // incremented on every grid update
+
 static auto get_ncoolingterms_ion(int element, int ion) -> int {
   return globals::elements[element].ions[ion].ncoolingterms;
 }
 
 template <bool update_cooling_contrib_list>
 static auto calculate_cooling_rates_ion(const int modelgridindex, const int element, const int ion,
-                                        const int indexionstart, const int tid, double *C_ff, double *C_fb,
+                                        const int indexionstart, double *cooling_contrib, double *C_ff, double *C_fb,
                                         double *C_exc, double *C_ionization) -> double
 // calculate the cooling contribution list of individual levels/processes for an ion
-// oldcoolingsum is the sum of lower ion (of same element or all ions of lower elements) cooling contributions
+// with update_cooling_contrib_list, the cumulative sums starting from zero for the ion are written to cooling_contrib
 {
   const auto nne = grid::get_nne(modelgridindex);
   const auto T_e = grid::get_Te(modelgridindex);
@@ -66,7 +78,7 @@ static auto calculate_cooling_rates_ion(const int modelgridindex, const int elem
     C_ion += C_ff_ion;
 
     if constexpr (update_cooling_contrib_list) {
-      globals::cellhistory[tid].cooling_contrib[i] = C_ion;
+      cooling_contrib[i] = C_ion;
 
       assert_testmodeonly(coolinglist[i].type == COOLINGTYPE_FF);
       assert_testmodeonly(coolinglist[i].element == element);
@@ -103,7 +115,7 @@ static auto calculate_cooling_rates_ion(const int modelgridindex, const int elem
         }
       }
       if constexpr (update_cooling_contrib_list) {
-        globals::cellhistory[tid].cooling_contrib[i] = C_ion;
+        cooling_contrib[i] = C_ion;
 
         assert_testmodeonly(coolinglist[i].type == COOLINGTYPE_COLLEXC);
         assert_testmodeonly(coolinglist[i].element == element);
@@ -132,7 +144,7 @@ static auto calculate_cooling_rates_ion(const int modelgridindex, const int elem
 
         C_ion += C;
         if constexpr (update_cooling_contrib_list) {
-          globals::cellhistory[tid].cooling_contrib[i] = C_ion;
+          cooling_contrib[i] = C_ion;
 
           assert_testmodeonly(coolinglist[i].type == COOLINGTYPE_COLLION);
           assert_testmodeonly(coolinglist[i].element == element);
@@ -160,7 +172,7 @@ static auto calculate_cooling_rates_ion(const int modelgridindex, const int elem
         C_ion += C;
 
         if constexpr (update_cooling_contrib_list) {
-          globals::cellhistory[tid].cooling_contrib[i] = C_ion;
+          cooling_contrib[i] = C_ion;
 
           assert_testmodeonly(coolinglist[i].type == COOLINGTYPE_FB);
           assert_testmodeonly(coolinglist[i].element == element);
@@ -195,7 +207,7 @@ void calculate_cooling_rates(const int modelgridindex, struct heatingcoolingrate
   for (int element = 0; element < get_nelements(); element++) {
     const int nions = get_nions(element);
     for (int ion = 0; ion < nions; ion++) {
-      const double C_ion = calculate_cooling_rates_ion<false>(modelgridindex, element, ion, -1, tid, &C_ff_all,
+      const double C_ion = calculate_cooling_rates_ion<false>(modelgridindex, element, ion, -1, nullptr, &C_ff_all,
                                                               &C_fb_all, &C_exc_all, &C_ionization_all);
       grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion] = C_ion;
     }
@@ -338,6 +350,83 @@ void setup_coolinglist() {
   printout("[info] read_atomicdata: number of coolingterms %d\n", globals::ncoolingterms);
 }
 
+// With USE_LUT_PLANCK_SAMPLING, blackbody frequencies are sampled from the cumulative distribution of
+// x^3 / (exp(x) - 1) with x = h nu / kT, which is the same for every temperature. It is tabulated at PLANCK_LUT_NPTS
+// evenly spaced x and inverted with a guide table, so that a sample needs one random number and a short search.
+constexpr int PLANCK_LUT_NPTS = 8192;
+constexpr double PLANCK_LUT_XMAX = 60.;  // the cumulative distribution differs from one by about 1e-21 here
+constexpr double PLANCK_LUT_DELTAX = PLANCK_LUT_XMAX / (PLANCK_LUT_NPTS - 1);
+
+static std::vector<double> planck_lut_cdf;
+static std::vector<int> planck_lut_guide;  // [j] is the last point with cdf <= j / PLANCK_LUT_NPTS
+
+void init_planck_lut() {
+  if constexpr (!USE_LUT_PLANCK_SAMPLING) {
+    return;
+  }
+
+  const auto integrand = [](const double x) { return (x > 0.) ? std::pow(x, 3) / std::expm1(x) : 0.; };
+
+  // Simpson's rule on each interval
+  planck_lut_cdf.resize(PLANCK_LUT_NPTS);
+  planck_lut_cdf[0] = 0.;
+  constexpr int nsubsteps = 8;
+  constexpr double dx_sub = PLANCK_LUT_DELTAX / nsubsteps;
+  for (int i = 1; i < PLANCK_LUT_NPTS; i++) {
+    double interval_integral = 0.;
+    for (int j = 0; j < nsubsteps; j++) {
+      const double x_a = (i - 1) * PLANCK_LUT_DELTAX + j * dx_sub;
+      interval_integral +=
+          dx_sub / 6. * (integrand(x_a) + 4. * integrand(x_a + dx_sub / 2.) + integrand(x_a + dx_sub));
+    }
+    planck_lut_cdf[i] = planck_lut_cdf[i - 1] + interval_integral;
+  }
+
+  const double integral_total = planck_lut_cdf[PLANCK_LUT_NPTS - 1];
+  printout("Planck sampling table: integral %.9f (pi^4/15 = %.9f)\n", integral_total, std::pow(PI, 4) / 15.);
+  for (auto &cdf : planck_lut_cdf) {
+    cdf /= integral_total;
+  }
+
+  planck_lut_guide.resize(PLANCK_LUT_NPTS);
+  int i = 0;
+  for (int j = 0; j < PLANCK_LUT_NPTS; j++) {
+    while (i < PLANCK_LUT_NPTS - 2 && planck_lut_cdf[i + 1] <= static_cast<double>(j) / PLANCK_LUT_NPTS) {
+      i++;
+    }
+    planck_lut_guide[j] = i;
+  }
+}
+
+static auto get_planck_lut_cdf(const double x) -> double {
+  if (x >= PLANCK_LUT_XMAX) {
+    return 1.;
+  }
+  const int i = static_cast<int>(x / PLANCK_LUT_DELTAX);
+  const double frac = x / PLANCK_LUT_DELTAX - i;
+  return planck_lut_cdf[i] + frac * (planck_lut_cdf[i + 1] - planck_lut_cdf[i]);
+}
+
+static auto sample_planck_lut(const double T) -> double
+// the distribution is restricted to [NU_MIN_R, NU_MAX_R] like the rejection method by sampling the cumulative
+// distribution only between the values at these frequencies
+{
+  const double cdf_min = get_planck_lut_cdf(H * NU_MIN_R / KB / T);
+  const double cdf_max = get_planck_lut_cdf(H * NU_MAX_R / KB / T);
+  const double cdf = cdf_min + rng_uniform() * (cdf_max - cdf_min);
+
+  int i = planck_lut_guide[std::min(static_cast<int>(cdf * PLANCK_LUT_NPTS), PLANCK_LUT_NPTS - 1)];
+  while (i < PLANCK_LUT_NPTS - 2 && planck_lut_cdf[i + 1] <= cdf) {
+    i++;
+  }
+
+  const double cdf_interval = planck_lut_cdf[i + 1] - planck_lut_cdf[i];
+  const double frac = (cdf_interval > 0.) ? (cdf - planck_lut_cdf[i]) / cdf_interval : 0.;
+  const double nu = (i + frac) * PLANCK_LUT_DELTAX * KB * T / H;
+
+  return std::clamp(nu, NU_MIN_R, NU_MAX_R);
+}
+
 static auto sample_planck(const double T) -> double
 /// returns a randomly chosen frequency according to the Planck
 /// distribution of temperature T
@@ -347,6 +436,10 @@ static auto sample_planck(const double T) -> double
     printout("[warning] sample_planck: intensity peaks outside frequency range\n");
   }
 
+  if constexpr (USE_LUT_PLANCK_SAMPLING) {
+    return sample_planck_lut(T);
+  }
+
   const double B_peak = radfield::dbb(nu_peak, T, 1);
 
   while (true) {
@@ -381,6 +474,198 @@ void do_kpkt_blackbody(struct packet *pkt_ptr)
   pkt_ptr->nscatterings = 0;
 }
 
+template <typename T>
+static auto alloc_cellcooling_nodeshared(const size_t count_per_cell) -> T * {
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  T *ptr = nullptr;
+#ifdef MPI_ON
+  size_t my_rank_cells_nonempty = npts_nonempty / globals::node_nprocs;
+  // rank_in_node 0 gets any remainder
+  if (globals::rank_in_node == 0) {
+    my_rank_cells_nonempty += npts_nonempty - (my_rank_cells_nonempty * globals::node_nprocs);
+  }
+  MPI_Aint size = my_rank_cells_nonempty * count_per_cell * sizeof(T);
+  int disp_unit = sizeof(T);
+  MPI_Win win = MPI_WIN_NULL;
+  assert_always(MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &ptr, &win) ==
+                MPI_SUCCESS);
+  assert_always(MPI_Win_shared_query(win, 0, &size, &disp_unit, &ptr) == MPI_SUCCESS);
+#else
+  ptr = static_cast<T *>(malloc(npts_nonempty * count_per_cell * sizeof(T)));
+#endif
+  assert_always(ptr != nullptr);
+  return ptr;
+}
+
+void init_cellcooling_cdf()
+// should be called after the cooling list and model grid are set up
+{
+  if constexpr (!KPKT_COOLING_CDF_ON) {
+    return;
+  }
+
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  const size_t mem_usage = npts_nonempty * (globals::ncoolingterms * sizeof(double) + sizeof(int));
+  cellcooling_cdf = alloc_cellcooling_nodeshared<double>(globals::ncoolingterms);
+  cellcooling_cdf_stamp = alloc_cellcooling_nodeshared<int>(1);
+  if (globals::rank_in_node == 0) {
+    std::fill_n(cellcooling_cdf_stamp, npts_nonempty, 0);
+  }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+
+  printout("[info] mem_usage: k-packet cooling CDFs for %zu cells occupy %.3f MB (node shared memory)\n",
+           npts_nonempty, mem_usage / 1024. / 1024.);
+}
+
+void invalidate_cellcooling_cdfs()
+// the cell properties are about to change, so the tables must be rebuilt when they are next needed
+{
+  cellcooling_cdf_generation++;
+}
+
+static void calculate_cellcooling_cdf(const int modelgridindex, double *cooling_cdf)
+// fill the cooling CDF of a cell from its current properties
+{
+  double C_lowerions = 0.;
+  for (int element = 0; element < get_nelements(); element++) {
+    const int nions = get_nions(element);
+    for (int ion = 0; ion < nions; ion++) {
+      const int ilow = get_coolinglistoffset(element, ion);
+      const double C_ion = calculate_cooling_rates_ion<true>(modelgridindex, element, ion, ilow, cooling_cdf, nullptr,
+                                                             nullptr, nullptr, nullptr);
+      assert_always(C_ion == grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion]);
+
+      for (int i = ilow; i < ilow + get_ncoolingterms_ion(element, ion); i++) {
+        cooling_cdf[i] += C_lowerions;
+      }
+      C_lowerions += C_ion;
+    }
+  }
+}
+
+static auto get_cellcooling_cdf(const int modelgridindex) -> const double * {
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  double *cooling_cdf = &cellcooling_cdf[nonemptymgi * globals::ncoolingterms];
+  std::atomic_ref<int> stamp(cellcooling_cdf_stamp[nonemptymgi]);
+  int stampvalue = stamp.load(std::memory_order_acquire);
+  while (stampvalue != cellcooling_cdf_generation) {
+    if (stampvalue != -cellcooling_cdf_generation &&
+        stamp.compare_exchange_weak(stampvalue, -cellcooling_cdf_generation, std::memory_order_acquire)) {
+      calculate_cellcooling_cdf(modelgridindex, cooling_cdf);
+      stamp.store(cellcooling_cdf_generation, std::memory_order_release);
+      break;
+    }
+    // another thread or rank on this node is building the table of this cell
+    stampvalue = stamp.load(std::memory_order_acquire);
+  }
+  return cooling_cdf;
+}
+
+static auto select_coolingterm_cellcdf(const double *cooling_cdf, const double zrand, double *rndcool_process)
+    -> ptrdiff_t
+// select a cooling process with one binary search in the cooling CDF of the cell
+{
+  *rndcool_process = zrand * cooling_cdf[globals::ncoolingterms - 1];
+
+  const ptrdiff_t i =
+      std::upper_bound(cooling_cdf, cooling_cdf + globals::ncoolingterms, *rndcool_process) - cooling_cdf;
+
+  assert_always(i < globals::ncoolingterms);
+  return i;
+}
+
+static auto select_coolingterm_perthread(const int modelgridindex, const double zrand, double *rndcool_process,
+                                         int *icumstart) -> ptrdiff_t
+// select an ion from the cooling rates per ion, then a process of that ion from the thread's cellhistory
+// cooling_contrib, which is calculated on demand for each ion
+{
+  const int tid = get_thread_num();
+  double coolingsum = 0.;
+  const double rndcool_ion = zrand * grid::modelgrid[modelgridindex].totalcooling;
+
+  int element = -1;
+  int ion = -1;
+  for (element = 0; element < get_nelements(); element++) {
+    const int nions = get_nions(element);
+    for (ion = 0; ion < nions; ion++) {
+      coolingsum += grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion];
+      // printout("Z=%d, ionstage %d, coolingsum %g\n", get_atomicnumber(element), get_ionstage(element, ion),
+      // coolingsum);
+      if (coolingsum > rndcool_ion) {
+        break;
+      }
+    }
+    if (coolingsum > rndcool_ion) {
+      break;
+    }
+  }
+  // printout("kpkt selected Z=%d ionstage %d\n", get_atomicnumber(element), get_ionstage(element, ion));
+
+  if (element >= get_nelements() || element < 0 || ion >= get_nions(element) || ion < 0) {
+    printout("do_kpkt: problem selecting a cooling process ... abort\n");
+    printout("do_kpkt: modelgridindex %d element %d ion %d\n", modelgridindex, element, ion);
+    printout("do_kpkt: totalcooling %g, coolingsum %g, rndcool_ion %g\n", grid::modelgrid[modelgridindex].totalcooling,
+             coolingsum, rndcool_ion);
+    printout("do_kpkt: modelgridindex %d, nne %g\n", modelgridindex, grid::get_nne(modelgridindex));
+    for (element = 0; element < get_nelements(); element++) {
+      const int nions = get_nions(element);
+      for (ion = 0; ion < nions; ion++) {
+        printout("do_kpkt: element %d, ion %d, coolingcontr %g\n", element, ion,
+                 grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion]);
+      }
+    }
+    abort();
+  }
+
+  // printout("element %d, ion %d, coolingsum %g\n",element,ion,coolingsum);
+  const int ilow = get_coolinglistoffset(element, ion);
+  const int ihigh = ilow + get_ncoolingterms_ion(element, ion) - 1;
+  // printout("element %d, ion %d, low %d, high %d\n",element,ion,low,high);
+  if (globals::cellhistory[tid].cooling_contrib[ilow] < 0.) {
+    // printout("calculate kpkt rates on demand modelgridindex %d element %d ion %d ilow %d ihigh %d
+    // oldcoolingsum %g\n",
+    //          modelgridindex, element, ion, ilow, high, oldcoolingsum);
+    const double C_ion = calculate_cooling_rates_ion<true>(modelgridindex, element, ion, ilow,
+                                                           globals::cellhistory[tid].cooling_contrib, nullptr, nullptr,
+                                                           nullptr, nullptr);
+    // we just summed up every individual cooling process. make sure it matches the stored total for the ion
+    assert_always(C_ion == grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion]);
+  }
+
+  // with the ion selected, we now select a level and transition type
+
+  const double zrand2 = rng_uniform();
+  const double rndcool_ion_process = zrand2 * globals::cellhistory[tid].cooling_contrib[ihigh];
+
+  auto *const selectedvalue =
+      std::upper_bound(&globals::cellhistory[tid].cooling_contrib[ilow],
+                       &globals::cellhistory[tid].cooling_contrib[ihigh + 1], rndcool_ion_process);
+  const ptrdiff_t i = selectedvalue - globals::cellhistory[tid].cooling_contrib;
+
+  if (i > ihigh) {
+    printout("do_kpkt: error occured while selecting a cooling channel: low %d, high %d, i %d, rndcool %g\n", ilow,
+             ihigh, i, rndcool_ion_process);
+    printout("element %d, ion %d, offset %d, terms %d, coolingsum %g\n", element, ion,
+             get_coolinglistoffset(element, ion), get_ncoolingterms_ion(element, ion), coolingsum);
+
+    printout("lower %g, %g, %g\n", globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion) - 1],
+             globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion)],
+             globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion) + 1]);
+    const int finalpos = get_coolinglistoffset(element, ion) + get_ncoolingterms_ion(element, ion) - 1;
+    printout("upper %g, %g, %g\n", globals::cellhistory[tid].cooling_contrib[finalpos - 1],
+             globals::cellhistory[tid].cooling_contrib[finalpos],
+             globals::cellhistory[tid].cooling_contrib[finalpos + 1]);
+  }
+
+  assert_always(i <= ihigh);
+
+  *rndcool_process = rndcool_ion_process;
+  *icumstart = ilow;
+  return i;
+}
+
 void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
 /// handle a k-packet (kinetic energy of the free electrons)
 {
@@ -410,87 +695,23 @@ void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
     pkt_ptr->prop_time = t_current;
 
     /// Randomly select the occuring cooling process
-    double coolingsum = 0.;
     const double zrand = rng_uniform();
-
     assert_always(grid::modelgrid[modelgridindex].totalcooling > 0.);
-    const double rndcool_ion = zrand * grid::modelgrid[modelgridindex].totalcooling;
-
-    int element = -1;
-    int ion = -1;
-    for (element = 0; element < get_nelements(); element++) {
-      const int nions = get_nions(element);
-      for (ion = 0; ion < nions; ion++) {
-        coolingsum += grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion];
-        // printout("Z=%d, ionstage %d, coolingsum %g\n", get_atomicnumber(element), get_ionstage(element, ion),
-        // coolingsum);
-        if (coolingsum > rndcool_ion) {
-          break;
-        }
-      }
-      if (coolingsum > rndcool_ion) {
-        break;
-      }
-    }
-    // printout("kpkt selected Z=%d ionstage %d\n", get_atomicnumber(element), get_ionstage(element, ion));
-
-    if (element >= get_nelements() || element < 0 || ion >= get_nions(element) || ion < 0) {
-      printout("do_kpkt: problem selecting a cooling process ... abort\n");
-      printout("do_kpkt: modelgridindex %d element %d ion %d\n", modelgridindex, element, ion);
-      printout("do_kpkt: totalcooling %g, coolingsum %g, rndcool_ion %g\n",
-               grid::modelgrid[modelgridindex].totalcooling, coolingsum, rndcool_ion);
-      printout("do_kpkt: modelgridindex %d, cellno %d, nne %g\n", modelgridindex, pkt_ptr->where,
-               grid::get_nne(modelgridindex));
-      for (element = 0; element < get_nelements(); element++) {
-        const int nions = get_nions(element);
-        for (ion = 0; ion < nions; ion++) {
-          printout("do_kpkt: element %d, ion %d, coolingcontr %g\n", element, ion,
-                   grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion]);
-        }
-      }
-      abort();
-    }
 
-    // printout("element %d, ion %d, coolingsum %g\n",element,ion,coolingsum);
-    const int ilow = get_coolinglistoffset(element, ion);
-    const int ihigh = ilow + get_ncoolingterms_ion(element, ion) - 1;
-    // printout("element %d, ion %d, low %d, high %d\n",element,ion,low,high);
-    if (globals::cellhistory[tid].cooling_contrib[ilow] < 0.) {
-      // printout("calculate kpkt rates on demand modelgridindex %d element %d ion %d ilow %d ihigh %d
-      // oldcoolingsum %g\n",
-      //          modelgridindex, element, ion, ilow, high, oldcoolingsum);
-      const double C_ion = calculate_cooling_rates_ion<true>(modelgridindex, element, ion, ilow, tid, nullptr, nullptr,
-                                                             nullptr, nullptr);
-      // we just summed up every individual cooling process. make sure it matches the stored total for the ion
-      assert_always(C_ion == grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion]);
-    }
-
-    // with the ion selected, we now select a level and transition type
-
-    const double zrand2 = rng_uniform();
-    const double rndcool_ion_process = zrand2 * globals::cellhistory[tid].cooling_contrib[ihigh];
-
-    auto *const selectedvalue =
-        std::upper_bound(&globals::cellhistory[tid].cooling_contrib[ilow],
-                         &globals::cellhistory[tid].cooling_contrib[ihigh + 1], rndcool_ion_process);
-    const ptrdiff_t i = selectedvalue - globals::cellhistory[tid].cooling_contrib;
-
-    if (i > ihigh) {
-      printout("do_kpkt: error occured while selecting a cooling channel: low %d, high %d, i %d, rndcool %g\n", ilow,
-               ihigh, i, rndcool_ion_process);
-      printout("element %d, ion %d, offset %d, terms %d, coolingsum %g\n", element, ion,
-               get_coolinglistoffset(element, ion), get_ncoolingterms_ion(element, ion), coolingsum);
-
-      printout("lower %g, %g, %g\n", globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion) - 1],
-               globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion)],
-               globals::cellhistory[tid].cooling_contrib[get_coolinglistoffset(element, ion) + 1]);
-      const int finalpos = get_coolinglistoffset(element, ion) + get_ncoolingterms_ion(element, ion) - 1;
-      printout("upper %g, %g, %g\n", globals::cellhistory[tid].cooling_contrib[finalpos - 1],
-               globals::cellhistory[tid].cooling_contrib[finalpos],
-               globals::cellhistory[tid].cooling_contrib[finalpos + 1]);
+    // cumulative cooling contributions in coolinglist order, which restart from zero at index icumstart
+    const double *cooling_contrib = nullptr;
+    int icumstart = 0;
+    double rndcool_process = 0.;
+    ptrdiff_t i = -1;
+    if constexpr (KPKT_COOLING_CDF_ON) {
+      cooling_contrib = get_cellcooling_cdf(modelgridindex);
+      i = select_coolingterm_cellcdf(cooling_contrib, zrand, &rndcool_process);
+    } else {
+      cooling_contrib = globals::cellhistory[tid].cooling_contrib;
+      i = select_coolingterm_perthread(modelgridindex, zrand, &rndcool_process, &icumstart);
     }
-
-    assert_always(i <= ihigh);
+    const int element = coolinglist[i].element;
+    const int ion = coolinglist[i].ion;
 
     // printout("do_kpkt: selected process %d, coolingsum %g\n", i, coolingsum);
 
@@ -565,7 +786,7 @@ void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
 
       // if the previous entry belongs to the same ion, then pick up the cumulative sum from
       // the previous entry, otherwise start from zero
-      const double contrib_low = (i > ilow) ? globals::cellhistory[tid].cooling_contrib[i - 1] : 0.;
+      const double contrib_low = (i > icumstart) ? cooling_contrib[i - 1] : 0.;
 
       double contrib = contrib_low;
       assert_testmodeonly(coolinglist[i].element == element);
@@ -586,7 +807,7 @@ void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
                          col_excitation_ratecoeff(T_e, nne, element, ion, level, ii, epsilon_trans, statweight) *
                          epsilon_trans;
         contrib += C;
-        if (contrib > rndcool_ion_process) {
+        if (contrib > rndcool_process) {
           upper = tmpupper;
           break;
         }
@@ -597,8 +818,8 @@ void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
             "WARNING: Could not select an upper level. modelgridindex %d i %d element %d ion %d level %d rndcool "
             "%g "
             "contrib_low %g contrib %g (should match %g) upper %d nuptrans %d\n",
-            modelgridindex, i, element, ion, level, rndcool_ion_process, contrib_low, contrib,
-            globals::cellhistory[tid].cooling_contrib[i], upper, nuptrans);
+            modelgridindex, i, element, ion, level, rndcool_process, contrib_low, contrib, cooling_contrib[i], upper,
+            nuptrans);
         abort();
       }
       assert_always(upper >= 0);
@@ -646,8 +867,8 @@ void do_kpkt(struct packet *pkt_ptr, double t2, int nts)
       pkt_ptr->trueemissionvelocity = -1;
     } else {
       printout("[fatal] do_kpkt: coolinglist.type mismatch\n");
-      printout("[fatal] do_kpkt: zrand %g, grid::modelgrid[modelgridindex].totalcooling %g, coolingsum %g, i %d\n",
-               zrand, grid::modelgrid[modelgridindex].totalcooling, coolingsum, i);
+      printout("[fatal] do_kpkt: zrand %g, grid::modelgrid[modelgridindex].totalcooling %g, rndcool %g, i %td\n",
+               zrand, grid::modelgrid[modelgridindex].totalcooling, rndcool_process, i);
       printout("[fatal] do_kpkt: coolinglist[i].type %d\n", coolinglist[i].type);
       printout("[fatal] do_kpkt: pkt_ptr->where %d, mgi %d\n", pkt_ptr->where, modelgridindex);
       abort();
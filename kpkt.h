@@ -10,7 +10,10 @@ constexpr double COOLING_UNDEFINED = -99;
 namespace kpkt {
 
 void setup_coolinglist();
+void init_planck_lut();
 void calculate_cooling_rates(int modelgridindex, struct heatingcoolingrates *heatingcoolingrates);
+void init_cellcooling_cdf();
+void invalidate_cellcooling_cdfs();
 void do_kpkt_blackbody(struct packet *pkt_ptr);
 void do_kpkt(struct packet *pkt_ptr, double t2, int nts);
 
@@ -326,7 +326,7 @@ auto get_levelpop(int modelgridindex, int element, int ion, int level) -> double
   double nn = 0.;
   if (use_cellhist) {
     assert_testmodeonly(modelgridindex == globals::cellhistory[tid].cellnumber);
-    nn = globals::cellhistory[tid].chelements[element].chions[ion].chlevels[level].population;
+    nn = globals::cellhistory[tid].levelpops[globals::elements[element].ions[ion].levels[level].uniquelevelindex];
   } else {
     nn = calculate_levelpop(modelgridindex, element, ion, level);
   }
@@ -4,6 +4,10 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
 
 #include "artisoptions.h"
 #include "globals.h"
@@ -23,6 +27,44 @@ constexpr bool LOG_MACROATOM = false;
 
 static FILE *macroatom_file = nullptr;
 
+// With MACROATOM_ALIAS_TABLES_ON, the internal jumps are not followed one by one. For each activation level, the
+// probabilities of deactivating through each channel (a level and a deactivating action) are found by pushing the
+// activation probability along the internal transitions until less than MA_ALIAS_MINPUSH remains at every level. What
+// is left at a level becomes a channel that resumes the jump-by-jump walk from there, so the deactivations follow the
+// same distribution as before. Each thread keeps the tables in alias form (Vose 1991) for the current timestep.
+
+// residual probability at a level below which it is not pushed along the internal transitions
+constexpr double MA_ALIAS_MINPUSH = 1e-7;
+// limit on the number of pushes for one table. Any remaining probability resumes the walk from its level
+constexpr int MA_ALIAS_MAXPUSHES = 1000000;
+
+struct ma_aliaschannel {
+  int ion;
+  int level;
+  enum ma_action action;  // MA_ACTION_COUNT to resume the walk at this level
+};
+
+struct ma_aliastable {
+  std::vector<struct ma_aliaschannel> channels;
+  std::vector<double> prob;  // probability of keeping the channel chosen uniformly (otherwise use the alias)
+  std::vector<int> alias;
+};
+
+// probabilities of the transitions out of a level, normalised to its total transition rate
+struct ma_leveltransitions {
+  bool calculated = false;
+  std::array<double, MA_ACTION_COUNT> deactivation{};  // deactivating actions (the internal entries are unused)
+  std::vector<std::pair<int, double>> internal;        // internal jumps to each target [elementlevelindex, prob]
+};
+
+struct ma_aliascache {
+  int timestep = -1;
+  size_t bytes = 0;
+  std::unordered_map<int64_t, struct ma_aliastable> tables;  // key is (modelgridindex << 32) + uniquelevelindex
+};
+
+static std::vector<struct ma_aliascache> ma_aliascache_threads;
+
 static void calculate_macroatom_transitionrates(const int modelgridindex, const int element, const int ion,
                                                 const int level, const double t_mid, struct chlevels &chlevel) {
   // printout("Calculating transition rates for element %d ion %d level %d\n", element, ion, level);
@@ -136,6 +178,237 @@ static void calculate_macroatom_transitionrates(const int modelgridindex, const
   }
 }
 
+static void build_aliastable(struct ma_aliastable &table, const std::vector<double> &channelprobs)
+// Vose's alias method: after this, a channel can be sampled with one uniform index and one comparison
+{
+  const int nchannels = static_cast<int>(channelprobs.size());
+  const double probsum = std::accumulate(channelprobs.cbegin(), channelprobs.cend(), 0.);
+  assert_always(nchannels > 0 && probsum > 0.);
+
+  table.prob.resize(nchannels);
+  table.alias.resize(nchannels);
+  std::vector<int> small;
+  std::vector<int> large;
+  for (int i = 0; i < nchannels; i++) {
+    table.prob[i] = channelprobs[i] * nchannels / probsum;
+    table.alias[i] = i;
+    (table.prob[i] < 1. ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    const int s = small.back();
+    small.pop_back();
+    const int l = large.back();
+    table.alias[s] = l;
+    table.prob[l] -= 1. - table.prob[s];
+    if (table.prob[l] < 1.) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // anything left over is only below or above one by rounding error
+  for (const int i : small) {
+    table.prob[i] = 1.;
+  }
+  for (const int i : large) {
+    table.prob[i] = 1.;
+  }
+}
+
+static void calculate_macroatom_leveltransitions(const int modelgridindex, const int element, const int ion,
+                                                const int level, const double t_mid,
+                                                struct ma_leveltransitions &leveltransitions)
+// find the probability of each deactivating action and internal jump out of a level. The internal jump targets are
+// indexed by uniquelevelindex relative to the first level of the element
+{
+  const int tid = get_thread_num();
+  const auto T_e = grid::get_Te(modelgridindex);
+  const auto nne = grid::get_nne(modelgridindex);
+  const int uniquelevelindex_first = globals::elements[element].ions[0].levels[0].uniquelevelindex;
+  const auto get_elementlevelindex = [&](const int targetion, const int targetlevel) {
+    return globals::elements[element].ions[targetion].levels[targetlevel].uniquelevelindex - uniquelevelindex_first;
+  };
+
+  auto &chlevel = globals::cellhistory[tid].chelements[element].chions[ion].chlevels[level];
+  const auto &processrates = chlevel.processrates;
+  if (processrates[MA_ACTION_COLDEEXC] < 0) {
+    calculate_macroatom_transitionrates(modelgridindex, element, ion, level, t_mid, chlevel);
+  }
+  const double total_transitions = std::accumulate(processrates.cbegin(), processrates.cend(), 0.);
+  assert_always(total_transitions > 0);
+
+  for (const auto action : {MA_ACTION_RADDEEXC, MA_ACTION_COLDEEXC, MA_ACTION_RADRECOMB, MA_ACTION_COLRECOMB,
+                            MA_ACTION_INTERNALUPHIGHERNT}) {
+    leveltransitions.deactivation[action] = processrates[action] / total_transitions;
+  }
+
+  auto &internal = leveltransitions.internal;
+  internal.clear();
+  const auto &levelref = globals::elements[element].ions[ion].levels[level];
+  if (processrates[MA_ACTION_INTERNALDOWNSAME] > 0.) {
+    double sum_prev = 0.;
+    for (int i = 0; i < get_ndowntrans(element, ion, level); i++) {
+      const double rate = chlevel.sum_internal_down_same[i] - sum_prev;
+      sum_prev = chlevel.sum_internal_down_same[i];
+      if (rate > 0.) {
+        internal.emplace_back(get_elementlevelindex(ion, levelref.downtrans[i].targetlevelindex),
+                              rate / total_transitions);
+      }
+    }
+  }
+
+  if (processrates[MA_ACTION_INTERNALUPSAME] > 0.) {
+    double sum_prev = 0.;
+    for (int i = 0; i < get_nuptrans(element, ion, level); i++) {
+      const double rate = chlevel.sum_internal_up_same[i] - sum_prev;
+      sum_prev = chlevel.sum_internal_up_same[i];
+      if (rate > 0.) {
+        internal.emplace_back(get_elementlevelindex(ion, levelref.uptrans[i].targetlevelindex),
+                              rate / total_transitions);
+      }
+    }
+  }
+
+  const double epsilon_current = epsilon(element, ion, level);
+  if (processrates[MA_ACTION_INTERNALDOWNLOWER] > 0.) {
+    for (int lower = 0; lower < get_ionisinglevels(element, ion - 1); lower++) {
+      const double epsilon_target = epsilon(element, ion - 1, lower);
+      const double epsilon_trans = epsilon_current - epsilon_target;
+      const double R = rad_recombination_ratecoeff(T_e, nne, element, ion, level, lower, modelgridindex);
+      const double C = col_recombination_ratecoeff(modelgridindex, element, ion, level, lower, epsilon_trans);
+      if ((R + C) > 0.) {
+        internal.emplace_back(get_elementlevelindex(ion - 1, lower), (R + C) * epsilon_target / total_transitions);
+      }
+    }
+  }
+
+  if (processrates[MA_ACTION_INTERNALUPHIGHER] > 0.) {
+    for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level); phixstargetindex++) {
+      const int upper = get_phixsupperlevel(element, ion, level, phixstargetindex);
+      const double epsilon_trans = get_phixs_threshold(element, ion, level, phixstargetindex);
+      const double R = get_corrphotoioncoeff(element, ion, level, phixstargetindex, modelgridindex);
+      const double C = col_ionization_ratecoeff(T_e, nne, element, ion, level, phixstargetindex, epsilon_trans);
+      if ((R + C) > 0.) {
+        internal.emplace_back(get_elementlevelindex(ion + 1, upper), (R + C) * epsilon_current / total_transitions);
+      }
+    }
+  }
+
+  leveltransitions.calculated = true;
+}
+
+static auto calculate_macroatom_aliastable(const int modelgridindex, const int element, const int ion_in,
+                                           const int level_in, const double t_mid) -> struct ma_aliastable {
+  const int nions = get_nions(element);
+  const int uniquelevelindex_first = globals::elements[element].ions[0].levels[0].uniquelevelindex;
+  int nelementlevels = 0;
+  for (int ion = 0; ion < nions; ion++) {
+    nelementlevels += get_nlevels(element, ion);
+  }
+  const auto get_elementlevelindex = [&](const int ion, const int level) {
+    return globals::elements[element].ions[ion].levels[level].uniquelevelindex - uniquelevelindex_first;
+  };
+
+  // activation probability that has arrived at a level and not been pushed on yet
+  std::vector<double> residual(nelementlevels, 0.);
+  // probability of deactivating from each level with each action
+  std::vector<std::array<double, MA_ACTION_COUNT>> deactivation(nelementlevels, std::array<double, MA_ACTION_COUNT>{});
+  std::vector<std::pair<int, int>> elementlevel_ionlevel(nelementlevels);
+  for (int ion = 0; ion < nions; ion++) {
+    for (int level = 0; level < get_nlevels(element, ion); level++) {
+      elementlevel_ionlevel[get_elementlevelindex(ion, level)] = {ion, level};
+    }
+  }
+  // the transition probabilities of a level are calculated the first time it is pushed and reused after that
+  std::vector<struct ma_leveltransitions> leveltransitions(nelementlevels);
+
+  std::vector<int> pushqueue;
+  const auto add_residual = [&](const int elementlevelindex, const double prob) {
+    const bool wasqueued = residual[elementlevelindex] >= MA_ALIAS_MINPUSH;
+    residual[elementlevelindex] += prob;
+    if (!wasqueued && residual[elementlevelindex] >= MA_ALIAS_MINPUSH) {
+      pushqueue.push_back(elementlevelindex);
+    }
+  };
+
+  add_residual(get_elementlevelindex(ion_in, level_in), 1.);
+  for (int pushcount = 0; !pushqueue.empty() && pushcount < MA_ALIAS_MAXPUSHES; pushcount++) {
+    const int elementlevelindex = pushqueue.back();
+    pushqueue.pop_back();
+    const double prob = residual[elementlevelindex];
+    residual[elementlevelindex] = 0.;
+
+    auto &transitions = leveltransitions[elementlevelindex];
+    if (!transitions.calculated) {
+      const auto [ion, level] = elementlevel_ionlevel[elementlevelindex];
+      calculate_macroatom_leveltransitions(modelgridindex, element, ion, level, t_mid, transitions);
+    }
+
+    for (const auto action : {MA_ACTION_RADDEEXC, MA_ACTION_COLDEEXC, MA_ACTION_RADRECOMB, MA_ACTION_COLRECOMB,
+                              MA_ACTION_INTERNALUPHIGHERNT}) {
+      deactivation[elementlevelindex][action] += transitions.deactivation[action] * prob;
+    }
+
+    for (const auto &[targetindex, targetprob] : transitions.internal) {
+      add_residual(targetindex, targetprob * prob);
+    }
+  }
+
+  struct ma_aliastable table;
+  std::vector<double> channelprobs;
+  for (int elementlevelindex = 0; elementlevelindex < nelementlevels; elementlevelindex++) {
+    const auto [ion, level] = elementlevel_ionlevel[elementlevelindex];
+    for (int action = 0; action < MA_ACTION_COUNT; action++) {
+      if (deactivation[elementlevelindex][action] > 0.) {
+        table.channels.push_back({ion, level, static_cast<enum ma_action>(action)});
+        channelprobs.push_back(deactivation[elementlevelindex][action]);
+      }
+    }
+    if (residual[elementlevelindex] > 0.) {
+      table.channels.push_back({ion, level, MA_ACTION_COUNT});
+      channelprobs.push_back(residual[elementlevelindex]);
+    }
+  }
+
+  build_aliastable(table, channelprobs);
+
+  return table;
+}
+
+static auto sample_macroatom_aliastable(const int modelgridindex, const int element, const int ion, const int level,
+                                        const int timestep, const double t_mid) -> struct ma_aliaschannel
+// select the channel through which a macro atom activated in this level will deactivate, or the level from which the
+// jump-by-jump walk should resume
+{
+  auto &cache = ma_aliascache_threads[get_thread_num()];
+  if (cache.timestep != timestep || cache.bytes > MA_ALIAS_MAXBYTES_PERTHREAD) {
+    cache.tables.clear();
+    cache.bytes = 0;
+    cache.timestep = timestep;
+  }
+
+  const int64_t key = (static_cast<int64_t>(modelgridindex) << 32) +
+                      globals::elements[element].ions[ion].levels[level].uniquelevelindex;
+  auto tableit = cache.tables.find(key);
+  if (tableit == cache.tables.end()) {
+    auto table = calculate_macroatom_aliastable(modelgridindex, element, ion, level, t_mid);
+    cache.bytes += table.channels.size() * (sizeof(struct ma_aliaschannel) + sizeof(double) + sizeof(int));
+    tableit = cache.tables.emplace(key, std::move(table)).first;
+  }
+
+  const auto &table = tableit->second;
+  const int nchannels = static_cast<int>(table.channels.size());
+  const int channelindex = std::min(static_cast<int>(rng_uniform() * nchannels), nchannels - 1);
+  return table.channels[(rng_uniform() < table.prob[channelindex]) ? channelindex : table.alias[channelindex]];
+}
+
+void init_macroatom_aliastables() {
+  if constexpr (MACROATOM_ALIAS_TABLES_ON) {
+    ma_aliascache_threads.resize(get_max_threads());
+  }
+}
+
 static auto do_macroatom_internal_down_same(int element, int ion, int level, double total_internal_down_same) -> int {
   const int ndowntrans = get_ndowntrans(element, ion, level);
 
@@ -388,6 +661,19 @@ void do_macroatom(struct packet *pkt_ptr, const int timestep)
     // printout("[debug] %s Z=%d ionstage %d level %d, jumps %d\n", __func__, get_atomicnumber(element),
     // get_ionstage(element,ion), level, jumps);
 
+    // with alias tables, jump straight to the deactivating level and action
+    enum ma_action selected_action = MA_ACTION_COUNT;
+    if constexpr (MACROATOM_ALIAS_TABLES_ON) {
+      const auto channel = sample_macroatom_aliastable(modelgridindex, element, ion, level, timestep, t_mid);
+      if (channel.ion != ion || channel.level != level) {
+        pkt_ptr->interactions += 1;
+        jumps++;
+      }
+      ion = channel.ion;
+      level = channel.level;
+      selected_action = channel.action;
+    }
+
     assert_testmodeonly(ion >= 0);
     assert_testmodeonly(ion < get_nions(element));
 
@@ -417,26 +703,28 @@ void do_macroatom(struct packet *pkt_ptr, const int timestep)
     //     printout("actions: %30s %g\n", actionlabel[action], processrates[action]);
     // }
 
-    // select transition according to probabilities
-    double total_transitions = 0.;
-    for (int action = 0; action < MA_ACTION_COUNT; action++) {
-      total_transitions += processrates[action];
-    }
-    assert_always(total_transitions > 0);
-
-    enum ma_action selected_action = MA_ACTION_COUNT;
-    double zrand = rng_uniform();
-    const double randomrate = zrand * total_transitions;
+    double zrand = 0.;
     double rate = 0.;
-    for (int action = 0; action < MA_ACTION_COUNT; action++) {
-      rate += processrates[action];
-      if (rate > randomrate) {
-        selected_action = static_cast<enum ma_action>(action);
-        break;
+    if (selected_action == MA_ACTION_COUNT) {
+      // select transition according to probabilities
+      double total_transitions = 0.;
+      for (int action = 0; action < MA_ACTION_COUNT; action++) {
+        total_transitions += processrates[action];
+      }
+      assert_always(total_transitions > 0);
+
+      zrand = rng_uniform();
+      const double randomrate = zrand * total_transitions;
+      for (int action = 0; action < MA_ACTION_COUNT; action++) {
+        rate += processrates[action];
+        if (rate > randomrate) {
+          selected_action = static_cast<enum ma_action>(action);
+          break;
+        }
       }
-    }
 
-    assert_always(rate > randomrate);
+      assert_always(rate > randomrate);
+    }
 
     switch (selected_action) {
       case MA_ACTION_RADDEEXC: {
@@ -484,7 +772,7 @@ void do_macroatom(struct packet *pkt_ptr, const int timestep)
 
         pkt_ptr->type = TYPE_KPKT;
         end_packet = true;
-        safeadd(globals::colheatingestimator[modelgridindex], pkt_ptr->e_cmf);
+        safeadd_nodeshared(globals::colheatingestimator[modelgridindex], pkt_ptr->e_cmf);
         break;
       }
 
@@ -530,7 +818,7 @@ void do_macroatom(struct packet *pkt_ptr, const int timestep)
 
         pkt_ptr->type = TYPE_KPKT;
         end_packet = true;
-        safeadd(globals::colheatingestimator[modelgridindex], pkt_ptr->e_cmf);
+        safeadd_nodeshared(globals::colheatingestimator[modelgridindex], pkt_ptr->e_cmf);
         break;
       }
 
@@ -31,6 +31,7 @@ enum ma_action {
 
 void macroatom_open_file(int my_rank);
 void macroatom_close_file();
+void init_macroatom_aliastables();
 
 void do_macroatom(struct packet *pkt_ptr, int timestep);
 
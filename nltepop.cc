@@ -4,11 +4,15 @@
 #include <gsl/gsl_integration.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_matrix_double.h>
+#include <gsl/gsl_splinalg.h>
+#include <gsl/gsl_spmatrix.h>
 #include <gsl/gsl_vector_double.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 #include "atomic.h"
 #include "grid.h"
@@ -24,6 +28,10 @@ static FILE *nlte_file = nullptr;
 // can save memory by using a combined rate matrix at the cost of diagnostic information
 constexpr bool individual_process_matricies = true;
 
+// counts for the NLTE_ITERATIVE_SOLVER_ON fallback rate (this process only)
+static int nlte_iterative_solves = 0;
+static int nlte_iterative_fallbacks = 0;
+
 static inline auto get_nlte_vector_index(const int element, const int ion, const int level) -> int
 // this is the index for the NLTE solver that is handling all ions of a single element
 // This is NOT an index into grid::modelgrid[modelgridindex].nlte_pops that contains all elements
@@ -686,18 +694,315 @@ static auto lumatrix_is_singular(const gsl_matrix *LU, const int element) -> boo
   return is_singular;
 }
 
-static auto nltepop_matrix_solve(const int element, const gsl_matrix *rate_matrix, const gsl_vector *balance_vector,
-                                 gsl_vector *popvec, const gsl_vector *pop_normfactor_vec) -> bool
-// solve rate_matrix * x = balance_vector,
-// then popvec[i] = x[i] / pop_norm_factor_vec[i]
+struct nlte_sparse_symbolic {
+  int dimension = 0;
+  std::vector<bool> pattern;  // [row * dimension + column] structural nonzeros of the rate matrix (unpermuted)
+  std::vector<int> order;     // order[k] is the rate matrix row/column that is eliminated at step k
+  std::vector<int> rowstart;  // CSR row offsets of the combined L+U pattern (permuted indices, including fill-in)
+  std::vector<int> colindex;  // permuted column indices of the L+U entries, sorted within each row
+  std::vector<int> diagpos;   // position of the diagonal entry of each row in colindex
+};
+
+// one symbolic factorisation per element, shared by all cells and NLTE iterations
+static std::vector<std::shared_ptr<const nlte_sparse_symbolic>> nlte_sparse_symbolic_cache;
+
+static auto nltepop_sparse_mindegree_order(const std::vector<bool> &pattern, const std::vector<bool> &eliminate_last,
+                                           const int n) -> std::vector<int>
+// greedy minimum degree ordering of the symmetrised pattern. Eliminating a vertex connects all of its remaining
+// neighbours. Vertices flagged in eliminate_last are only chosen once all other vertices have been eliminated
+{
+  std::vector<bool> adjacent(static_cast<size_t>(n) * n, false);
+  std::vector<int> degree(n, 0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      if (i != j && (pattern[(i * n) + j] || pattern[(j * n) + i])) {
+        adjacent[(i * n) + j] = true;
+        degree[i]++;
+      }
+    }
+  }
+
+  std::vector<bool> eliminated(n, false);
+  std::vector<int> order;
+  order.reserve(n);
+  std::vector<int> neighbours;
+  for (int step = 0; step < n; step++) {
+    int v = -1;
+    for (int i = 0; i < n; i++) {
+      if (!eliminated[i] && (v < 0 || (eliminate_last[v] && !eliminate_last[i]) ||
+                             (eliminate_last[v] == eliminate_last[i] && degree[i] < degree[v]))) {
+        v = i;
+      }
+    }
+    order.push_back(v);
+    eliminated[v] = true;
+
+    neighbours.clear();
+    for (int i = 0; i < n; i++) {
+      if (!eliminated[i] && adjacent[(v * n) + i]) {
+        neighbours.push_back(i);
+        adjacent[(i * n) + v] = false;
+        degree[i]--;
+      }
+    }
+
+    for (const int a : neighbours) {
+      for (const int b : neighbours) {
+        if (a != b && !adjacent[(a * n) + b]) {
+          adjacent[(a * n) + b] = true;
+          degree[a]++;
+        }
+      }
+    }
+  }
+
+  return order;
+}
+
+static auto nltepop_sparse_analyse(const int element, std::vector<bool> pattern, const int n)
+    -> std::shared_ptr<const nlte_sparse_symbolic>
+// compute the fill-reducing ordering and the L+U pattern of the factorisation without pivoting
+{
+  auto symb = std::make_shared<nlte_sparse_symbolic>();
+  symb->dimension = n;
+
+  // the diagonal is always needed for the pivots
+  for (int i = 0; i < n; i++) {
+    pattern[(i * n) + i] = true;
+  }
+
+  // the rate matrix columns sum to zero, so the pivots of the rate equations are only safe without pivoting if the
+  // normalisation row (and the ion population rows of FORCE_SAHA_ION_BALANCE) replacing them come last
+  std::vector<bool> eliminate_last(n, false);
+  eliminate_last[0] = true;
+  if (FORCE_SAHA_ION_BALANCE(get_atomicnumber(element))) {
+    for (int ion = 1; ion < get_nions(element); ion++) {
+      eliminate_last[get_nlte_vector_index(element, ion, 0)] = true;
+    }
+  }
+
+  symb->order = nltepop_sparse_mindegree_order(pattern, eliminate_last, n);
+
+  std::vector<bool> filled(static_cast<size_t>(n) * n, false);
+  for (int k = 0; k < n; k++) {
+    for (int j = 0; j < n; j++) {
+      filled[(k * n) + j] = pattern[(symb->order[k] * n) + symb->order[j]];
+    }
+  }
+
+  // symbolic Gaussian elimination: eliminating column k fills in (i, j) wherever (i, k) and (k, j) are nonzero
+  std::vector<int> upper_cols;
+  for (int k = 0; k < n; k++) {
+    upper_cols.clear();
+    for (int j = k + 1; j < n; j++) {
+      if (filled[(k * n) + j]) {
+        upper_cols.push_back(j);
+      }
+    }
+    for (int i = k + 1; i < n; i++) {
+      if (filled[(i * n) + k]) {
+        for (const int j : upper_cols) {
+          filled[(i * n) + j] = true;
+        }
+      }
+    }
+  }
+
+  symb->rowstart.resize(n + 1);
+  symb->diagpos.resize(n);
+  for (int i = 0; i < n; i++) {
+    symb->rowstart[i] = static_cast<int>(symb->colindex.size());
+    for (int j = 0; j < n; j++) {
+      if (filled[(i * n) + j]) {
+        if (j == i) {
+          symb->diagpos[i] = static_cast<int>(symb->colindex.size());
+        }
+        symb->colindex.push_back(j);
+      }
+    }
+  }
+  symb->rowstart[n] = static_cast<int>(symb->colindex.size());
+
+  const auto nnz_matrix = std::count(pattern.begin(), pattern.end(), true);
+  printout("NLTE sparse solver: Z=%d dimension %d has %td nonzeros in the rate matrix and %zu in the LU factors\n",
+           get_atomicnumber(element), n, nnz_matrix, symb->colindex.size());
+
+  symb->pattern = std::move(pattern);
+  return symb;
+}
+
+static auto nltepop_sparse_pattern_covers(const nlte_sparse_symbolic *symb, const gsl_matrix *rate_matrix) -> bool {
+  const int n = static_cast<int>(rate_matrix->size1);
+  if (symb == nullptr || symb->dimension != n) {
+    return false;
+  }
+  for (int row = 0; row < n; row++) {
+    for (int column = 0; column < n; column++) {
+      if (gsl_matrix_get(rate_matrix, row, column) != 0. && !symb->pattern[(row * n) + column]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static auto get_nlte_sparse_symbolic(const int element, const gsl_matrix *rate_matrix)
+    -> std::shared_ptr<const nlte_sparse_symbolic>
+// the structure of the rate matrix only depends on the atomic data, so the analysis normally happens once per element.
+// If a cell has a rate that was zero in every cell seen so far, the union pattern is analysed again
+{
+  std::shared_ptr<const nlte_sparse_symbolic> symb;
+#ifdef _OPENMP
+#pragma omp critical(nlte_sparse_symbolic)
+#endif
+  {
+    if (nlte_sparse_symbolic_cache.empty()) {
+      nlte_sparse_symbolic_cache.resize(get_nelements());
+    }
+    symb = nlte_sparse_symbolic_cache[element];
+  }
+
+  if (!nltepop_sparse_pattern_covers(symb.get(), rate_matrix)) {
+#ifdef _OPENMP
+#pragma omp critical(nlte_sparse_symbolic)
+#endif
+    {
+      // another thread might have extended the pattern in the meantime
+      symb = nlte_sparse_symbolic_cache[element];
+      if (!nltepop_sparse_pattern_covers(symb.get(), rate_matrix)) {
+        const int n = static_cast<int>(rate_matrix->size1);
+        std::vector<bool> pattern = (symb != nullptr && symb->dimension == n)
+                                        ? symb->pattern
+                                        : std::vector<bool>(static_cast<size_t>(n) * n, false);
+        for (int row = 0; row < n; row++) {
+          for (int column = 0; column < n; column++) {
+            if (gsl_matrix_get(rate_matrix, row, column) != 0.) {
+              pattern[(row * n) + column] = true;
+            }
+          }
+        }
+        symb = nltepop_sparse_analyse(element, std::move(pattern), n);
+        nlte_sparse_symbolic_cache[element] = symb;
+      }
+    }
+  }
+
+  return symb;
+}
+
+static auto nltepop_matrix_solve_sparse(const int element, const gsl_matrix *rate_matrix,
+                                        const gsl_vector *balance_vector, gsl_vector *x) -> bool
+// numeric LU factorisation on the cached symbolic factorisation, followed by iterative refinement.
+// There is no pivoting, so return false to fall back to the dense solver if a pivot is tiny
+// or the solution does not satisfy the rate equations
+{
+  const double PIVOT_TOLERANCE = 1e-13;  // relative to the diagonal entry before elimination
+  const double MAX_REL_RESIDUAL = 1e-10;  // relative to the largest entry of the balance vector
+
+  const auto symb = get_nlte_sparse_symbolic(element, rate_matrix);
+  const int n = symb->dimension;
+  const auto &order = symb->order;
+  const auto &rowstart = symb->rowstart;
+  const auto &colindex = symb->colindex;
+  const auto &diagpos = symb->diagpos;
+
+  std::vector<double> lu(colindex.size());
+  std::vector<double> work(n, 0.);
+  for (int i = 0; i < n; i++) {
+    for (int p = rowstart[i]; p < rowstart[i + 1]; p++) {
+      work[colindex[p]] = gsl_matrix_get(rate_matrix, order[i], order[colindex[p]]);
+    }
+    const double diag_original = work[i];
+
+    // row-wise elimination against the previous rows. The columns of the lower part are sorted and each update only
+    // touches columns further to the right that are part of this row's pattern
+    for (int p = rowstart[i]; p < diagpos[i]; p++) {
+      const int k = colindex[p];
+      const double l_ik = work[k] / lu[diagpos[k]];
+      work[k] = l_ik;
+      if (l_ik != 0.) {
+        for (int q = diagpos[k] + 1; q < rowstart[k + 1]; q++) {
+          work[colindex[q]] -= l_ik * lu[q];
+        }
+      }
+    }
+
+    for (int p = rowstart[i]; p < rowstart[i + 1]; p++) {
+      lu[p] = work[colindex[p]];
+      work[colindex[p]] = 0.;
+    }
+
+    const double pivot = lu[diagpos[i]];
+    if (!std::isfinite(pivot) || std::fabs(pivot) <= PIVOT_TOLERANCE * std::fabs(diag_original)) {
+      return false;
+    }
+  }
+
+  std::vector<double> y(n);
+  const auto lu_solve = [&](const gsl_vector *rhs, gsl_vector *solution) {
+    for (int i = 0; i < n; i++) {
+      double sum = gsl_vector_get(rhs, order[i]);
+      for (int p = rowstart[i]; p < diagpos[i]; p++) {
+        sum -= lu[p] * y[colindex[p]];
+      }
+      y[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      double sum = y[i];
+      for (int p = diagpos[i] + 1; p < rowstart[i + 1]; p++) {
+        sum -= lu[p] * y[colindex[p]];
+      }
+      y[i] = sum / lu[diagpos[i]];
+    }
+    for (int i = 0; i < n; i++) {
+      gsl_vector_set(solution, order[i], y[i]);
+    }
+  };
+
+  lu_solve(balance_vector, x);
+
+  const double balance_max = std::fabs(gsl_vector_get(balance_vector, gsl_blas_idamax(balance_vector)));
+  gsl_vector *residual_vector = gsl_vector_alloc(n);
+  gsl_vector *correction = gsl_vector_alloc(n);
+  gsl_vector *x_best = gsl_vector_alloc(n);
+  double error_best = -1.;
+  for (int iteration = 0; iteration < 10; iteration++) {
+    gsl_vector_memcpy(residual_vector, balance_vector);
+    gsl_blas_dgemv(CblasNoTrans, 1.0, rate_matrix, x, -1.0, residual_vector);  // calculate Ax - b = residual
+    const double error = fabs(gsl_vector_get(residual_vector, gsl_blas_idamax(residual_vector)));
+
+    if (std::isfinite(error) && (error < error_best || error_best < 0.)) {
+      gsl_vector_memcpy(x_best, x);
+      error_best = error;
+    }
+    if (error <= 1e-16 * balance_max) {
+      break;
+    }
+
+    lu_solve(residual_vector, correction);
+    gsl_vector_sub(x, correction);
+  }
+  gsl_vector_memcpy(x, x_best);
+
+  gsl_vector_free(x_best);
+  gsl_vector_free(correction);
+  gsl_vector_free(residual_vector);
+
+  if (error_best < 0. || error_best > MAX_REL_RESIDUAL * balance_max) {
+    printout("  NLTE sparse solver: Z=%d max residual %g is too large, using the dense solver\n",
+             get_atomicnumber(element), error_best);
+    return false;
+  }
+
+  return true;
+}
+
+static auto nltepop_matrix_solve_dense(const int element, const gsl_matrix *rate_matrix,
+                                       const gsl_vector *balance_vector, gsl_vector *x) -> bool
+// LU decomposition with partial pivoting and iterative refinement
 {
   bool completed_solution = false;
   const size_t nlte_dimension = balance_vector->size;
-  assert_always(pop_normfactor_vec->size == nlte_dimension);
-  assert_always(rate_matrix->size1 == nlte_dimension);
-  assert_always(rate_matrix->size2 == nlte_dimension);
-
-  gsl_vector *x = gsl_vector_alloc(nlte_dimension);  // population solution vector (normalised)
 
   // make a copy of the rate matrix for the LU decomp
   gsl_matrix *rate_matrix_LU_decomp = gsl_matrix_alloc(nlte_dimension, nlte_dimension);
@@ -764,6 +1069,178 @@ static auto nltepop_matrix_solve(const int element, const gsl_matrix *rate_matri
     gsl_vector_free(x_best);
     gsl_vector_free(gsl_work_vector);
 
+    gsl_vector_free(residual_vector);
+    completed_solution = true;
+  }
+
+  gsl_matrix_free(rate_matrix_LU_decomp);
+  gsl_permutation_free(p);
+
+  return completed_solution;
+}
+
+static auto nltepop_get_previous_solution(const int modelgridindex, const int element,
+                                          const std::vector<double> &superlevel_partfunc,
+                                          const gsl_vector *pop_normfactor_vec) -> gsl_vector *
+// get the normalised population vector of the previous NLTE solution in this cell (previous NLTE iteration or
+// timestep) as the starting point for the iterative solver, or nullptr if the populations are not available
+{
+  const int nlte_dimension = static_cast<int>(pop_normfactor_vec->size);
+  const double rho = grid::get_rho(modelgridindex);
+  gsl_vector *x_initial = gsl_vector_alloc(nlte_dimension);
+
+  for (int ion = 0; ion < get_nions(element); ion++) {
+    const int nlte_start = globals::elements[element].ions[ion].first_nlte;
+    const int nlevels_nlte = get_nlevels_nlte(element, ion);
+    const int index_gs = get_nlte_vector_index(element, ion, 0);
+    gsl_vector_set(x_initial, index_gs, grid::modelgrid[modelgridindex].composition[element].groundlevelpop[ion]);
+
+    for (int level = 1; level <= nlevels_nlte; level++) {
+      gsl_vector_set(x_initial, get_nlte_vector_index(element, ion, level),
+                     grid::modelgrid[modelgridindex].nlte_pops[nlte_start + level - 1] * rho);
+    }
+
+    if (ion_has_superlevel(element, ion)) {
+      gsl_vector_set(x_initial, get_nlte_vector_index(element, ion, nlevels_nlte + 1),
+                     grid::modelgrid[modelgridindex].nlte_pops[nlte_start + nlevels_nlte] * rho *
+                         superlevel_partfunc[ion]);
+    }
+  }
+
+  for (int index = 0; index < nlte_dimension; index++) {
+    // negative populations flag that there is no NLTE solution (e.g. first timestep or reset to LTE)
+    if (!(gsl_vector_get(x_initial, index) >= 0.) || !(gsl_vector_get(pop_normfactor_vec, index) > 0.)) {
+      gsl_vector_free(x_initial);
+      return nullptr;
+    }
+  }
+
+  gsl_vector_div(x_initial, pop_normfactor_vec);
+  return x_initial;
+}
+
+static auto nltepop_matrix_solve_iterative(const int modelgridindex, const int element, const gsl_matrix *rate_matrix,
+                                           const gsl_vector *balance_vector, gsl_vector *x) -> bool
+// GMRES with Jacobi (diagonal) preconditioning, starting from the solution vector in x.
+// Returns false if the solution does not converge, so that the direct LU solver can be used instead
+{
+  const int MAX_RESTARTS = 10;
+  const size_t RESTART_ITERATIONS = 50;
+  const double TOLERANCE = 1e-12;         // GMRES residual relative to the preconditioned balance vector
+  const double MAX_REL_RESIDUAL = 1e-10;  // relative to the largest entry of the balance vector
+
+  const int nlte_dimension = static_cast<int>(balance_vector->size);
+
+  // scale each row by its diagonal element, which is the total rate out of the level (or the normalisation factor for
+  // the population constraint rows)
+  gsl_spmatrix *triplet = gsl_spmatrix_alloc(nlte_dimension, nlte_dimension);
+  gsl_vector *balance_scaled = gsl_vector_alloc(nlte_dimension);
+  bool has_zero_diagonal = false;
+  for (int row = 0; row < nlte_dimension; row++) {
+    const double diag = gsl_matrix_get(rate_matrix, row, row);
+    if (diag == 0.) {
+      has_zero_diagonal = true;
+      break;
+    }
+    for (int column = 0; column < nlte_dimension; column++) {
+      const double value = gsl_matrix_get(rate_matrix, row, column);
+      if (value != 0.) {
+        gsl_spmatrix_set(triplet, row, column, value / diag);
+      }
+    }
+    gsl_vector_set(balance_scaled, row, gsl_vector_get(balance_vector, row) / diag);
+  }
+
+  int status = GSL_CONTINUE;
+  size_t iterations = 0;
+  if (!has_zero_diagonal) {
+    gsl_spmatrix *rate_matrix_sparse = gsl_spmatrix_compress(triplet, GSL_SPMATRIX_CSC);
+    gsl_splinalg_itersolve *workspace =
+        gsl_splinalg_itersolve_alloc(gsl_splinalg_itersolve_gmres, nlte_dimension, RESTART_ITERATIONS);
+
+    gsl_error_handler_t *previous_handler = gsl_set_error_handler(gsl_error_handler_printout);
+    for (int restart = 0; restart < MAX_RESTARTS && status == GSL_CONTINUE; restart++) {
+      status = gsl_splinalg_itersolve_iterate(rate_matrix_sparse, balance_scaled, TOLERANCE, x, workspace);
+      iterations += gsl_splinalg_itersolve_niter(workspace);
+    }
+    gsl_set_error_handler(previous_handler);
+
+    gsl_splinalg_itersolve_free(workspace);
+    gsl_spmatrix_free(rate_matrix_sparse);
+  }
+  gsl_vector_free(balance_scaled);
+  gsl_spmatrix_free(triplet);
+
+  // check the residual of the unscaled equations
+  double error = -1.;
+  if (status == GSL_SUCCESS) {
+    gsl_vector *residual_vector = gsl_vector_alloc(nlte_dimension);
+    gsl_vector_memcpy(residual_vector, balance_vector);
+    gsl_blas_dgemv(CblasNoTrans, 1.0, rate_matrix, x, -1.0, residual_vector);  // calculate Ax - b = residual
+    error = fabs(gsl_vector_get(residual_vector, gsl_blas_idamax(residual_vector)));
+    gsl_vector_free(residual_vector);
+  }
+  const double balance_max = std::fabs(gsl_vector_get(balance_vector, gsl_blas_idamax(balance_vector)));
+  const bool converged = std::isfinite(error) && error >= 0. && error <= MAX_REL_RESIDUAL * balance_max;
+
+  int solves = 0;
+  int fallbacks = 0;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+  solves = ++nlte_iterative_solves;
+  if (!converged) {
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+    fallbacks = ++nlte_iterative_fallbacks;
+  } else {
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    fallbacks = nlte_iterative_fallbacks;
+  }
+
+  printout(
+      "  NLTE iterative solver: cell %d Z=%d %s after %zu GMRES iterations (max residual %g). Fallback to LU in "
+      "%d of %d solves\n",
+      modelgridindex, get_atomicnumber(element), converged ? "converged" : "did not converge", iterations, error,
+      fallbacks, solves);
+
+  return converged;
+}
+
+static auto nltepop_matrix_solve(const int modelgridindex, const int element, const gsl_matrix *rate_matrix,
+                                 const gsl_vector *balance_vector, gsl_vector *popvec,
+                                 const gsl_vector *pop_normfactor_vec, const gsl_vector *x_initial) -> bool
+// solve rate_matrix * x = balance_vector,
+// then popvec[i] = x[i] / pop_norm_factor_vec[i]
+// x_initial is an optional starting point for the iterative solver
+{
+  const size_t nlte_dimension = balance_vector->size;
+  assert_always(pop_normfactor_vec->size == nlte_dimension);
+  assert_always(rate_matrix->size1 == nlte_dimension);
+  assert_always(rate_matrix->size2 == nlte_dimension);
+
+  gsl_vector *x = gsl_vector_alloc(nlte_dimension);  // population solution vector (normalised)
+
+  bool completed_solution = false;
+  if constexpr (NLTE_ITERATIVE_SOLVER_ON) {
+    if (x_initial != nullptr) {
+      gsl_vector_memcpy(x, x_initial);
+      completed_solution = nltepop_matrix_solve_iterative(modelgridindex, element, rate_matrix, balance_vector, x);
+    }
+  }
+  if constexpr (NLTE_SPARSE_SOLVER_ON) {
+    if (!completed_solution) {
+      completed_solution = nltepop_matrix_solve_sparse(element, rate_matrix, balance_vector, x);
+    }
+  }
+  if (!completed_solution) {
+    completed_solution = nltepop_matrix_solve_dense(element, rate_matrix, balance_vector, x);
+  }
+
+  if (completed_solution) {
     // get the real populations using the x vector and the normalisation factors
     gsl_vector_memcpy(popvec, x);
     gsl_vector_mul(popvec, pop_normfactor_vec);
@@ -794,14 +1271,9 @@ static auto nltepop_matrix_solve(const int element, const gsl_matrix *rate_matri
         gsl_vector_set(popvec, row, gsl_vector_get(pop_normfactor_vec, row));
       }
     }
-
-    gsl_vector_free(residual_vector);
-    completed_solution = true;
   }
 
   gsl_vector_free(x);
-  gsl_matrix_free(rate_matrix_LU_decomp);
-  gsl_permutation_free(p);
 
   return completed_solution;
 }
@@ -958,8 +1430,17 @@ void solve_nlte_pops_element(const int element, const int modelgridindex, const
 
   gsl_vector *popvec = gsl_vector_alloc(nlte_dimension);  // the true population densities
 
-  const bool matrix_solve_success =
-      nltepop_matrix_solve(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec);
+  gsl_vector *x_initial = nullptr;
+  if constexpr (NLTE_ITERATIVE_SOLVER_ON) {
+    x_initial = nltepop_get_previous_solution(modelgridindex, element, superlevel_partfunc, pop_norm_factor_vec);
+  }
+
+  const bool matrix_solve_success = nltepop_matrix_solve(modelgridindex, element, rate_matrix, balance_vector, popvec,
+                                                         pop_norm_factor_vec, x_initial);
+
+  if (x_initial != nullptr) {
+    gsl_vector_free(x_initial);
+  }
 
   if (!matrix_solve_success) {
     printout(
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "atomic.h"
 #include "decay.h"
@@ -90,6 +91,43 @@ struct collionrow {
 
 static std::vector<struct collionrow> colliondata;
 
+// for SF_PRECOMPUTED_OPERATORS_ON, the parts of the Spencer-Fano matrix that only depend on the atomic data and the
+// energy grid. Each cell multiplies these by its level or ion populations
+
+// excitation from one lower level (summed over its transitions) per unit level population, which is a band of
+// columns i to i + bandwidth - 1 in each row i
+struct sf_excitation_operator {
+  int element;
+  int ion;
+  int lower;
+  int bandwidth;
+  size_t offset;  // into sf_operator_data
+};
+
+// ionisation of one shell (colliondata row) per unit ion population. The values are five vectors of length SFPTS
+struct sf_ionization_operator {
+  int xsstartindex;
+  int augerstopindex;
+  size_t offset;  // into sf_operator_data
+};
+
+enum sf_ionization_operator_vec {
+  SF_IONOP_PREFACTOR = 0,   // cross section over the atan normalisation times DELTA_E at E' = envec[j]
+  SF_IONOP_INT_EPS_UPPER,   // atan((epsilon_upper - ionpot) / J) at E' = envec[j]
+  SF_IONOP_INT_EPS_LOWER,   // atan((max(E' - E, ionpot) - ionpot) / J) for E' - E = j * DELTA_E
+  SF_IONOP_INT_EPS_LOWER2,  // atan(E / J) at E = envec[i]
+  SF_IONOP_AUGER_WEIGHT,    // cross section at E' = envec[j] for the Auger electron terms (if SF_AUGER_CONTRIBUTION_ON)
+  SF_IONOP_COUNT,
+};
+
+static std::vector<struct sf_excitation_operator> sf_excitation_operators;
+// [uniqueionindex] is the first excitation operator of each ion
+static std::vector<int> sf_excitation_operators_ionstart;
+// same indices as colliondata
+static std::vector<struct sf_ionization_operator> sf_ionization_operators;
+// node-shared values of all operators
+static double *sf_operator_data = nullptr;
+
 static FILE *nonthermalfile = nullptr;
 static bool nonthermal_initialized = false;
 
@@ -545,6 +583,8 @@ void init(const int my_rank, const int ndo_nonempty) {
 
   read_collion_data();
 
+  init_sf_operators();
+
   nonthermal_initialized = true;
   printout("Finished initializing non-thermal solver\n");
 }
@@ -2129,7 +2169,28 @@ static void analyse_sf_solution(const int modelgridindex, const int timestep, co
   // E_init_ev *= frac_sum;
 }
 
-static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelgridindex, const int element,
+// the Spencer-Fano matrix only has nonzero elements on and above the diagonal, so with SF_PACKED_TRIANGULAR_SOLVER_ON
+// the upper triangle is stored row by row, i.e., row i holds the columns i to SFPTS - 1
+struct sfmatrix_packed_upper {
+  std::vector<double> values = std::vector<double>(static_cast<size_t>(SFPTS) * (SFPTS + 1) / 2, 0.);
+};
+
+static constexpr auto get_sfmatrix_packed_rowoffset(const int row) -> size_t {
+  return (static_cast<size_t>(row) * SFPTS) - (static_cast<size_t>(row) * (row - 1) / 2);
+}
+
+static inline auto sfmatrix_ptr(gsl_matrix *const sfmatrix, const int i, const int j) -> double * {
+  return gsl_matrix_ptr(sfmatrix, i, j);
+}
+
+static inline auto sfmatrix_ptr(sfmatrix_packed_upper *const sfmatrix, const int i, const int j) -> double * {
+  assert_testmodeonly(j >= i);
+  assert_testmodeonly(j < SFPTS);
+  return &sfmatrix->values[get_sfmatrix_packed_rowoffset(i) + (j - i)];
+}
+
+template <typename SFMatrix>
+static void sfmatrix_add_excitation(SFMatrix *const sfmatrix, const int modelgridindex, const int element,
                                     const int ion) {
   // excitation terms
   gsl_vector *vec_xs_excitation_deltae = gsl_vector_alloc(SFPTS);
@@ -2165,7 +2226,7 @@ static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelg
 
           const int startindex = i > xsstartindex ? i : xsstartindex;
           for (int j = startindex; j < stopindex; j++) {
-            *gsl_matrix_ptr(sfmatrix, i, j) += nnlevel * gsl_vector_get(vec_xs_excitation_deltae, j);
+            *sfmatrix_ptr(sfmatrix, i, j) += nnlevel * gsl_vector_get(vec_xs_excitation_deltae, j);
           }
 
           // do the last bit separately because we're not using the full delta_e interval
@@ -2173,7 +2234,7 @@ static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelg
 
           const double delta_en_actual = (en + epsilon_trans_ev - gsl_vector_get(envec, stopindex));
 
-          *gsl_matrix_ptr(sfmatrix, i, stopindex) +=
+          *sfmatrix_ptr(sfmatrix, i, stopindex) +=
               nnlevel * gsl_vector_get(vec_xs_excitation_deltae, stopindex) * delta_en_actual / delta_en;
         }
       }
@@ -2182,7 +2243,8 @@ static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelg
   gsl_vector_free(vec_xs_excitation_deltae);
 }
 
-static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, const int ionstage, const double nnion)
+template <typename SFMatrix>
+static void sfmatrix_add_ionization(SFMatrix *const sfmatrix, const int Z, const int ionstage, const double nnion)
 // add the ionization terms to the Spencer-Fano matrix
 {
   gsl_vector *const vec_xs_ionization = gsl_vector_alloc(SFPTS);
@@ -2231,7 +2293,7 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
               std::max(endash - en, ionpot_ev);  // and epsilon_upper = (endash + ionpot_ev) / 2;
           const double int_eps_lower = atan((epsilon_lower - ionpot_ev) / J);
           if (int_eps_lower <= int_eps_upper[j]) {
-            *gsl_matrix_ptr(sfmatrix, i, j) += prefactors[j] * (int_eps_upper[j] - int_eps_lower) * DELTA_E;
+            *sfmatrix_ptr(sfmatrix, i, j) += prefactors[j] * (int_eps_upper[j] - int_eps_lower) * DELTA_E;
           }
         }
 
@@ -2245,7 +2307,7 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
             // epsilon_lower = en + ionpot_ev;
             // epsilon_upper = (endash + ionpot_ev) / 2;
             if (int_eps_lower2 <= int_eps_upper[j]) {
-              *gsl_matrix_ptr(sfmatrix, i, j) -= prefactors[j] * (int_eps_upper[j] - int_eps_lower2) * DELTA_E;
+              *sfmatrix_ptr(sfmatrix, i, j) -= prefactors[j] * (int_eps_upper[j] - int_eps_lower2) * DELTA_E;
             }
           }
         }
@@ -2272,14 +2334,14 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
               const double en_boost = 1 / (1. - collionrow.prob_num_auger[0]);
               for (int a = 1; a <= NT_MAX_AUGER_ELECTRONS; a++) {
                 if (en < (en_auger_ev * en_boost / a)) {
-                  *gsl_matrix_ptr(sfmatrix, i, j) -= nnion * xs * collionrow.prob_num_auger[a] * a;
+                  *sfmatrix_ptr(sfmatrix, i, j) -= nnion * xs * collionrow.prob_num_auger[a] * a;
                 }
               }
             } else {
               assert_always(en < en_auger_ev);
               // printout("SFAuger E %g < en_auger_ev %g so subtracting %g from element with value %g\n", en,
               // en_auger_ev, nnion * xs, ij_contribution);
-              *gsl_matrix_ptr(sfmatrix, i, j) -= nnion * xs;  // * n_auger_elec_avg; // * en_auger_ev???
+              *sfmatrix_ptr(sfmatrix, i, j) -= nnion * xs;  // * n_auger_elec_avg; // * en_auger_ev???
             }
           }
         }
@@ -2289,6 +2351,288 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
   gsl_vector_free(vec_xs_ionization);
 }
 
+static void calculate_sf_excitation_operator(const struct sf_excitation_operator &op,
+                                             gsl_vector *vec_xs_excitation_deltae)
+// sum the excitation terms of all transitions from a lower level into its band of the Spencer-Fano matrix
+{
+  const int element = op.element;
+  const int ion = op.ion;
+  const int lower = op.lower;
+  double *const band = &sf_operator_data[op.offset];
+  std::fill_n(band, static_cast<size_t>(SFPTS) * op.bandwidth, 0.);
+
+  const double statweight_lower = stat_weight(element, ion, lower);
+  const double epsilon_lower = epsilon(element, ion, lower);
+  const int nuptrans = get_nuptrans(element, ion, lower);
+  for (int t = 0; t < nuptrans; t++) {
+    const int lineindex = globals::elements[element].ions[ion].levels[lower].uptrans[t].lineindex;
+    const int upper = globals::linelist[lineindex].upperlevelindex;
+    if (upper >= NTEXCITATION_MAXNLEVELS_UPPER) {
+      continue;
+    }
+    const double epsilon_trans = epsilon(element, ion, upper) - epsilon_lower;
+    const double epsilon_trans_ev = epsilon_trans / EV;
+    if (epsilon_trans_ev < SF_EMIN) {
+      continue;
+    }
+
+    const int xsstartindex =
+        get_xs_excitation_vector(vec_xs_excitation_deltae, element, ion, lower, t, statweight_lower, epsilon_trans);
+    if (xsstartindex >= 0) {
+      gsl_blas_dscal(DELTA_E, vec_xs_excitation_deltae);
+
+      for (int i = 0; i < SFPTS; i++) {
+        const double en = gsl_vector_get(envec, i);
+        const int stopindex = get_energyindex_ev_lteq(en + epsilon_trans_ev);
+        assert_always(stopindex - i < op.bandwidth);
+
+        const int startindex = i > xsstartindex ? i : xsstartindex;
+        for (int j = startindex; j < stopindex; j++) {
+          band[(i * op.bandwidth) + (j - i)] += gsl_vector_get(vec_xs_excitation_deltae, j);
+        }
+
+        // do the last bit separately because we're not using the full delta_e interval
+        const double delta_en_actual = (en + epsilon_trans_ev - gsl_vector_get(envec, stopindex));
+
+        band[(i * op.bandwidth) + (stopindex - i)] +=
+            gsl_vector_get(vec_xs_excitation_deltae, stopindex) * delta_en_actual / DELTA_E;
+      }
+    }
+  }
+}
+
+static void calculate_sf_ionization_operator(const struct collionrow &collionrow,
+                                             const struct sf_ionization_operator &op, gsl_vector *vec_xs_ionization)
+// the energy grid is uniform, so the lower limit of the first integral only depends on E' - E, and all of the
+// arctangents can be tabulated as vectors instead of being evaluated for every matrix element in every cell
+{
+  const int Z = collionrow.Z;
+  const int ionstage = Z - collionrow.nelec + 1;
+  const double ionpot_ev = collionrow.ionpot_ev;
+  const double J = get_J(Z, ionstage, ionpot_ev);
+
+  assert_always(ionpot_ev >= SF_EMIN);
+
+  double *const prefactors = &sf_operator_data[op.offset + (SF_IONOP_PREFACTOR * SFPTS)];
+  double *const int_eps_upper = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_UPPER * SFPTS)];
+  double *const int_eps_lower = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_LOWER * SFPTS)];
+  double *const int_eps_lower2 = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_LOWER2 * SFPTS)];
+  double *const auger_weight = &sf_operator_data[op.offset + (SF_IONOP_AUGER_WEIGHT * SFPTS)];
+
+  const int xsstartindex = get_xs_ionization_vector(vec_xs_ionization, collionrow);
+  assert_always(xsstartindex == op.xsstartindex);
+  for (int j = 0; j < SFPTS; j++) {
+    prefactors[j] = 0.;
+    int_eps_upper[j] = 0.;
+    if (j >= xsstartindex) {
+      const double endash = gsl_vector_get(envec, j);
+      const double epsilon_upper = std::min((endash + ionpot_ev) / 2, endash);
+      int_eps_upper[j] = atan((epsilon_upper - ionpot_ev) / J);
+      prefactors[j] = gsl_vector_get(vec_xs_ionization, j) / atan((endash - ionpot_ev) / 2 / J) * DELTA_E;
+    }
+
+    const double epsilon_lower = std::max(j * DELTA_E, ionpot_ev);
+    int_eps_lower[j] = atan((epsilon_lower - ionpot_ev) / J);
+
+    int_eps_lower2[j] = atan(gsl_vector_get(envec, j) / J);
+  }
+
+  std::fill_n(auger_weight, SFPTS, 0.);
+  if constexpr (SF_AUGER_CONTRIBUTION_ON) {
+    for (int j = xsstartindex; j < SFPTS; j++) {
+      auger_weight[j] = gsl_vector_get(vec_xs_ionization, j);
+    }
+  }
+}
+
+static auto get_sf_augerstopindex(const struct collionrow &collionrow) -> int {
+  if constexpr (!SF_AUGER_CONTRIBUTION_ON) {
+    return 0;
+  }
+  if (SF_AUGER_CONTRIBUTION_DISTRIBUTE_EN) {
+    // en_auger_ev is (if LJS understands it correctly) averaged to include some probability of zero Auger
+    // electrons so we need a boost to get the average energy of Auger electrons given that there are one or more
+    const double en_boost = 1 / (1. - collionrow.prob_num_auger[0]);
+
+    return get_energyindex_ev_gteq(collionrow.en_auger_ev * en_boost);
+  }
+  return get_energyindex_ev_gteq(collionrow.en_auger_ev);
+}
+
+static auto get_sf_auger_rowweight(const struct collionrow &collionrow, const double en) -> double
+// the number of Auger electrons that are produced with energies above en per shell ionisation
+{
+  if (SF_AUGER_CONTRIBUTION_DISTRIBUTE_EN) {
+    const double en_boost = 1 / (1. - collionrow.prob_num_auger[0]);
+    double weight = 0.;
+    for (int a = 1; a <= NT_MAX_AUGER_ELECTRONS; a++) {
+      if (en < (collionrow.en_auger_ev * en_boost / a)) {
+        weight += collionrow.prob_num_auger[a] * a;
+      }
+    }
+    return weight;
+  }
+  assert_always(en < collionrow.en_auger_ev);
+  return 1.;
+}
+
+void init_sf_operators()
+// precompute the cell-independent excitation and ionisation operators of the Spencer-Fano equation
+// in node-shared memory
+{
+  if constexpr (!SF_PRECOMPUTED_OPERATORS_ON) {
+    return;
+  }
+
+  size_t nvalues = 0;
+
+  // the band of each excitation operator must cover the energy loss of its highest transition
+  sf_excitation_operators_ionstart.resize(get_includedions() + 1);
+  for (int element = 0; element < get_nelements(); element++) {
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      sf_excitation_operators_ionstart[get_uniqueionindex(element, ion)] =
+          static_cast<int>(sf_excitation_operators.size());
+      const int nlevels = std::min(NTEXCITATION_MAXNLEVELS_LOWER, get_nlevels(element, ion));
+      for (int lower = 0; lower < nlevels; lower++) {
+        const double epsilon_lower = epsilon(element, ion, lower);
+        int bandwidth = 0;
+        for (int t = 0; t < get_nuptrans(element, ion, lower); t++) {
+          const int lineindex = globals::elements[element].ions[ion].levels[lower].uptrans[t].lineindex;
+          const int upper = globals::linelist[lineindex].upperlevelindex;
+          const double epsilon_trans_ev = (epsilon(element, ion, upper) - epsilon_lower) / EV;
+          if (upper >= NTEXCITATION_MAXNLEVELS_UPPER || epsilon_trans_ev < SF_EMIN) {
+            continue;
+          }
+          for (int i = 0; i < SFPTS; i++) {
+            const int stopindex = get_energyindex_ev_lteq(gsl_vector_get(envec, i) + epsilon_trans_ev);
+            bandwidth = std::max(bandwidth, stopindex - i + 1);
+          }
+        }
+        if (bandwidth > 0) {
+          sf_excitation_operators.push_back({.element = element,
+                                             .ion = ion,
+                                             .lower = lower,
+                                             .bandwidth = bandwidth,
+                                             .offset = nvalues});
+          nvalues += static_cast<size_t>(SFPTS) * bandwidth;
+        }
+      }
+    }
+  }
+  sf_excitation_operators_ionstart[get_includedions()] = static_cast<int>(sf_excitation_operators.size());
+
+  for (const auto &collionrow : colliondata) {
+    sf_ionization_operators.push_back({.xsstartindex = get_energyindex_ev_gteq(collionrow.ionpot_ev),
+                                       .augerstopindex = get_sf_augerstopindex(collionrow),
+                                       .offset = nvalues});
+    nvalues += static_cast<size_t>(SFPTS) * SF_IONOP_COUNT;
+  }
+
+#ifdef MPI_ON
+  MPI_Win win = MPI_WIN_NULL;
+  MPI_Aint size = (globals::rank_in_node == 0) ? nvalues * sizeof(double) : 0;
+  int disp_unit = sizeof(double);
+  assert_always(MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &sf_operator_data,
+                                        &win) == MPI_SUCCESS);
+  assert_always(MPI_Win_shared_query(win, 0, &size, &disp_unit, &sf_operator_data) == MPI_SUCCESS);
+#else
+  sf_operator_data = static_cast<double *>(malloc(nvalues * sizeof(double)));
+#endif
+  assert_always(sf_operator_data != nullptr);
+
+  // the operators are divided between the ranks on the node
+  gsl_vector *vec_xs = gsl_vector_alloc(SFPTS);
+  for (size_t i = 0; i < sf_excitation_operators.size(); i++) {
+    if (static_cast<int>(i % globals::node_nprocs) == globals::rank_in_node) {
+      calculate_sf_excitation_operator(sf_excitation_operators[i], vec_xs);
+    }
+  }
+  for (size_t n = 0; n < colliondata.size(); n++) {
+    if (static_cast<int>(n % globals::node_nprocs) == globals::rank_in_node) {
+      calculate_sf_ionization_operator(colliondata[n], sf_ionization_operators[n], vec_xs);
+    }
+  }
+  gsl_vector_free(vec_xs);
+
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+
+  printout(
+      "[info] mem_usage: precomputed Spencer-Fano operators (%zu excitation, %zu ionisation) occupy %.3f MB (node "
+      "shared memory)\n",
+      sf_excitation_operators.size(), sf_ionization_operators.size(), nvalues * sizeof(double) / 1024. / 1024.);
+}
+
+template <typename SFMatrix>
+static void sfmatrix_add_excitation_precomputed(SFMatrix *const sfmatrix, const int modelgridindex, const int element,
+                                               const int ion)
+// excitation terms from the precomputed operators of each lower level
+{
+  const int uniqueionindex = get_uniqueionindex(element, ion);
+  for (int opindex = sf_excitation_operators_ionstart[uniqueionindex];
+       opindex < sf_excitation_operators_ionstart[uniqueionindex + 1]; opindex++) {
+    const auto &op = sf_excitation_operators[opindex];
+    const double nnlevel = get_levelpop(modelgridindex, element, ion, op.lower);
+    const double *const band = &sf_operator_data[op.offset];
+    for (int i = 0; i < SFPTS; i++) {
+      const int jmax = std::min(i + op.bandwidth, SFPTS);
+      for (int j = i; j < jmax; j++) {
+        *sfmatrix_ptr(sfmatrix, i, j) += nnlevel * band[(i * op.bandwidth) + (j - i)];
+      }
+    }
+  }
+}
+
+template <typename SFMatrix>
+static void sfmatrix_add_ionization_precomputed(SFMatrix *const sfmatrix, const int Z, const int ionstage,
+                                                const double nnion)
+// ionization terms from the precomputed operators of each shell
+{
+  for (size_t n = 0; n < colliondata.size(); n++) {
+    const auto &collionrow = colliondata[n];
+    if (collionrow.Z != Z || collionrow.nelec != Z - ionstage + 1) {
+      continue;
+    }
+    const auto &op = sf_ionization_operators[n];
+    const double ionpot_ev = collionrow.ionpot_ev;
+    const int xsstartindex = op.xsstartindex;
+    const double *const prefactors = &sf_operator_data[op.offset + (SF_IONOP_PREFACTOR * SFPTS)];
+    const double *const int_eps_upper = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_UPPER * SFPTS)];
+    const double *const int_eps_lower = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_LOWER * SFPTS)];
+    const double *const int_eps_lower2 = &sf_operator_data[op.offset + (SF_IONOP_INT_EPS_LOWER2 * SFPTS)];
+    const double *const auger_weight = &sf_operator_data[op.offset + (SF_IONOP_AUGER_WEIGHT * SFPTS)];
+
+    for (int i = 0; i < SFPTS; i++) {
+      const double en = gsl_vector_get(envec, i);
+
+      const int jstart = std::max(i, xsstartindex);
+      for (int j = jstart; j < SFPTS; j++) {
+        if (int_eps_lower[j - i] <= int_eps_upper[j]) {
+          *sfmatrix_ptr(sfmatrix, i, j) += nnion * prefactors[j] * (int_eps_upper[j] - int_eps_lower[j - i]);
+        }
+      }
+
+      if (2 * en + ionpot_ev <= SF_EMAX) {
+        const int secondintegralstartindex = std::max(xsstartindex, get_energyindex_ev_lteq(2 * en + ionpot_ev));
+        for (int j = secondintegralstartindex; j < SFPTS; j++) {
+          if (int_eps_lower2[i] <= int_eps_upper[j]) {
+            *sfmatrix_ptr(sfmatrix, i, j) -= nnion * prefactors[j] * (int_eps_upper[j] - int_eps_lower2[i]);
+          }
+        }
+      }
+    }
+
+    for (int i = 0; i < op.augerstopindex; i++) {
+      const double rowweight = nnion * get_sf_auger_rowweight(collionrow, gsl_vector_get(envec, i));
+      const int jstart = std::max(i, xsstartindex);
+      for (int j = jstart; j < SFPTS; j++) {
+        *sfmatrix_ptr(sfmatrix, i, j) -= rowweight * auger_weight[j];
+      }
+    }
+  }
+}
+
 static void sfmatrix_solve(const gsl_matrix *sfmatrix, const gsl_vector *rhsvec, gsl_vector *yvec) {
   // WARNING: this assumes sfmatrix is in upper triangular form already!
   const gsl_matrix *sfmatrix_LU = sfmatrix;
@@ -2352,6 +2696,108 @@ static void sfmatrix_solve(const gsl_matrix *sfmatrix, const gsl_vector *rhsvec,
   }
 }
 
+static void sfmatrix_solve_packed(const sfmatrix_packed_upper *sfmatrix, const gsl_vector *rhsvec, gsl_vector *yvec)
+// the matrix is upper triangular, so solve by back substitution without any factorisation
+{
+  for (int i = SFPTS - 1; i >= 0; i--) {
+    const double *const row = &sfmatrix->values[get_sfmatrix_packed_rowoffset(i)];
+    double sum = gsl_vector_get(rhsvec, i);
+    for (int j = i + 1; j < SFPTS; j++) {
+      sum -= row[j - i] * gsl_vector_get(yvec, j);
+    }
+    gsl_vector_set(yvec, i, sum / row[0]);
+  }
+
+  // value of the largest absolute residual of Ax - b
+  double error = 0.;
+  for (int i = 0; i < SFPTS; i++) {
+    const double *const row = &sfmatrix->values[get_sfmatrix_packed_rowoffset(i)];
+    double residual = -gsl_vector_get(rhsvec, i);
+    for (int j = i; j < SFPTS; j++) {
+      residual += row[j - i] * gsl_vector_get(yvec, j);
+    }
+    error = std::max(error, std::fabs(residual));
+  }
+
+  if (!(error <= 1e-10)) {
+    printout("  SF solver back substitution: solution vector has a max residual of %g (WARNING)\n", error);
+  }
+
+  if (gsl_vector_isnonneg(yvec) == 0) {
+    printout("solve_sfmatrix: WARNING: y function goes negative!\n");
+  }
+}
+
+template <typename SFMatrix>
+static void sfmatrix_setup(SFMatrix *const sfmatrix, gsl_vector *const rhsvec, const int modelgridindex,
+                           const double nne, const bool enable_sfexcitation, const bool enable_sfionization)
+// add the loss, source, excitation, and ionisation terms to the Spencer-Fano matrix and right-hand-side vector
+{
+  // loss terms and source terms
+  for (int i = 0; i < SFPTS; i++) {
+    const double en = gsl_vector_get(envec, i);
+
+    *sfmatrix_ptr(sfmatrix, i, i) += electron_loss_rate(en * EV, nne) / EV;
+
+    double source_integral_to_SF_EMAX = NAN;
+    if (i < SFPTS - 1) {
+      gsl_vector_const_view source_e_to_SF_EMAX = gsl_vector_const_subvector(sourcevec, i + 1, SFPTS - i - 1);
+      source_integral_to_SF_EMAX = gsl_blas_dasum(&source_e_to_SF_EMAX.vector) * DELTA_E;
+    } else {
+      source_integral_to_SF_EMAX = 0;
+    }
+
+    gsl_vector_set(rhsvec, i, source_integral_to_SF_EMAX);
+  }
+  // gsl_vector_set_all(rhsvec, 1.); // alternative if all electrons are injected at SF_EMAX
+
+  if (enable_sfexcitation || enable_sfionization) {
+    for (int element = 0; element < get_nelements(); element++) {
+      const int Z = get_atomicnumber(element);
+      const int nions = get_nions(element);
+      bool first_included_ion_of_element = true;
+      for (int ion = 0; ion < nions; ion++) {
+        const double nnion = get_nnion(modelgridindex, element, ion);  // hopefully ions per cm^3?
+
+        if (nnion < minionfraction * get_nnion_tot(modelgridindex))  // skip negligible ions
+        {
+          continue;
+        }
+
+        const int ionstage = get_ionstage(element, ion);
+        if (first_included_ion_of_element) {
+          printout("  including Z=%2d ion_stages: ", Z);
+          for (int i = 1; i < get_ionstage(element, ion); i++) {
+            printout("  ");
+          }
+          first_included_ion_of_element = false;
+        }
+
+        printout("%d ", ionstage);
+
+        if (enable_sfexcitation) {
+          if constexpr (SF_PRECOMPUTED_OPERATORS_ON) {
+            sfmatrix_add_excitation_precomputed(sfmatrix, modelgridindex, element, ion);
+          } else {
+            sfmatrix_add_excitation(sfmatrix, modelgridindex, element, ion);
+          }
+        }
+
+        if (enable_sfionization && (ion < nions - 1)) {
+          if constexpr (SF_PRECOMPUTED_OPERATORS_ON) {
+            sfmatrix_add_ionization_precomputed(sfmatrix, Z, ionstage, nnion);
+          } else {
+            sfmatrix_add_ionization(sfmatrix, Z, ionstage, nnion);
+          }
+        }
+      }
+      if (!first_included_ion_of_element) {
+        printout("\n");
+      }
+    }
+  }
+}
+
 void solve_spencerfano(const int modelgridindex, const int timestep, const int iteration)
 // solve the Spencer-Fano equation to get the non-thermal electron flux energy distribution
 // based on Equation (2) of Li et al. (2012)
@@ -2446,65 +2892,8 @@ void solve_spencerfano(const int modelgridindex, const int timestep, const int i
   //   timesteps.\n");
   // }
 
-  gsl_matrix *const sfmatrix = gsl_matrix_calloc(SFPTS, SFPTS);
   gsl_vector *const rhsvec = gsl_vector_calloc(SFPTS);  // constant term (not dependent on y func) in each equation
 
-  // loss terms and source terms
-  for (int i = 0; i < SFPTS; i++) {
-    const double en = gsl_vector_get(envec, i);
-
-    *gsl_matrix_ptr(sfmatrix, i, i) += electron_loss_rate(en * EV, nne) / EV;
-
-    double source_integral_to_SF_EMAX = NAN;
-    if (i < SFPTS - 1) {
-      gsl_vector_const_view source_e_to_SF_EMAX = gsl_vector_const_subvector(sourcevec, i + 1, SFPTS - i - 1);
-      source_integral_to_SF_EMAX = gsl_blas_dasum(&source_e_to_SF_EMAX.vector) * DELTA_E;
-    } else {
-      source_integral_to_SF_EMAX = 0;
-    }
-
-    gsl_vector_set(rhsvec, i, source_integral_to_SF_EMAX);
-  }
-  // gsl_vector_set_all(rhsvec, 1.); // alternative if all electrons are injected at SF_EMAX
-
-  if (enable_sfexcitation || enable_sfionization) {
-    for (int element = 0; element < get_nelements(); element++) {
-      const int Z = get_atomicnumber(element);
-      const int nions = get_nions(element);
-      bool first_included_ion_of_element = true;
-      for (int ion = 0; ion < nions; ion++) {
-        const double nnion = get_nnion(modelgridindex, element, ion);  // hopefully ions per cm^3?
-
-        if (nnion < minionfraction * get_nnion_tot(modelgridindex))  // skip negligible ions
-        {
-          continue;
-        }
-
-        const int ionstage = get_ionstage(element, ion);
-        if (first_included_ion_of_element) {
-          printout("  including Z=%2d ion_stages: ", Z);
-          for (int i = 1; i < get_ionstage(element, ion); i++) {
-            printout("  ");
-          }
-          first_included_ion_of_element = false;
-        }
-
-        printout("%d ", ionstage);
-
-        if (enable_sfexcitation) {
-          sfmatrix_add_excitation(sfmatrix, modelgridindex, element, ion);
-        }
-
-        if (enable_sfionization && (ion < nions - 1)) {
-          sfmatrix_add_ionization(sfmatrix, Z, ionstage, nnion);
-        }
-      }
-      if (!first_included_ion_of_element) {
-        printout("\n");
-      }
-    }
-  }
-
   // printout("SF matrix | RHS vector:\n");
   // for (int row = 0; row < 10; row++)
   // {
@@ -2528,11 +2917,20 @@ void solve_spencerfano(const int modelgridindex, const int timestep, const int i
   gsl_vector_view yvecview = gsl_vector_view_array(nt_solution[modelgridindex].yfunc, SFPTS);
   gsl_vector *yvec = &yvecview.vector;
 
-  sfmatrix_solve(sfmatrix, rhsvec, yvec);
+  if constexpr (SF_PACKED_TRIANGULAR_SOLVER_ON) {
+    auto sfmatrix = sfmatrix_packed_upper{};
+    sfmatrix_setup(&sfmatrix, rhsvec, modelgridindex, nne, enable_sfexcitation, enable_sfionization);
+    sfmatrix_solve_packed(&sfmatrix, rhsvec, yvec);
+  } else {
+    gsl_matrix *const sfmatrix = gsl_matrix_calloc(SFPTS, SFPTS);
+    sfmatrix_setup(sfmatrix, rhsvec, modelgridindex, nne, enable_sfexcitation, enable_sfionization);
+    sfmatrix_solve(sfmatrix, rhsvec, yvec);
+
+    // gsl_matrix_free(sfmatrix_LU); // if sfmatrix_LU is different to sfmatrix
 
-  // gsl_matrix_free(sfmatrix_LU); // if sfmatrix_LU is different to sfmatrix
+    gsl_matrix_free(sfmatrix);
+  }
 
-  gsl_matrix_free(sfmatrix);
   gsl_vector_free(rhsvec);
 
   if (timestep % 10 == 0) {
@@ -2677,61 +3075,71 @@ void read_restart_data(FILE *gridsave_file) {
 }
 
 #ifdef MPI_ON
-void nt_MPI_Bcast(const int modelgridindex, const int root) {
-  if (grid::get_numassociatedcells(modelgridindex) == 0) {
-    return;
-  }
-
-  // printout("nonthermal_MPI_Bcast cell %d before: ratecoeff(Z=%d ion_stage %d): %g, eff_ionpot %g eV\n",
-  //          modelgridindex, logged_element_z, logged_ion_stage,
-  //          nt_ionization_ratecoeff_sf(modelgridindex, logged_element_index, logged_ion_index),
-  //          get_eff_ionpot(modelgridindex, logged_element_index, logged_ion_index) / EV);
-
-  MPI_Bcast(&deposition_rate_density_timestep[modelgridindex], 1, MPI_INT, root, MPI_COMM_WORLD);
-  MPI_Bcast(&deposition_rate_density[modelgridindex], 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
+void mpi_pack_cell(std::vector<char> &buffer, const int modelgridindex)
+// append the non-thermal solution of a cell to the grid exchange buffer
+{
+  mpi_pack_values(buffer, &deposition_rate_density_timestep[modelgridindex], 1);
+  mpi_pack_values(buffer, &deposition_rate_density[modelgridindex], 1);
 
   if (NT_ON && NT_SOLVE_SPENCERFANO) {
     assert_always(nonthermal_initialized);
-    MPI_Bcast(&nt_solution[modelgridindex].nneperion_when_solved, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].timestep_last_solved, 1, MPI_INT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_heating, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_ionization, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_excitation, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
+    const auto &solution = nt_solution[modelgridindex];
+    mpi_pack_values(buffer, &solution.nneperion_when_solved, 1);
+    mpi_pack_values(buffer, &solution.timestep_last_solved, 1);
+    mpi_pack_values(buffer, &solution.frac_heating, 1);
+    mpi_pack_values(buffer, &solution.frac_ionization, 1);
+    mpi_pack_values(buffer, &solution.frac_excitation, 1);
 
-    MPI_Bcast(nt_solution[modelgridindex].fracdep_ionization_ion, get_includedions(), MPI_DOUBLE, root, MPI_COMM_WORLD);
-    MPI_Bcast(nt_solution[modelgridindex].eff_ionpot, get_includedions(), MPI_FLOAT, root, MPI_COMM_WORLD);
+    mpi_pack_values(buffer, solution.fracdep_ionization_ion, get_includedions());
+    mpi_pack_values(buffer, solution.eff_ionpot, get_includedions());
 
-    MPI_Bcast(nt_solution[modelgridindex].prob_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1), MPI_FLOAT,
-              root, MPI_COMM_WORLD);
-    MPI_Bcast(nt_solution[modelgridindex].ionenfrac_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1),
-              MPI_FLOAT, root, MPI_COMM_WORLD);
+    mpi_pack_values(buffer, solution.prob_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1));
+    mpi_pack_values(buffer, solution.ionenfrac_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1));
 
-    // communicate NT excitations
-    const auto frac_excitations_list_size_old = nt_solution[modelgridindex].frac_excitations_list.size();
-    auto frac_excitations_list_size_new = nt_solution[modelgridindex].frac_excitations_list.size();
-    MPI_Bcast(&frac_excitations_list_size_new, 1, MPI_INT, root, MPI_COMM_WORLD);
+    // the number of NT excitations varies between cells, so it goes in front of the list
+    const size_t frac_excitations_list_size = solution.frac_excitations_list.size();
+    mpi_pack_values(buffer, &frac_excitations_list_size, 1);
+    mpi_pack_values(buffer, solution.frac_excitations_list.data(), frac_excitations_list_size);
 
-    if (frac_excitations_list_size_new != frac_excitations_list_size_old) {
-      nt_solution[modelgridindex].frac_excitations_list.resize(frac_excitations_list_size_new);
+    if (STORE_NT_SPECTRUM) {
+      assert_always(solution.yfunc != nullptr);
+      mpi_pack_values(buffer, solution.yfunc, SFPTS);
     }
+  }
+}
 
-    const auto frac_excitations_list_size = nt_solution[modelgridindex].frac_excitations_list.size();
-    for (size_t excitationindex = 0; excitationindex < frac_excitations_list_size; excitationindex++) {
-      MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].frac_deposition, 1, MPI_DOUBLE,
-                root, MPI_COMM_WORLD);
-      MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].ratecoeffperdeposition, 1,
-                MPI_DOUBLE, root, MPI_COMM_WORLD);
-      MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].lineindex, 1, MPI_INT, root,
-                MPI_COMM_WORLD);
-    }
+void mpi_unpack_cell(const char *buffer, size_t &position, const int modelgridindex)
+// read back a cell written by mpi_pack_cell()
+{
+  mpi_unpack_values(buffer, position, &deposition_rate_density_timestep[modelgridindex], 1);
+  mpi_unpack_values(buffer, position, &deposition_rate_density[modelgridindex], 1);
+
+  if (NT_ON && NT_SOLVE_SPENCERFANO) {
+    assert_always(nonthermal_initialized);
+    auto &solution = nt_solution[modelgridindex];
+    mpi_unpack_values(buffer, position, &solution.nneperion_when_solved, 1);
+    mpi_unpack_values(buffer, position, &solution.timestep_last_solved, 1);
+    mpi_unpack_values(buffer, position, &solution.frac_heating, 1);
+    mpi_unpack_values(buffer, position, &solution.frac_ionization, 1);
+    mpi_unpack_values(buffer, position, &solution.frac_excitation, 1);
+
+    mpi_unpack_values(buffer, position, solution.fracdep_ionization_ion, get_includedions());
+    mpi_unpack_values(buffer, position, solution.eff_ionpot, get_includedions());
+
+    mpi_unpack_values(buffer, position, solution.prob_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1));
+    mpi_unpack_values(buffer, position, solution.ionenfrac_num_auger,
+                      get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1));
+
+    size_t frac_excitations_list_size = 0;
+    mpi_unpack_values(buffer, position, &frac_excitations_list_size, 1);
+    solution.frac_excitations_list.resize(frac_excitations_list_size);
+    mpi_unpack_values(buffer, position, solution.frac_excitations_list.data(), frac_excitations_list_size);
 
     if (STORE_NT_SPECTRUM) {
-      assert_always(nt_solution[modelgridindex].yfunc != nullptr);
-      MPI_Bcast(nt_solution[modelgridindex].yfunc, SFPTS, MPI_DOUBLE, root, MPI_COMM_WORLD);
+      assert_always(solution.yfunc != nullptr);
+      mpi_unpack_values(buffer, position, solution.yfunc, SFPTS);
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
-
     check_auger_probabilities(modelgridindex);
   }
 }
@@ -1,12 +1,15 @@
 #ifndef NONTHERMAL_H
 #define NONTHERMAL_H
 
+#include <cstddef>
 #include <cstdio>
+#include <vector>
 
 #include "packet.h"
 
 namespace nonthermal {
 void init(int my_rank, int ndo_nonempty);
+void init_sf_operators();
 void close_file();
 void solve_spencerfano(int modelgridindex, int timestep, int iteration);
 auto nt_ionization_ratecoeff(int modelgridindex, int element, int ion) -> double;
@@ -22,7 +25,8 @@ auto nt_excitation_ratecoeff(int modelgridindex, int element, int ion, int lower
 void do_ntlepton(struct packet *pkt_ptr);
 void write_restart_data(FILE *gridsave_file);
 void read_restart_data(FILE *gridsave_file);
-void nt_MPI_Bcast(int modelgridindex, int root);
+void mpi_pack_cell(std::vector<char> &buffer, int modelgridindex);
+void mpi_unpack_cell(const char *buffer, size_t &position, int modelgridindex);
 void nt_reset_stats();
 void nt_print_stats(double modelvolume, double deltat);
 }  // namespace nonthermal
@@ -134,6 +134,7 @@ void packet_init(struct packet *pkt)
 
   printout("Placing pellets...\n");
   for (int n = 0; n < globals::npkts; n++) {
+    rng_set_stream(n, 0);
     const double zrand = rng_uniform();
     const double targetval = zrand * norm;
 
@@ -143,7 +144,9 @@ void packet_init(struct packet *pkt)
     const ptrdiff_t cellindex = std::distance(en_cumulative.cbegin(), upperval);
 
     place_pellet(e0, cellindex, n, &pkt[n]);
+    pkt[n].rngblockcounter = rng_get_blockcounter();
   }
+  rng_set_thread_stream();
 
   decay::free_decaypath_energy_per_mass();  // will no longer be needed after packets are set up
 
@@ -221,36 +224,6 @@ void read_temp_packetsfile(const int timestep, const int my_rank, struct packet
   printout("done\n");
 }
 
-auto verify_temp_packetsfile(const int timestep, const int my_rank, const struct packet *const pkt) -> bool {
-  // return true if verification is good, otherwise return false
-
-  // read packets binary file
-  char filename[MAXFILENAMELENGTH];
-  snprintf(filename, MAXFILENAMELENGTH, "packets_%.4d_ts%d.tmp", my_rank, timestep);
-
-  printout("Verifying file %s...", filename);
-  FILE *packets_file = fopen_required(filename, "rb");
-  struct packet pkt_in;
-  bool readback_passed = true;
-  for (int n = 0; n < globals::npkts; n++) {
-    assert_always(std::fread(&pkt_in, sizeof(struct packet), 1, packets_file) == 1);
-    if (pkt_in != pkt[n]) {
-      printout("failed on packet %d\n", n);
-      printout(" compare number %ld %ld\n", pkt_in.number, pkt[n].number);
-      printout(" compare nu_cmf %lg %lg\n", pkt_in.nu_cmf, pkt[n].nu_cmf);
-      printout(" compare e_rf %lg %lg\n", pkt_in.e_rf, pkt[n].e_rf);
-      readback_passed = false;
-    }
-  }
-  fclose(packets_file);
-  if (readback_passed) {
-    printout("  verification passed\n");
-  } else {
-    printout("  verification FAILED\n");
-  }
-  return readback_passed;
-}
-
 void read_packets(const char filename[], struct packet *pkt) {
   // read packets*.out text format file
   std::ifstream packets_file(filename);
@@ -2,6 +2,8 @@
 #define PACKET_H
 
 #include <compare>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 
 enum packet_type {
@@ -36,48 +38,57 @@ enum cell_boundary {
   BOUNDARY_NONE = 107,
 };
 
-struct packet {
+// The first 128 bytes (two cache lines) hold the fields touched on every propagation step (move_pkt(), get_event(),
+// boundary crossings, the update_packets loop). The emission/absorption bookkeeping that is only written at
+// interactions and read when writing out packets follows in the cold part, so walking the packet array for transport
+// does not pull it into cache.
+struct alignas(64) packet {
+  // hot part
   int where = -1;                                 // The propagation grid cell that the packet is in.
   enum packet_type type;                          // type of packet (k-, r-, etc.)
   enum cell_boundary last_cross = BOUNDARY_NONE;  // To avoid rounding errors on cell crossing.
-  int interactions = 0;                           // number of interactions the packet undergone
-  int nscatterings = 0;              // records number of electron scatterings a r-pkt undergone since it was emitted
-  int last_event;                    // debug: stores information about the packets history
-  double pos[3] = {0};               // Position of the packet (x,y,z).
-  double dir[3] = {0};               // Direction of propagation. (x,y,z). Always a unit vector.
-  double e_cmf;                      // The energy the packet carries in the co-moving frame.
-  double e_rf;                       // The energy the packet carries in the rest frame.
-  double nu_cmf;                     // The frequency in the co-moving frame.
-  double nu_rf;                      // The frequency in the rest frame.
-  int next_trans;                    // This keeps track of the next possible line interaction of a rpkt by storing
-                                     // its linelist index (to overcome numerical problems in propagating the rpkts).
-  int emissiontype = EMTYPE_NOTSET;  // records how the packet was emitted if it is a r-pkt
-  double em_pos[3];                  // Position of the last emission (x,y,z).
-  float em_time = -1.;
+  int next_trans;         // This keeps track of the next possible line interaction of a rpkt by storing
+                          // its linelist index (to overcome numerical problems in propagating the rpkts).
+                          // Negative values -1 - lineindex give a start for the line list search instead.
+  int interactions = 0;   // number of interactions the packet undergone
+  int nscatterings = 0;   // records number of electron scatterings a r-pkt undergone since it was emitted
+  int last_event;         // debug: stores information about the packets history
+  int number = -1;        // A unique number to identify the packet
+  double pos[3] = {0};    // Position of the packet (x,y,z).
+  double dir[3] = {0};    // Direction of propagation. (x,y,z). Always a unit vector.
+  double e_cmf;           // The energy the packet carries in the co-moving frame.
+  double e_rf;            // The energy the packet carries in the rest frame.
+  double nu_cmf;          // The frequency in the co-moving frame.
+  double nu_rf;           // The frequency in the rest frame.
   double prop_time = -1.;  // internal clock to track how far in time the packet has been propagated
-  int absorptiontype;      // records linelistindex of the last absorption
-                           // negative values give ff-abs (-1), bf-abs (-2), compton scattering of gammas (-3),
-                           // photoelectric effect of gammas (-4), pair production of gammas (-5)
-                           // decaying pellets of the 52Fe chain (-6) and pellets which decayed before the
-                           // onset of the simulation (-7)
-                           // decay of a positron pellet (-10)
+  double tdecay = -1.;     // Time at which pellet decays
+
+  // cold part
+  struct mastate mastate;
+  int emissiontype = EMTYPE_NOTSET;      // records how the packet was emitted if it is a r-pkt
   int trueemissiontype = EMTYPE_NOTSET;  // emission type coming from a kpkt to rpkt (last thermal emission)
-  float trueem_time = -1.;               // first thermal emission time [s]
-  double absorptionfreq;                 // records nu_rf of packet at last absorption
-  double absorptiondir[3] = {0.};  // Direction of propagation (x,y,z) when a packet was last absorbed in a line. Always
-                                   // a unit vector.
-  double stokes[3] = {0.};         // I, Q and U Stokes parameters
-  double pol_dir[3] = {0.};      // unit vector which defines the coordinate system against which Q and U are measured;
-                                 // should always be perpendicular to dir
-  double tdecay = -1.;           // Time at which pellet decays
-  enum packet_type escape_type;  // Flag to tell us in which form it escaped from the grid.
-  float escape_time = -1;        // time at which is passes out of the grid [s]
-  int number = -1;               // A unique number to identify the packet
-  bool originated_from_particlenotgamma;  // first-non-pellet packet type was gamma
+  int absorptiontype;                    // records linelistindex of the last absorption
+                                         // negative values give ff-abs (-1), bf-abs (-2), compton scattering of
+                                         // gammas (-3), photoelectric effect of gammas (-4), pair production of
+                                         // gammas (-5), decaying pellets of the 52Fe chain (-6) and pellets which
+                                         // decayed before the onset of the simulation (-7)
+                                         // decay of a positron pellet (-10)
   int pellet_decaytype = -1;              // index into decay::decaytypes
   int pellet_nucindex = -1;               // nuclide index of the decaying species
+  enum packet_type escape_type;           // Flag to tell us in which form it escaped from the grid.
+  float em_time = -1.;
+  float trueem_time = -1.;                // first thermal emission time [s]
+  float escape_time = -1;                 // time at which is passes out of the grid [s]
   float trueemissionvelocity = -1;
-  struct mastate mastate;
+  bool originated_from_particlenotgamma;  // first-non-pellet packet type was gamma
+  double em_pos[3];                       // Position of the last emission (x,y,z).
+  double absorptionfreq;                  // records nu_rf of packet at last absorption
+  double absorptiondir[3] = {0.};  // Direction of propagation (x,y,z) when a packet was last absorbed in a line. Always
+                                   // a unit vector.
+  double stokes[3] = {0.};         // I, Q and U Stokes parameters
+  double pol_dir[3] = {0.};  // unit vector which defines the coordinate system against which Q and U are measured;
+                             // should always be perpendicular to dir
+  uint64_t rngblockcounter = 0;  // position in the packet's random number stream (see rng_set_stream())
 
   inline auto operator==(const packet &rhs) -> bool {
     return (number == rhs.number && type == rhs.type &&
@@ -88,10 +99,11 @@ struct packet {
   }
 };
 
+static_assert(offsetof(struct packet, mastate) == 128, "hot part of struct packet should fill exactly two cache lines");
+
 void packet_init(struct packet *pkt);
 void write_packets(char filename[], const struct packet *pkt);
 void read_packets(const char filename[], struct packet *pkt);
 void read_temp_packetsfile(int timestep, int my_rank, struct packet *pkt);
-auto verify_temp_packetsfile(int timestep, int my_rank, const struct packet *pkt) -> bool;
 
 #endif  // PACKET_H
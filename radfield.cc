@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <cmath>
 #include <ctime>
+#include <vector>
 
 #include "atomic.h"
 #include "grid.h"
@@ -32,14 +33,13 @@ struct radfieldbin_solution {
   // enum_bin_fit_type fit_type;
 };
 
-struct radfieldbin {
-  double J_raw;  // value needs to be multipled by J_normfactor to get the true value
-  double nuJ_raw;
-  int contribcount;
-};
-
 static double radfieldbin_nu_upper[RADFIELDBINCOUNT];  // array of upper frequency boundaries of bins
-static struct radfieldbin *radfieldbins = nullptr;
+
+// bin estimators indexed by nonemptymgi * RADFIELDBINCOUNT + binindex
+// each is a flat array so that it can be reduced across ranks with a single MPI call
+static std::vector<double> radfieldbin_J_raw;  // value needs to be multipled by J_normfactor to get the true value
+static std::vector<double> radfieldbin_nuJ_raw;
+static std::vector<int> radfieldbin_contribcount;
 static struct radfieldbin_solution *radfieldbin_solutions = nullptr;
 
 #ifdef MPI_ON
@@ -62,13 +62,21 @@ static int detailed_linecount = 0;
 static int *detailed_lineindicies;
 
 static struct Jb_lu_estimator **prev_Jb_lu_normed = nullptr;  // value from the previous timestep
-static struct Jb_lu_estimator **Jb_lu_raw = nullptr;          // unnormalised estimator for the current timestep
+
+// unnormalised estimators for the current timestep indexed by nonemptymgi * detailed_linecount + jblueindex
+static std::vector<double> Jb_lu_raw_value;
+static std::vector<int> Jb_lu_raw_contribcount;
 
 // ** end detailed lines
 
 static float *prev_bfrate_normed = nullptr;  // values from the previous timestep
 static double *bfrate_raw = nullptr;         // unnormalised estimators for the current timestep
 
+#ifdef MPI_ON
+// outstanding non-blocking reductions started by start_reduce_estimators()
+static std::vector<MPI_Request> reduce_estimators_requests;
+#endif
+
 // expensive debugging mode to track the contributions to each bound-free rate estimator
 
 static std::vector<double> J;  // after normalisation: [ergs/s/sr/cm2/Hz]
@@ -173,10 +181,7 @@ static void realloc_detailed_lines(const int new_size) {
       prev_Jb_lu_normed[modelgridindex] = static_cast<struct Jb_lu_estimator *>(
           realloc(prev_Jb_lu_normed[modelgridindex], new_size * sizeof(struct Jb_lu_estimator)));
 
-      Jb_lu_raw[modelgridindex] = static_cast<struct Jb_lu_estimator *>(
-          realloc(Jb_lu_raw[modelgridindex], new_size * sizeof(struct Jb_lu_estimator)));
-
-      if (prev_Jb_lu_normed[modelgridindex] == nullptr || Jb_lu_raw[modelgridindex] == nullptr) {
+      if (prev_Jb_lu_normed[modelgridindex] == nullptr) {
         printout("ERROR: Not enough memory to reallocate detailed Jblue estimator list for cell %d.\n", modelgridindex);
         abort();
       }
@@ -197,10 +202,6 @@ static void add_detailed_line(const int lineindex)
     if (grid::get_numassociatedcells(modelgridindex) > 0) {
       prev_Jb_lu_normed[modelgridindex][detailed_linecount].value = 0;
       prev_Jb_lu_normed[modelgridindex][detailed_linecount].contribcount = 0;
-
-      // zero_estimators should do the next part anyway, but just to be sure:
-      Jb_lu_raw[modelgridindex][detailed_linecount].value = 0;
-      Jb_lu_raw[modelgridindex][detailed_linecount].contribcount = 0;
     }
   }
   detailed_lineindicies[detailed_linecount] = lineindex;
@@ -229,15 +230,12 @@ void init(int my_rank, int ndo_nonempty)
 
   prev_Jb_lu_normed =
       static_cast<struct Jb_lu_estimator **>(malloc((grid::get_npts_model() + 1) * sizeof(struct Jb_lu_estimator *)));
-  Jb_lu_raw =
-      static_cast<struct Jb_lu_estimator **>(malloc((grid::get_npts_model() + 1) * sizeof(struct Jb_lu_estimator *)));
 
   detailed_linecount = 0;
 
   detailed_lineindicies = nullptr;
   for (int modelgridindex = 0; modelgridindex < grid::get_npts_model(); modelgridindex++) {
     prev_Jb_lu_normed[modelgridindex] = nullptr;
-    Jb_lu_raw[modelgridindex] = nullptr;
   }
 
   if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
@@ -283,6 +281,10 @@ void init(int my_rank, int ndo_nonempty)
     std::sort(detailed_lineindicies, detailed_lineindicies + detailed_linecount);
   }
 
+  // the raw estimators are only allocated once the detailed line list is final
+  Jb_lu_raw_value.resize(static_cast<size_t>(nonempty_npts_model) * detailed_linecount);
+  Jb_lu_raw_contribcount.resize(static_cast<size_t>(nonempty_npts_model) * detailed_linecount);
+
   printout("There are %d lines with detailed Jblue_lu estimators.\n", detailed_linecount);
 
   printout("DETAILED_BF_ESTIMATORS %s", DETAILED_BF_ESTIMATORS_ON ? "ON" : "OFF");
@@ -310,9 +312,11 @@ void init(int my_rank, int ndo_nonempty)
 
     setup_bin_boundaries();
 
-    const size_t mem_usage_bins = nonempty_npts_model * RADFIELDBINCOUNT * sizeof(struct radfieldbin);
-    radfieldbins =
-        static_cast<struct radfieldbin *>(malloc(nonempty_npts_model * RADFIELDBINCOUNT * sizeof(struct radfieldbin)));
+    const size_t nbins_total = static_cast<size_t>(nonempty_npts_model) * RADFIELDBINCOUNT;
+    const size_t mem_usage_bins = nbins_total * (2 * sizeof(double) + sizeof(int));
+    radfieldbin_J_raw.resize(nbins_total);
+    radfieldbin_nuJ_raw.resize(nbins_total);
+    radfieldbin_contribcount.resize(nbins_total);
 
     const size_t mem_usage_bin_solutions = nonempty_npts_model * RADFIELDBINCOUNT * sizeof(struct radfieldbin_solution);
 
@@ -479,7 +483,7 @@ static auto get_bin_J(int modelgridindex, int binindex) -> double
   assert_testmodeonly(binindex >= 0);
   assert_testmodeonly(binindex < RADFIELDBINCOUNT);
   const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-  return radfieldbins[mgibinindex].J_raw * J_normfactor[nonemptymgi];
+  return radfieldbin_J_raw[mgibinindex] * J_normfactor[nonemptymgi];
 }
 
 static auto get_bin_nuJ(int modelgridindex, int binindex) -> double {
@@ -489,7 +493,7 @@ static auto get_bin_nuJ(int modelgridindex, int binindex) -> double {
   assert_testmodeonly(binindex >= 0);
   assert_testmodeonly(binindex < RADFIELDBINCOUNT);
   const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-  return radfieldbins[mgibinindex].nuJ_raw * J_normfactor[nonemptymgi];
+  return radfieldbin_nuJ_raw[mgibinindex] * J_normfactor[nonemptymgi];
 }
 
 static inline auto get_bin_nu_bar(int modelgridindex, int binindex) -> double
@@ -509,7 +513,7 @@ static inline auto get_bin_nu_lower(int binindex) -> double {
 
 static inline auto get_bin_contribcount(int modelgridindex, int binindex) -> int {
   const int mgibinindex = grid::get_modelcell_nonemptymgi(modelgridindex) * RADFIELDBINCOUNT + binindex;
-  return radfieldbins[mgibinindex].contribcount;
+  return radfieldbin_contribcount[mgibinindex];
 }
 
 static inline auto get_bin_W(int modelgridindex, int binindex) -> float {
@@ -582,7 +586,7 @@ void write_to_file(int modelgridindex, int timestep) {
       {
         const int jblueindex = -2 - binindex;  // -2 is the first detailed line, -3 is the second, etc
         const int lineindex = detailed_lineindicies[jblueindex];
-        const double nu_trans = globals::linelist[lineindex].nu;
+        const double nu_trans = globals::linelist_nu[lineindex];
         nu_lower = nu_trans;
         nu_upper = nu_trans;
         nuJ_out = -1.;
@@ -616,7 +620,6 @@ void close_file() {
   }
 
   if (MULTIBIN_RADFIELD_MODEL_ON) {
-    free(radfieldbins);
 #ifdef MPI_ON
     if (win_radfieldbin_solutions != MPI_WIN_NULL) {
       MPI_Win_free(&win_radfieldbin_solutions);
@@ -662,12 +665,8 @@ void zero_estimators(int modelgridindex)
   }
 
   if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
-    assert_always(Jb_lu_raw != nullptr);
-    assert_always(Jb_lu_raw[modelgridindex] != nullptr);
-    for (int i = 0; i < detailed_linecount; i++) {
-      Jb_lu_raw[modelgridindex][i].value = 0.;
-      Jb_lu_raw[modelgridindex][i].contribcount = 0.;
-    }
+    std::fill_n(Jb_lu_raw_value.begin() + nonemptymgi * detailed_linecount, detailed_linecount, 0.);
+    std::fill_n(Jb_lu_raw_contribcount.begin() + nonemptymgi * detailed_linecount, detailed_linecount, 0);
   }
 
   J[nonemptymgi] = 0.;  // this is required even if FORCE_LTE is on
@@ -676,13 +675,9 @@ void zero_estimators(int modelgridindex)
   if (MULTIBIN_RADFIELD_MODEL_ON) {
     // printout("radfield: zeroing estimators in %d bins in cell %d\n",RADFIELDBINCOUNT,modelgridindex);
 
-    assert_always(radfieldbins != nullptr);
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
-      const int mgibinindex = grid::get_modelcell_nonemptymgi(modelgridindex) * RADFIELDBINCOUNT + binindex;
-      radfieldbins[mgibinindex].J_raw = 0.0;
-      radfieldbins[mgibinindex].nuJ_raw = 0.0;
-      radfieldbins[mgibinindex].contribcount = 0;
-    }
+    std::fill_n(radfieldbin_J_raw.begin() + nonemptymgi * RADFIELDBINCOUNT, RADFIELDBINCOUNT, 0.);
+    std::fill_n(radfieldbin_nuJ_raw.begin() + nonemptymgi * RADFIELDBINCOUNT, RADFIELDBINCOUNT, 0.);
+    std::fill_n(radfieldbin_contribcount.begin() + nonemptymgi * RADFIELDBINCOUNT, RADFIELDBINCOUNT, 0);
   }
   set_J_normfactor(modelgridindex, -1.0);
 }
@@ -742,9 +737,9 @@ void update_estimators(const int nonemptymgi, const double distance_e_cmf, const
 
     if (binindex >= 0) {
       const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-      safeadd(radfieldbins[mgibinindex].J_raw, distance_e_cmf);
-      safeadd(radfieldbins[mgibinindex].nuJ_raw, distance_e_cmf * nu_cmf);
-      safeincrement(radfieldbins[mgibinindex].contribcount);
+      safeadd(radfieldbin_J_raw[mgibinindex], distance_e_cmf);
+      safeadd(radfieldbin_nuJ_raw[mgibinindex], distance_e_cmf * nu_cmf);
+      safeincrement(radfieldbin_contribcount[mgibinindex]);
     }
     // else
     // {
@@ -763,11 +758,12 @@ void update_lineestimator(const int modelgridindex, const int lineindex, const d
 
   const int jblueindex = get_Jblueindex(lineindex);
   if (jblueindex >= 0) {
-    Jb_lu_raw[modelgridindex][jblueindex].value += increment;
-    Jb_lu_raw[modelgridindex][jblueindex].contribcount += 1;
+    const int mgijblueindex = grid::get_modelcell_nonemptymgi(modelgridindex) * detailed_linecount + jblueindex;
+    safeadd(Jb_lu_raw_value[mgijblueindex], increment);
+    safeincrement(Jb_lu_raw_contribcount[mgijblueindex]);
     // const int lineindex = detailed_lineindicies[jblueindex];
     // printout(" increment cell %d lineindex %d Jb_lu_raw %g prev_Jb_lu_normed %g radfield(nu_trans) %g\n",
-    //       modelgridindex, lineindex, Jb_lu_raw[modelgridindex][jblueindex],
+    //       modelgridindex, lineindex, Jb_lu_raw_value[mgijblueindex],
     //       prev_Jb_lu_normed[modelgridindex][jblueindex].value, radfield(linelist[lineindex].nu, modelgridindex));
   }
 }
@@ -1161,8 +1157,9 @@ void normalise_J(const int modelgridindex, const double estimator_normfactor_ove
   assert_always(std::isfinite(J[nonemptymgi]));
   J[nonemptymgi] *= estimator_normfactor_over4pi;
   for (int i = 0; i < detailed_linecount; i++) {
-    prev_Jb_lu_normed[modelgridindex][i].value = Jb_lu_raw[modelgridindex][i].value * estimator_normfactor_over4pi;
-    prev_Jb_lu_normed[modelgridindex][i].contribcount = Jb_lu_raw[modelgridindex][i].contribcount;
+    const int mgijblueindex = nonemptymgi * detailed_linecount + i;
+    prev_Jb_lu_normed[modelgridindex][i].value = Jb_lu_raw_value[mgijblueindex] * estimator_normfactor_over4pi;
+    prev_Jb_lu_normed[modelgridindex][i].contribcount = Jb_lu_raw_contribcount[mgijblueindex];
   }
 }
 
@@ -1265,95 +1262,108 @@ void titer_nuJ(const int modelgridindex) {
 #endif
 
 #ifdef MPI_ON
-void reduce_estimators()
-// reduce and broadcast (allreduce) the estimators for J and nuJ in all bins
+void start_reduce_estimators()
+// begin summing the J, nuJ, bin, bound-free, and detailed line estimators over all ranks.
+// Each estimator is a contiguous array, so this is a handful of non-blocking MPI_Iallreduce calls that can progress
+// while the caller does other work. The estimators must not be read or written until finish_reduce_estimators().
 {
+  assert_always(reduce_estimators_requests.empty());
   const int nonempty_npts_model = grid::get_nonempty_npts_model();
 
-  MPI_Allreduce(MPI_IN_PLACE, J.data(), nonempty_npts_model, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, nuJ.data(), nonempty_npts_model, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+  MPI_Iallreduce(MPI_IN_PLACE, J.data(), nonempty_npts_model, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                 &reduce_estimators_requests.back());
+  reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+  MPI_Iallreduce(MPI_IN_PLACE, nuJ.data(), nonempty_npts_model, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                 &reduce_estimators_requests.back());
 
   if constexpr (DETAILED_BF_ESTIMATORS_ON) {
-    MPI_Allreduce(MPI_IN_PLACE, bfrate_raw, grid::get_nonempty_npts_model() * globals::BFGlobalVariable, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, bfrate_raw, nonempty_npts_model * globals::BFGlobalVariable, MPI_DOUBLE, MPI_SUM,
+                   MPI_COMM_WORLD, &reduce_estimators_requests.back());
   }
 
   if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
-    const time_t sys_time_start_reduction = time(nullptr);
-    printout("Reducing binned radiation field estimators");
-    assert_always(radfieldbins != nullptr);
-
-    for (int nonemptymgi = 0; nonemptymgi < nonempty_npts_model; nonemptymgi++) {
-      for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
-        const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-        MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].contribcount, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-      }
-    }
-    const int duration_reduction = time(nullptr) - sys_time_start_reduction;
-    printout(" (took %d s)\n", duration_reduction);
+    const int nbins_total = nonempty_npts_model * RADFIELDBINCOUNT;
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, radfieldbin_J_raw.data(), nbins_total, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                   &reduce_estimators_requests.back());
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, radfieldbin_nuJ_raw.data(), nbins_total, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                   &reduce_estimators_requests.back());
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, radfieldbin_contribcount.data(), nbins_total, MPI_INT, MPI_SUM, MPI_COMM_WORLD,
+                   &reduce_estimators_requests.back());
   }
 
   if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
-    const time_t sys_time_start_reduction = time(nullptr);
-    printout("Reducing detailed line estimators");
-
-    for (int modelgridindex = 0; modelgridindex < grid::get_npts_model(); modelgridindex++) {
-      if (grid::get_numassociatedcells(modelgridindex) > 0) {
-        for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
-          MPI_Allreduce(MPI_IN_PLACE, &Jb_lu_raw[modelgridindex][jblueindex].value, 1, MPI_DOUBLE, MPI_SUM,
-                        MPI_COMM_WORLD);
-          MPI_Allreduce(MPI_IN_PLACE, &Jb_lu_raw[modelgridindex][jblueindex].contribcount, 1, MPI_INT, MPI_SUM,
-                        MPI_COMM_WORLD);
-        }
-      }
-    }
-    const int duration_reduction = time(nullptr) - sys_time_start_reduction;
-    printout(" (took %d s)\n", duration_reduction);
+    const int njblue_total = nonempty_npts_model * detailed_linecount;
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, Jb_lu_raw_value.data(), njblue_total, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                   &reduce_estimators_requests.back());
+    reduce_estimators_requests.emplace_back(MPI_REQUEST_NULL);
+    MPI_Iallreduce(MPI_IN_PLACE, Jb_lu_raw_contribcount.data(), njblue_total, MPI_INT, MPI_SUM, MPI_COMM_WORLD,
+                   &reduce_estimators_requests.back());
   }
-  MPI_Barrier(MPI_COMM_WORLD);
 }
 
-void do_MPI_Bcast(const int modelgridindex, const int root, int root_node_id)
-// broadcast computed radfield results including parameters
-// from the cells belonging to root process to all processes
+void finish_reduce_estimators()
+// wait for the reductions started by start_reduce_estimators() to complete
 {
-  if (grid::get_numassociatedcells(modelgridindex) == 0) {
-    return;
-  }
+  const time_t sys_time_start_wait = time(nullptr);
+  printout("Waiting for radiation field estimator reductions");
+  MPI_Waitall(static_cast<int>(reduce_estimators_requests.size()), reduce_estimators_requests.data(),
+              MPI_STATUSES_IGNORE);
+  reduce_estimators_requests.clear();
+  printout(" (took %ld s)\n", static_cast<long>(time(nullptr) - sys_time_start_wait));
+}
 
+void mpi_pack_cell(std::vector<char> &buffer, const int modelgridindex)
+// append the computed radfield results including parameters of a cell to the grid exchange buffer
+{
   const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
-  MPI_Bcast(&J_normfactor[nonemptymgi], 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
+  mpi_pack_values(buffer, &J_normfactor[nonemptymgi], 1);
 
   if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
-      const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-      if (globals::rank_in_node == 0) {
-        MPI_Bcast(&radfieldbin_solutions[mgibinindex].W, 1, MPI_FLOAT, root_node_id, globals::mpi_comm_internode);
-        MPI_Bcast(&radfieldbin_solutions[mgibinindex].T_R, 1, MPI_FLOAT, root_node_id, globals::mpi_comm_internode);
-      }
-      MPI_Bcast(&radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-      MPI_Bcast(&radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-      MPI_Bcast(&radfieldbins[mgibinindex].contribcount, 1, MPI_INT, root, MPI_COMM_WORLD);
-    }
+    mpi_pack_values(buffer, &radfieldbin_solutions[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+    mpi_pack_values(buffer, &radfieldbin_J_raw[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+    mpi_pack_values(buffer, &radfieldbin_nuJ_raw[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+    mpi_pack_values(buffer, &radfieldbin_contribcount[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
   }
 
   if constexpr (DETAILED_BF_ESTIMATORS_ON) {
-    if (globals::rank_in_node == 0) {
-      MPI_Bcast(&prev_bfrate_normed[nonemptymgi * globals::nbfcontinua], globals::nbfcontinua, MPI_FLOAT, root_node_id,
-                globals::mpi_comm_internode);
-    }
+    mpi_pack_values(buffer, &prev_bfrate_normed[nonemptymgi * globals::nbfcontinua], globals::nbfcontinua);
   }
 
   if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
-    for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
-      MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].value, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-      MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].contribcount, 1, MPI_INT, root, MPI_COMM_WORLD);
-    }
+    mpi_pack_values(buffer, prev_Jb_lu_normed[modelgridindex], detailed_linecount);
+  }
+}
+
+void mpi_unpack_cell(const char *buffer, size_t &position, const int modelgridindex, const bool write_nodeshared)
+// read back a cell written by mpi_pack_cell(). The node-shared arrays are only written if write_nodeshared is true.
+{
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  mpi_unpack_values(buffer, position, &J_normfactor[nonemptymgi], 1);
+
+  if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
+    mpi_unpack_values(buffer, position,
+                      write_nodeshared ? &radfieldbin_solutions[nonemptymgi * RADFIELDBINCOUNT] : nullptr,
+                      RADFIELDBINCOUNT);
+    mpi_unpack_values(buffer, position, &radfieldbin_J_raw[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+    mpi_unpack_values(buffer, position, &radfieldbin_nuJ_raw[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+    mpi_unpack_values(buffer, position, &radfieldbin_contribcount[nonemptymgi * RADFIELDBINCOUNT], RADFIELDBINCOUNT);
+  }
+
+  if constexpr (DETAILED_BF_ESTIMATORS_ON) {
+    mpi_unpack_values(buffer, position,
+                      write_nodeshared ? &prev_bfrate_normed[nonemptymgi * globals::nbfcontinua] : nullptr,
+                      globals::nbfcontinua);
   }
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
+    mpi_unpack_values(buffer, position, prev_Jb_lu_normed[modelgridindex], detailed_linecount);
+  }
 }
 #endif
 
@@ -1403,17 +1413,16 @@ void write_restart_data(FILE *gridsave_file) {
       if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
         for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
           const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
-          fprintf(gridsave_file, "%la %la %a %a %d\n", radfieldbins[mgibinindex].J_raw,
-                  radfieldbins[mgibinindex].nuJ_raw, radfieldbin_solutions[mgibinindex].W,
-                  radfieldbin_solutions[mgibinindex].T_R, radfieldbins[mgibinindex].contribcount);
-          // radfieldbins[mgibinindex].fit_type
+          fprintf(gridsave_file, "%la %la %a %a %d\n", radfieldbin_J_raw[mgibinindex],
+                  radfieldbin_nuJ_raw[mgibinindex], radfieldbin_solutions[mgibinindex].W,
+                  radfieldbin_solutions[mgibinindex].T_R, radfieldbin_contribcount[mgibinindex]);
         }
       }
 
       if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
         for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
-          fprintf(gridsave_file, "%la %d\n", Jb_lu_raw[modelgridindex][jblueindex].value,
-                  Jb_lu_raw[modelgridindex][jblueindex].contribcount);
+          const int mgijblueindex = nonemptymgi * detailed_linecount + jblueindex;
+          fprintf(gridsave_file, "%la %d\n", Jb_lu_raw_value[mgijblueindex], Jb_lu_raw_contribcount[mgijblueindex]);
         }
       }
     }
@@ -1525,9 +1534,9 @@ void read_restart_data(FILE *gridsave_file) {
           const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
           float W = 0;
           float T_R = 0;
-          assert_always(fscanf(gridsave_file, "%la %la %a %a %d\n", &radfieldbins[mgibinindex].J_raw,
-                               &radfieldbins[mgibinindex].nuJ_raw, &W, &T_R,
-                               &radfieldbins[mgibinindex].contribcount) == 5);
+          assert_always(fscanf(gridsave_file, "%la %la %a %a %d\n", &radfieldbin_J_raw[mgibinindex],
+                               &radfieldbin_nuJ_raw[mgibinindex], &W, &T_R,
+                               &radfieldbin_contribcount[mgibinindex]) == 5);
 #ifdef MPI_ON
           if (globals::rank_in_node == 0)
 #endif
@@ -1540,8 +1549,9 @@ void read_restart_data(FILE *gridsave_file) {
 
       if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
         for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
-          assert_always(fscanf(gridsave_file, "%la %d\n", &Jb_lu_raw[modelgridindex][jblueindex].value,
-                               &Jb_lu_raw[modelgridindex][jblueindex].contribcount) == 2);
+          const int mgijblueindex = nonemptymgi * detailed_linecount + jblueindex;
+          assert_always(fscanf(gridsave_file, "%la %d\n", &Jb_lu_raw_value[mgijblueindex],
+                               &Jb_lu_raw_contribcount[mgijblueindex]) == 2);
         }
       }
     }
@@ -3,7 +3,9 @@
 
 #include <gsl/gsl_integration.h>
 
+#include <cstddef>
 #include <cstdio>
+#include <vector>
 
 #include "sn3d.h"
 
@@ -27,8 +29,10 @@ void normalise_nuJ(int modelgridindex, double estimator_normfactor_over4pi);
 [[nodiscard]] auto get_Jb_lu_contribcount(int modelgridindex, int jblueindex) -> int;
 void titer_J(int modelgridindex);
 void titer_nuJ(int modelgridindex);
-void reduce_estimators();
-void do_MPI_Bcast(int modelgridindex, int root, int root_node_id);
+void start_reduce_estimators();
+void finish_reduce_estimators();
+void mpi_pack_cell(std::vector<char> &buffer, int modelgridindex);
+void mpi_unpack_cell(const char *buffer, size_t &position, int modelgridindex, bool write_nodeshared);
 void write_restart_data(FILE *gridsave_file);
 void read_restart_data(FILE *gridsave_file);
 void normalise_bf_estimators(int modelgridindex, double estimator_normfactor_over_H);
@@ -1,9 +1,14 @@
 #include "rpkt.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <limits>
+#include <numeric>
 #include <span>
+#include <vector>
 
 #include "artisoptions.h"
 #include "atomic.h"
@@ -20,6 +25,64 @@
 
 constexpr int RPKT_EVENTTYPE_BB = 550;
 constexpr int RPKT_EVENTTYPE_CONT = 551;
+constexpr int RPKT_EVENTTYPE_PRUNEDLINES = 552;
+constexpr int RPKT_EVENTTYPE_EXPANSIONOPACITY = 553;
+
+// the line list is indexed by buckets of equal width in log(nu), so that finding the line list position of a
+// frequency is a bucket lookup plus a search over the lines within that bucket
+static std::vector<int> linebucket_firstline;  // [bucket + 1] is the first lineindex with get_linebucket(nu) <= bucket
+static double linebucket_lognu_min = 0.;
+static double linebucket_per_lognu = 0.;
+static int linebucket_count = 0;
+
+static auto get_linebucket(const double nu) -> int {
+  const int bucket = static_cast<int>((std::log(nu) - linebucket_lognu_min) * linebucket_per_lognu);
+  return std::clamp(bucket, 0, linebucket_count - 1);
+}
+
+void setup_linelist_buckets()
+// must be called after the sorted line list is in memory
+{
+  if (globals::nlines == 0) {
+    return;
+  }
+
+  linebucket_count = std::clamp(globals::nlines / 4, 1, 1 << 18);
+  linebucket_lognu_min = std::log(globals::linelist_nu[globals::nlines - 1]);
+  const double lognu_max = std::log(globals::linelist_nu[0]);
+  linebucket_per_lognu = (lognu_max > linebucket_lognu_min)
+                             ? linebucket_count / (lognu_max - linebucket_lognu_min)
+                             : 0.;
+
+  // lines are sorted by descending frequency, so the bucket number never increases along the list
+  linebucket_firstline.resize(linebucket_count + 1);
+  linebucket_firstline[0] = globals::nlines;
+  for (int bucket = 0; bucket < linebucket_count; bucket++) {
+    const auto *firstline =
+        std::partition_point(globals::linelist_nu, globals::linelist_nu + globals::nlines,
+                             [bucket](const double nu_line) -> bool { return get_linebucket(nu_line) > bucket; });
+    linebucket_firstline[bucket + 1] = static_cast<int>(std::distance(globals::linelist_nu, firstline));
+  }
+
+  printout("[info] line list position lookup uses %d log(nu) buckets (%.1f lines per bucket on average)\n",
+           linebucket_count, static_cast<double>(globals::nlines) / linebucket_count);
+}
+
+static auto get_linelist_position(const double nu_cmf, const int searchstart) -> int
+// find the lowest lineindex >= searchstart with nu_line <= nu_cmf, or nlines if there is none
+{
+  const int bucket = get_linebucket(nu_cmf);
+
+  // lines before the bucket's first line are bluer than nu_cmf and lines from the next bucket down are redder
+  const int lower = std::max(linebucket_firstline[bucket + 1], searchstart);
+  const int upper = std::max(linebucket_firstline[bucket], lower);
+
+  // lower_bound matches the first element where the comparison function is false
+  const auto *matchline =
+      std::lower_bound(globals::linelist_nu + lower, globals::linelist_nu + upper, nu_cmf,
+                       [](const double nu_line, const double nu_cmf) -> bool { return nu_line > nu_cmf; });
+  return static_cast<int>(std::distance(globals::linelist_nu, matchline));
+}
 
 auto closest_transition(const double nu_cmf, const int next_trans) -> int
 /// for the propagation through non empty cells
@@ -32,21 +95,20 @@ auto closest_transition(const double nu_cmf, const int next_trans) -> int
   }
   /// if nu_cmf is smaller than the lowest frequency in the linelist,
   /// no line interaction is possible: return negative value as a flag
-  if (nu_cmf < globals::linelist[globals::nlines - 1].nu) {
+  if (nu_cmf < globals::linelist_nu[globals::nlines - 1]) {
     return -1;
   }
 
   if (next_trans > 0) {
     /// if left = pkt_ptr->next_trans > 0 we know the next line we should interact with, independent of the packets
-    /// current nu_cmf which might be smaller than globals::linelist[left].nu due to propagation errors
+    /// current nu_cmf which might be smaller than globals::linelist_nu[left] due to propagation errors
     return next_trans;
   }
   // will find the highest frequency (lowest index) line with nu_line <= nu_cmf
-  // lower_bound matches the first element where the comparison function is false
-  const auto *matchline =
-      std::lower_bound(&globals::linelist[next_trans], &globals::linelist[globals::nlines], nu_cmf,
-                       [](const auto &line, const double nu_cmf) -> bool { return line.nu > nu_cmf; });
-  const int matchindex = std::distance(globals::linelist, matchline);
+  // a negative next_trans holds the line list position from before a region where lines were skipped (see
+  // get_next_trans_skiplines), which is a lower bound because the packet only moves redwards through the list
+  const int searchstart = (next_trans < 0) ? (-1 - next_trans) : 0;
+  const int matchindex = get_linelist_position(nu_cmf, searchstart);
   if (matchindex >= globals::nlines) {
     return -1;
   }
@@ -54,6 +116,401 @@ auto closest_transition(const double nu_cmf, const int next_trans) -> int
   return matchindex;
 }
 
+static void update_tau_line_block(const int modelgridindex, const int lineindex)
+// make sure that the cached Sobolev optical depth divided by time is valid for the block of lines containing
+// lineindex. The cache may be shared with other threads and ranks on the node, so the block is claimed by setting
+// its stamp negative while it is being filled.
+{
+  const auto &chist = globals::cellhistory[tid];
+  assert_testmodeonly(chist.cellnumber == modelgridindex);
+  const int block = lineindex / LINE_TAUBLOCKSIZE;
+  std::atomic_ref<int> blockstamp(chist.tau_line_blockstamp[block]);
+  int stampvalue = blockstamp.load(std::memory_order_acquire);
+  while (stampvalue != chist.tau_line_stamp) {
+    if (stampvalue != -chist.tau_line_stamp &&
+        blockstamp.compare_exchange_weak(stampvalue, -chist.tau_line_stamp, std::memory_order_acquire)) {
+      const int blockstart = block * LINE_TAUBLOCKSIZE;
+      const int blockend = std::min(blockstart + LINE_TAUBLOCKSIZE, globals::nlines);
+      for (int i = blockstart; i < blockend; i++) {
+        const auto &line = globals::linelist[i];
+        const int element = line.elementindex;
+        const int ion = line.ionindex;
+
+        const double n_u = get_levelpop(modelgridindex, element, ion, line.upperlevelindex);
+        const double n_l = get_levelpop(modelgridindex, element, ion, line.lowerlevelindex);
+
+        chist.tau_line_over_t[i] =
+            std::max(0., (globals::linelist_B_lu[i] * n_l - globals::linelist_B_ul[i] * n_u) * HCLIGHTOVERFOURPI);
+      }
+      blockstamp.store(chist.tau_line_stamp, std::memory_order_release);
+      return;
+    }
+    // another thread or rank is filling this block
+    stampvalue = blockstamp.load(std::memory_order_acquire);
+  }
+}
+
+static void update_lineestimator_atline(const int modelgridindex, const struct packet *const pkt_ptr,
+                                        const int lineindex, const double ldist) {
+  if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
+    struct packet dummypkt = *pkt_ptr;
+    move_pkt_withtime(&dummypkt, ldist);
+    radfield::update_lineestimator(modelgridindex, lineindex,
+                                   dummypkt.prop_time * CLIGHT * dummypkt.e_cmf / dummypkt.nu_cmf);
+  }
+}
+
+// With ACTIVE_LINES_ON, each cell keeps a list of the lines with a Sobolev optical depth above
+// ACTIVE_LINES_MIN_TAU_SOBOLEV, which is rebuilt by the rank updating the cell. The lists of all cells are kept one
+// after another in node-shared memory and the other nodes receive them with the grid properties. The other lines are
+// optically thin, so their optical depths simply add up along the path and are folded into a pseudo-continuum in bins
+// of equal width in log(nu).
+constexpr int PRUNEDLINES_NBINS = 256;
+
+// lists of the cells updated by this rank, until finish_cell_activelines_update() copies them into node-shared memory
+struct cell_activelines {
+  std::vector<int> lineindex;      // in line list order (descending frequency)
+  std::vector<double> tau_over_t;  // Sobolev optical depth divided by time
+};
+
+static std::vector<struct cell_activelines> rank_activelines;  // indexed by nonemptymgi
+
+// node shared
+static size_t *activelines_start = nullptr;  // [nonemptymgi] is the position of the cell's list in the arrays below
+static int *activelines_lineindex = nullptr;
+static double *activelines_tau_over_t = nullptr;
+static size_t activelines_capacity = 0;
+static double *chi_prunedlines = nullptr;  // [nonemptymgi * PRUNEDLINES_NBINS + bin] [cm^-1] in the comoving frame
+#ifdef MPI_ON
+static MPI_Win win_activelines_lineindex = MPI_WIN_NULL;
+static MPI_Win win_activelines_tau_over_t = MPI_WIN_NULL;
+#endif
+
+static double prunedlines_lognu_min = 0.;
+static double prunedlines_per_lognu = 0.;
+
+#ifdef MPI_ON
+template <typename T>
+static auto alloc_activelines_nodeshared(const size_t count, MPI_Win *win) -> T *
+// all of the values are held by rank_in_node 0. Must be called by every rank on the node
+{
+  T *ptr = nullptr;
+  MPI_Aint size = (globals::rank_in_node == 0) ? static_cast<MPI_Aint>(count * sizeof(T)) : 0;
+  int disp_unit = sizeof(T);
+  assert_always(MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &ptr, win) ==
+                MPI_SUCCESS);
+  assert_always(MPI_Win_shared_query(*win, 0, &size, &disp_unit, &ptr) == MPI_SUCCESS);
+  assert_always(ptr != nullptr);
+  return ptr;
+}
+#endif
+
+void init_activelines()
+// should be called after the line list and model grid are set up
+{
+  if constexpr (!ACTIVE_LINES_ON) {
+    return;
+  }
+
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  rank_activelines.resize(npts_nonempty);
+#ifdef MPI_ON
+  MPI_Win win_activelines_start = MPI_WIN_NULL;
+  MPI_Win win_chi_prunedlines = MPI_WIN_NULL;
+  activelines_start = alloc_activelines_nodeshared<size_t>(npts_nonempty + 1, &win_activelines_start);
+  chi_prunedlines = alloc_activelines_nodeshared<double>(npts_nonempty * PRUNEDLINES_NBINS, &win_chi_prunedlines);
+#else
+  activelines_start = static_cast<size_t *>(malloc((npts_nonempty + 1) * sizeof(size_t)));
+  chi_prunedlines = static_cast<double *>(malloc(npts_nonempty * PRUNEDLINES_NBINS * sizeof(double)));
+  assert_always(activelines_start != nullptr && chi_prunedlines != nullptr);
+#endif
+  if (globals::rank_in_node == 0) {
+    std::fill_n(activelines_start, npts_nonempty + 1, 0);
+    std::fill_n(chi_prunedlines, npts_nonempty * PRUNEDLINES_NBINS, 0.);
+  }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+
+  if (globals::nlines > 0) {
+    prunedlines_lognu_min = std::log(globals::linelist_nu[globals::nlines - 1]);
+    const double lognu_max = std::log(globals::linelist_nu[0]);
+    prunedlines_per_lognu =
+        (lognu_max > prunedlines_lognu_min) ? PRUNEDLINES_NBINS / (lognu_max - prunedlines_lognu_min) : 0.;
+  }
+
+  printout("[info] active lines: lines with tau_sobolev < %g go into a pseudo-continuum with %d bins\n",
+           ACTIVE_LINES_MIN_TAU_SOBOLEV, PRUNEDLINES_NBINS);
+  printout("[info] mem_usage: pruned line pseudo-continuum occupies %.3f MB (node shared memory)\n",
+           npts_nonempty * PRUNEDLINES_NBINS * sizeof(double) / 1024. / 1024.);
+}
+
+static auto get_prunedlines_bin(const double nu) -> int {
+  const int bin = static_cast<int>((std::log(nu) - prunedlines_lognu_min) * prunedlines_per_lognu);
+  return std::clamp(bin, 0, PRUNEDLINES_NBINS - 1);
+}
+
+static auto get_chi_prunedlines(const int modelgridindex, const double nu_cmf) -> double
+// pseudo-continuum opacity of the pruned lines in the comoving frame
+{
+  if (globals::nlines == 0 || nu_cmf < globals::linelist_nu[globals::nlines - 1] ||
+      nu_cmf > globals::linelist_nu[0]) {
+    return 0.;
+  }
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  return chi_prunedlines[nonemptymgi * PRUNEDLINES_NBINS + get_prunedlines_bin(nu_cmf)];
+}
+
+static auto calculate_cell_levelpops_for_lines(const int modelgridindex) -> std::vector<double>
+// populations of all levels of the elements present in a cell, indexed by uniquelevelindex, for computing the line
+// optical depths of the cell in update_grid
+{
+  int nlevels_total = 0;
+  for (int element = 0; element < get_nelements(); element++) {
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      nlevels_total += get_nlevels(element, ion);
+    }
+  }
+
+  std::vector<double> levelpops(nlevels_total, 0.);
+  for (int element = 0; element < get_nelements(); element++) {
+    if (grid::get_elem_abundance(modelgridindex, element) <= 0.) {
+      continue;
+    }
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      for (int level = 0; level < get_nlevels(element, ion); level++) {
+        levelpops[globals::elements[element].ions[ion].levels[level].uniquelevelindex] =
+            calculate_levelpop(modelgridindex, element, ion, level);
+      }
+    }
+  }
+  return levelpops;
+}
+
+static auto get_line_tau_over_t(const int lineindex, const std::vector<double> &levelpops) -> double
+// Sobolev optical depth divided by time from the populations given by calculate_cell_levelpops_for_lines()
+{
+  const auto &line = globals::linelist[lineindex];
+  const auto &ionlevels = globals::elements[line.elementindex].ions[line.ionindex].levels;
+  const double n_u = levelpops[ionlevels[line.upperlevelindex].uniquelevelindex];
+  const double n_l = levelpops[ionlevels[line.lowerlevelindex].uniquelevelindex];
+  return std::max(
+      0., (globals::linelist_B_lu[lineindex] * n_l - globals::linelist_B_ul[lineindex] * n_u) * HCLIGHTOVERFOURPI);
+}
+
+void update_cell_activelines(const int modelgridindex, const double t_mid)
+// select the lines of a cell with a Sobolev optical depth of at least ACTIVE_LINES_MIN_TAU_SOBOLEV at t_mid. Lines with
+// detailed estimators are always kept.
+{
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  auto &activelines = rank_activelines[nonemptymgi];
+  activelines.lineindex.clear();
+  activelines.tau_over_t.clear();
+  double *chi_prunedlines_cell = &chi_prunedlines[nonemptymgi * PRUNEDLINES_NBINS];
+  std::fill_n(chi_prunedlines_cell, PRUNEDLINES_NBINS, 0.);
+
+  if (grid::modelgrid[modelgridindex].thick == 1) {
+    // grey cells have no line opacity
+    return;
+  }
+
+  const auto levelpops = calculate_cell_levelpops_for_lines(modelgridindex);
+
+  // a line of tau << 1 over a bin of width dlog(nu) adds t * tau_over_t to the optical depth over a path of
+  // c * t * dlog(nu)
+  const double prunedlines_chi_per_tau_over_t = prunedlines_per_lognu / CLIGHT;
+
+  for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
+    if (grid::get_elem_abundance(modelgridindex, globals::linelist[lineindex].elementindex) <= 0.) {
+      continue;
+    }
+    const double tau_over_t = get_line_tau_over_t(lineindex, levelpops);
+
+    if (tau_over_t * t_mid >= ACTIVE_LINES_MIN_TAU_SOBOLEV || radfield::get_Jblueindex(lineindex) >= 0) {
+      activelines.lineindex.push_back(lineindex);
+      activelines.tau_over_t.push_back(tau_over_t);
+    } else {
+      chi_prunedlines_cell[get_prunedlines_bin(globals::linelist_nu[lineindex])] +=
+          tau_over_t * prunedlines_chi_per_tau_over_t;
+    }
+  }
+
+  printout("update_cell_activelines: cell %d keeps %zu of %d lines with tau_sobolev >= %g\n", modelgridindex,
+           activelines.lineindex.size(), globals::nlines, ACTIVE_LINES_MIN_TAU_SOBOLEV);
+}
+
+static void reserve_activelines_nodeshared(const size_t nactive_total)
+// make room in node-shared memory for the lists of all cells. Must be called by every rank on the node
+{
+  if (activelines_lineindex != nullptr && nactive_total <= activelines_capacity) {
+    return;
+  }
+  // leave room for the lists to grow, so that they are not reallocated at every grid update
+  activelines_capacity = std::max(nactive_total + nactive_total / 4, static_cast<size_t>(1));
+#ifdef MPI_ON
+  if (win_activelines_lineindex != MPI_WIN_NULL) {
+    MPI_Win_free(&win_activelines_lineindex);
+    MPI_Win_free(&win_activelines_tau_over_t);
+  }
+  activelines_lineindex = alloc_activelines_nodeshared<int>(activelines_capacity, &win_activelines_lineindex);
+  activelines_tau_over_t = alloc_activelines_nodeshared<double>(activelines_capacity, &win_activelines_tau_over_t);
+#else
+  free(activelines_lineindex);
+  free(activelines_tau_over_t);
+  activelines_lineindex = static_cast<int *>(malloc(activelines_capacity * sizeof(int)));
+  activelines_tau_over_t = static_cast<double *>(malloc(activelines_capacity * sizeof(double)));
+  assert_always(activelines_lineindex != nullptr && activelines_tau_over_t != nullptr);
+#endif
+  printout("[info] mem_usage: active line lists occupy %.3f MB (node shared memory)\n",
+           activelines_capacity * (sizeof(int) + sizeof(double)) / 1024. / 1024.);
+}
+
+void finish_cell_activelines_update()
+// after update_grid has rebuilt the lists of this rank's cells, lay out the lists of all cells in node-shared memory
+// and copy this rank's lists into it. Must be called by every rank
+{
+  if constexpr (!ACTIVE_LINES_ON) {
+    return;
+  }
+
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  // the other ranks' cells have empty lists here, so the sum over ranks gives the length of every list
+  std::vector<uint64_t> nactive(npts_nonempty);
+  for (size_t nonemptymgi = 0; nonemptymgi < npts_nonempty; nonemptymgi++) {
+    nactive[nonemptymgi] = rank_activelines[nonemptymgi].lineindex.size();
+  }
+#ifdef MPI_ON
+  MPI_Allreduce(MPI_IN_PLACE, nactive.data(), static_cast<int>(npts_nonempty), MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+  std::vector<size_t> start(npts_nonempty + 1, 0);
+  std::partial_sum(nactive.begin(), nactive.end(), start.begin() + 1);
+  reserve_activelines_nodeshared(start[npts_nonempty]);
+  if (globals::rank_in_node == 0) {
+    std::ranges::copy(start, activelines_start);
+  }
+
+  for (size_t nonemptymgi = 0; nonemptymgi < npts_nonempty; nonemptymgi++) {
+    auto &activelines = rank_activelines[nonemptymgi];
+    if (!activelines.lineindex.empty()) {
+      std::ranges::copy(activelines.lineindex, &activelines_lineindex[start[nonemptymgi]]);
+      std::ranges::copy(activelines.tau_over_t, &activelines_tau_over_t[start[nonemptymgi]]);
+      activelines = {};
+    }
+  }
+
+  // the lists must be in place before any rank on the node packs or uses them
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+}
+
+void mpi_pack_cell_activelines(std::vector<char> &buffer, const int modelgridindex)
+// append the active lines of a cell to the grid exchange buffer
+{
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  // every rank knows the lengths of the lists from finish_cell_activelines_update()
+  const size_t liststart = activelines_start[nonemptymgi];
+  const size_t nactive = activelines_start[nonemptymgi + 1] - liststart;
+  mpi_pack_values(buffer, &activelines_lineindex[liststart], nactive);
+  mpi_pack_values(buffer, &activelines_tau_over_t[liststart], nactive);
+  mpi_pack_values(buffer, &chi_prunedlines[nonemptymgi * PRUNEDLINES_NBINS], PRUNEDLINES_NBINS);
+}
+
+void mpi_unpack_cell_activelines(const char *buffer, size_t &position, const int modelgridindex,
+                                 const bool write_nodeshared)
+// read back a cell written by mpi_pack_cell_activelines()
+{
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  const size_t liststart = activelines_start[nonemptymgi];
+  const size_t nactive = activelines_start[nonemptymgi + 1] - liststart;
+  mpi_unpack_values(buffer, position, write_nodeshared ? &activelines_lineindex[liststart] : nullptr, nactive);
+  mpi_unpack_values(buffer, position, write_nodeshared ? &activelines_tau_over_t[liststart] : nullptr, nactive);
+  mpi_unpack_values(buffer, position, write_nodeshared ? &chi_prunedlines[nonemptymgi * PRUNEDLINES_NBINS] : nullptr,
+                    PRUNEDLINES_NBINS);
+}
+
+// With EXPANSION_OPACITIES_ON, r-packets do not follow the lines one by one. Instead, each cell has the expansion
+// opacity (Eastman & Pinto 1993) of the lines in EXPANSION_OPACITIES_NBINS bins of equal width in log(nu):
+// chi = sum(1 - exp(-tau_sobolev)) / (c * t * dlog(nu)), which is computed in update_grid at the middle of the timestep
+// and sent to the other ranks with the grid properties
+static_assert(!(EXPANSION_OPACITIES_ON && ACTIVE_LINES_ON),
+              "EXPANSION_OPACITIES_ON replaces the line list traversal of ACTIVE_LINES_ON");
+static std::vector<double> cell_expansionopacity;  // [nonemptymgi * EXPANSION_OPACITIES_NBINS + bin] [cm^-1]
+static double expansionopacity_lognu_min = 0.;
+static double expansionopacity_per_lognu = 0.;
+
+void init_expansionopacities()
+// should be called after the line list and model grid are set up
+{
+  if constexpr (!EXPANSION_OPACITIES_ON) {
+    return;
+  }
+
+  cell_expansionopacity.resize(static_cast<size_t>(grid::get_nonempty_npts_model()) * EXPANSION_OPACITIES_NBINS, 0.);
+
+  if (globals::nlines > 0) {
+    expansionopacity_lognu_min = std::log(globals::linelist_nu[globals::nlines - 1]);
+    const double lognu_max = std::log(globals::linelist_nu[0]);
+    expansionopacity_per_lognu = (lognu_max > expansionopacity_lognu_min)
+                                     ? EXPANSION_OPACITIES_NBINS / (lognu_max - expansionopacity_lognu_min)
+                                     : 0.;
+  }
+
+  printout("[info] mem_usage: expansion opacities with %d bins (dlog(nu) %g) occupy %.3f MB\n",
+           EXPANSION_OPACITIES_NBINS, (expansionopacity_per_lognu > 0.) ? 1. / expansionopacity_per_lognu : 0.,
+           cell_expansionopacity.size() * sizeof(double) / 1024. / 1024.);
+}
+
+static auto get_expansionopacity_bin(const double nu) -> int
+// bin number, which is negative below the line list and EXPANSION_OPACITIES_NBINS or more above it
+{
+  const double x = (std::log(nu) - expansionopacity_lognu_min) * expansionopacity_per_lognu;
+  return static_cast<int>(std::floor(std::clamp(x, -1., static_cast<double>(EXPANSION_OPACITIES_NBINS))));
+}
+
+static auto get_expansionopacity_bin_nu_lower(const int bin) -> double {
+  return std::exp(expansionopacity_lognu_min + bin / expansionopacity_per_lognu);
+}
+
+void update_cell_expansionopacities(const int modelgridindex, const double t_mid) {
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  double *chi_expansion = &cell_expansionopacity[static_cast<size_t>(nonemptymgi) * EXPANSION_OPACITIES_NBINS];
+  std::fill_n(chi_expansion, EXPANSION_OPACITIES_NBINS, 0.);
+
+  if (grid::modelgrid[modelgridindex].thick == 1 || expansionopacity_per_lognu <= 0.) {
+    return;
+  }
+
+  const auto levelpops = calculate_cell_levelpops_for_lines(modelgridindex);
+  for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
+    if (grid::get_elem_abundance(modelgridindex, globals::linelist[lineindex].elementindex) <= 0.) {
+      continue;
+    }
+    const double tau_sobolev = get_line_tau_over_t(lineindex, levelpops) * t_mid;
+    const int bin = std::min(get_expansionopacity_bin(globals::linelist_nu[lineindex]), EXPANSION_OPACITIES_NBINS - 1);
+    chi_expansion[bin] -= std::expm1(-tau_sobolev);
+  }
+
+  const double dlognu = 1. / expansionopacity_per_lognu;
+  for (int bin = 0; bin < EXPANSION_OPACITIES_NBINS; bin++) {
+    chi_expansion[bin] /= CLIGHT * t_mid * dlognu;
+  }
+}
+
+void mpi_pack_cell_expansionopacities(std::vector<char> &buffer, const int modelgridindex) {
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  mpi_pack_values(buffer, &cell_expansionopacity[static_cast<size_t>(nonemptymgi) * EXPANSION_OPACITIES_NBINS],
+                  EXPANSION_OPACITIES_NBINS);
+}
+
+void mpi_unpack_cell_expansionopacities(const char *buffer, size_t &position, const int modelgridindex) {
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  mpi_unpack_values(buffer, position,
+                    &cell_expansionopacity[static_cast<size_t>(nonemptymgi) * EXPANSION_OPACITIES_NBINS],
+                    EXPANSION_OPACITIES_NBINS);
+}
+
 static auto get_event(const int modelgridindex,
                       struct packet *pkt_ptr,  // pointer to packet object
                       int *rpkt_eventtype,
@@ -76,140 +533,226 @@ static auto get_event(const int modelgridindex,
   // the frequency change from start to abort (cell boundary/timestep end)
   const double d_nu_on_d_l = (nu_cmf_abort - pkt_ptr->nu_cmf) / abort_dist;
 
-  struct packet dummypkt = *pkt_ptr;
-
   calculate_chi_rpkt_cont(pkt_ptr->nu_cmf, &globals::chi_rpkt_cont[tid], modelgridindex, true);
-  const double chi_cont =
-      globals::chi_rpkt_cont[tid].total * doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
-  double tau = 0.;   // optical depth along path
-  double dist = 0.;  // position on path
-  while (true) {
-    /// calculate distance to next line encounter ldist
-    /// first select the closest transition in frequency
-    /// we need its frequency nu_trans, the element/ion and the corresponding levels
-    /// create therefore new variables in packet, which contain next_lowerlevel, ...
-    const int lineindex = closest_transition(dummypkt.nu_cmf,
-                                             dummypkt.next_trans);  /// returns negative value if nu_cmf > nu_trans
-    if (lineindex >= 0) {
-      /// line interaction is possible (nu_cmf > nu_trans)
+  const double dopplerfactor = doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  const double chi_prunedlines =
+      ACTIVE_LINES_ON ? get_chi_prunedlines(modelgridindex, pkt_ptr->nu_cmf) * dopplerfactor : 0.;
+  const double chi_cont = globals::chi_rpkt_cont[tid].total * dopplerfactor + chi_prunedlines;
+
+  // the distance to each line and the time at which it is reached are measured from the packet starting point, so
+  // the optical depth up to any line is chi_cont * ldist plus the sum of the line optical depths passed before it
+  const double nu_cmf_start = pkt_ptr->nu_cmf;
+  const double prop_time_start = pkt_ptr->prop_time;
+  double tau_lines = 0.;  // sum of line optical depths passed so far
+
+  const auto get_continuum_eventtype = [&]() -> int {
+    if (chi_prunedlines > 0. && rng_uniform() * chi_cont < chi_prunedlines) {
+      return RPKT_EVENTTYPE_PRUNEDLINES;
+    }
+    return RPKT_EVENTTYPE_CONT;
+  };
 
-      const double nu_trans = globals::linelist[lineindex].nu;
+  // returns the distance to an event before or at the line, or -1 if the packet passes the line.
+  // next_trans_unreached is stored if the packet stops before reaching the line
+  const auto get_event_atline = [&](const int lineindex, const double tau_line_over_t,
+                                    const int next_trans_unreached) -> double {
+    const double nu_trans = globals::linelist_nu[lineindex];
+    const double ldist = get_linedistance(prop_time_start, nu_cmf_start, nu_trans, d_nu_on_d_l);
+    const double tau_cont = chi_cont * ldist;
 
-      // helper variable to overcome numerical problems after line scattering
-      // further scattering events should be located at lower frequencies to prevent
-      // multiple scattering events of one packet in a single line
-      dummypkt.next_trans = lineindex + 1;
+    if (tau_rnd - tau_lines <= tau_cont) {
+      /// continuum process occurs before reaching the line
 
-      const double ldist = get_linedistance(dummypkt.prop_time, dummypkt.nu_cmf, nu_trans, d_nu_on_d_l);
+      *rpkt_eventtype = get_continuum_eventtype();
 
-      const double tau_cont = chi_cont * ldist;
+      pkt_ptr->next_trans = next_trans_unreached;
 
-      if (tau_rnd - tau > tau_cont) {
-        // got past the continuum optical depth so propagate to the line, and check interaction
+      return (tau_rnd - tau_lines) / chi_cont;
+    }
 
-        if (nu_trans < nu_cmf_abort) {
-          // back up one line, because we didn't reach it before the boundary/timelimit
-          pkt_ptr->next_trans = dummypkt.next_trans - 1;
+    // got past the continuum optical depth so propagate to the line, and check interaction
 
-          return std::numeric_limits<double>::max();
-        }
+    if (nu_trans < nu_cmf_abort) {
+      // the line is not reached before the boundary/timelimit
+      pkt_ptr->next_trans = next_trans_unreached;
 
-        const int element = globals::linelist[lineindex].elementindex;
-        const int ion = globals::linelist[lineindex].ionindex;
-        const int upper = globals::linelist[lineindex].upperlevelindex;
-        const int lower = globals::linelist[lineindex].lowerlevelindex;
-        const double A_ul = einstein_spontaneous_emission(lineindex);
-        const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nu_trans, 3) * A_ul;
-        const double B_lu = stat_weight(element, ion, upper) / stat_weight(element, ion, lower) * B_ul;
-
-        const double n_u = get_levelpop(modelgridindex, element, ion, upper);
-        const double n_l = get_levelpop(modelgridindex, element, ion, lower);
-
-        const double tau_line = std::max(0., (B_lu * n_l - B_ul * n_u) * HCLIGHTOVERFOURPI * dummypkt.prop_time);
-
-        // printout("[debug] get_event:     tau_line %g\n", tau_line);
-        // printout("[debug] get_event:       tau_rnd - tau > tau_cont\n");
-
-        if (tau_rnd - tau > tau_cont + tau_line) {
-          // total optical depth still below tau_rnd: propagate to the line and continue
-
-          // printout(
-          //     "[debug] get_event: tau_rnd - tau > tau_cont + tau_line ... proceed this packets "
-          //     "propagation\n");
-
-          dist += ldist;
-          tau += tau_cont + tau_line;
-
-          if constexpr (!USE_RELATIVISTIC_DOPPLER_SHIFT) {
-            move_pkt_withtime(&dummypkt, ldist);
-          } else {
-            // avoid move_pkt_withtime() to skip the standard Doppler shift calculation
-            // and use the linear approx instead
-            dummypkt.pos[0] += (dummypkt.dir[0] * ldist);
-            dummypkt.pos[1] += (dummypkt.dir[1] * ldist);
-            dummypkt.pos[2] += (dummypkt.dir[2] * ldist);
-            dummypkt.prop_time += ldist / CLIGHT_PROP;
-            dummypkt.nu_cmf = pkt_ptr->nu_cmf + d_nu_on_d_l * dist;  // should equal nu_trans;
-            assert_testmodeonly(dummypkt.nu_cmf <= pkt_ptr->nu_cmf);
-          }
+      return std::numeric_limits<double>::max();
+    }
 
-          radfield::update_lineestimator(modelgridindex, lineindex,
-                                         dummypkt.prop_time * CLIGHT * dummypkt.e_cmf / dummypkt.nu_cmf);
+    const double tau_line = tau_line_over_t * (prop_time_start + ldist / CLIGHT_PROP);
 
-        } else {
-          /// bound-bound process occurs
-          // printout("[debug] get_event: tau_rnd - tau <= tau_cont + tau_line: bb-process occurs\n");
+    if (tau_rnd - tau_lines > tau_cont + tau_line) {
+      // total optical depth still below tau_rnd: propagate to the line and continue
+      tau_lines += tau_line;
 
-          pkt_ptr->mastate.element = element;
-          pkt_ptr->mastate.ion = ion;
-          pkt_ptr->mastate.level = upper;  /// if the MA will be activated it must be in the transitions upper level
-          pkt_ptr->mastate.activatingline = lineindex;
+      update_lineestimator_atline(modelgridindex, pkt_ptr, lineindex, ldist);
 
-          if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
-            move_pkt_withtime(&dummypkt, ldist);
-            radfield::update_lineestimator(modelgridindex, lineindex,
-                                           dummypkt.prop_time * CLIGHT * dummypkt.e_cmf / dummypkt.nu_cmf);
-          }
+      return -1.;
+    }
 
-          *rpkt_eventtype = RPKT_EVENTTYPE_BB;
-          /// the line and its parameters were already selected by closest_transition!
-          // printout("[debug] get_event:         edist %g, abort_dist %g, edist-abort_dist %g, endloop
-          // %d\n",edist,abort_dist,edist-abort_dist,endloop);
+    /// bound-bound process occurs
+    const auto &line = globals::linelist[lineindex];
+    pkt_ptr->mastate.element = line.elementindex;
+    pkt_ptr->mastate.ion = line.ionindex;
+    /// if the MA will be activated it must be in the transitions upper level
+    pkt_ptr->mastate.level = line.upperlevelindex;
+    pkt_ptr->mastate.activatingline = lineindex;
 
-          pkt_ptr->next_trans = dummypkt.next_trans;
+    update_lineestimator_atline(modelgridindex, pkt_ptr, lineindex, ldist);
 
-          return dist + ldist;
-        }
-      } else {
-        /// continuum process occurs before reaching the line
+    *rpkt_eventtype = RPKT_EVENTTYPE_BB;
+
+    // further scattering events should be located at lower frequencies to prevent
+    // multiple scattering events of one packet in a single line
+    pkt_ptr->next_trans = lineindex + 1;
 
-        *rpkt_eventtype = RPKT_EVENTTYPE_CONT;
+    return ldist;
+  };
 
-        pkt_ptr->next_trans = dummypkt.next_trans - 1;
+  /// first select the closest transition in frequency (returns negative value if no line can be reached)
+  int lineindex = closest_transition(pkt_ptr->nu_cmf, pkt_ptr->next_trans);
 
-        return dist + (tau_rnd - tau) / chi_cont;
+  if constexpr (ACTIVE_LINES_ON) {
+    if (lineindex >= 0) {
+      const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+      const int *const activelineindices = &activelines_lineindex[activelines_start[nonemptymgi]];
+      const double *const activetau_over_t = &activelines_tau_over_t[activelines_start[nonemptymgi]];
+      const auto nactive = static_cast<int>(activelines_start[nonemptymgi + 1] - activelines_start[nonemptymgi]);
+      int activeindex = static_cast<int>(std::distance(
+          activelineindices, std::lower_bound(activelineindices, activelineindices + nactive, lineindex)));
+
+      // the pruned lines of this cell can be active in the next one, so a packet that stops between active lines
+      // keeps the position after the last line it passed as the start of a new line list search
+      int searchstart = lineindex;
+      for (; activeindex < nactive; activeindex++) {
+        const int activelineindex = activelineindices[activeindex];
+        const double edist = get_event_atline(activelineindex, activetau_over_t[activeindex],
+                                              get_next_trans_skiplines(searchstart));
+        if (edist >= 0.) {
+          return edist;
+        }
+        searchstart = activelineindex + 1;
       }
-    } else {
-      /// no line interaction possible - check whether continuum process occurs in cell
+      pkt_ptr->next_trans = get_next_trans_skiplines(searchstart);
+    }
+  } else {
+    const double *const tau_line_over_t = globals::cellhistory[tid].tau_line_over_t;
+    while (lineindex >= 0 && lineindex < globals::nlines) {
+      const int blockend = std::min((lineindex / LINE_TAUBLOCKSIZE + 1) * LINE_TAUBLOCKSIZE, globals::nlines);
+      update_tau_line_block(modelgridindex, lineindex);
+
+      // if the packet can reach the end of the block without an event, pass all of its lines at once
+      const double nu_blocklast = globals::linelist_nu[blockend - 1];
+      if (nu_blocklast >= nu_cmf_abort) {
+        double tau_lines_block = 0.;
+        for (int i = lineindex; i < blockend; i++) {
+          const double ldist = get_linedistance(prop_time_start, nu_cmf_start, globals::linelist_nu[i], d_nu_on_d_l);
+          tau_lines_block += tau_line_over_t[i] * (prop_time_start + ldist / CLIGHT_PROP);
+        }
 
-      const double tau_cont = chi_cont * (abort_dist - dist);
+        const double ldist_blocklast = get_linedistance(prop_time_start, nu_cmf_start, nu_blocklast, d_nu_on_d_l);
+        if (tau_rnd > chi_cont * ldist_blocklast + tau_lines + tau_lines_block) {
+          if constexpr (DETAILED_LINE_ESTIMATORS_ON) {
+            for (int i = lineindex; i < blockend; i++) {
+              update_lineestimator_atline(
+                  modelgridindex, pkt_ptr, i,
+                  get_linedistance(prop_time_start, nu_cmf_start, globals::linelist_nu[i], d_nu_on_d_l));
+            }
+          }
+          tau_lines += tau_lines_block;
+          lineindex = blockend;
+          continue;
+        }
+      }
 
-      if (tau_rnd - tau > tau_cont) {
-        // no continuum event before abort_dist
-        return std::numeric_limits<double>::max();
+      // the event or the abort point lies within this block, so go through its lines one at a time
+      for (; lineindex < blockend; lineindex++) {
+        const double edist = get_event_atline(lineindex, tau_line_over_t[lineindex], lineindex);
+        if (edist >= 0.) {
+          return edist;
+        }
       }
-      /// continuum process occurs at edist
+    }
+  }
 
-      *rpkt_eventtype = RPKT_EVENTTYPE_CONT;
+  /// no line interaction possible - check whether continuum process occurs in cell
 
-      pkt_ptr->next_trans = globals::nlines + 1;
+  const double tau_cont = chi_cont * abort_dist;
 
-      return dist + (tau_rnd - tau) / chi_cont;
-    }
+  if (tau_rnd - tau_lines > tau_cont) {
+    // no continuum event before abort_dist
+    return std::numeric_limits<double>::max();
   }
+  /// continuum process occurs at edist
+
+  *rpkt_eventtype = get_continuum_eventtype();
+
+  if constexpr (!ACTIVE_LINES_ON) {
+    pkt_ptr->next_trans = globals::nlines + 1;
+  }
+
+  return (tau_rnd - tau_lines) / chi_cont;
+}
+
+static auto get_event_expansionopacity(const int modelgridindex, struct packet *pkt_ptr, int *rpkt_eventtype,
+                                       int *event_bin, const double tau_rnd, const double abort_dist) -> double
+// as get_event(), but with the expansion opacity in place of the individual lines. The packet redshifts through the
+// bins, so the optical depth is added up bin by bin until it reaches tau_rnd or the packet reaches abort_dist.
+// For an expansion opacity event, event_bin is set to the bin of the event
+{
+  struct packet dummypkt_abort = *pkt_ptr;
+  // this is done is two parts to get identical results to do_rpkt_step()
+  move_pkt_withtime(&dummypkt_abort, abort_dist / 2.);
+  move_pkt_withtime(&dummypkt_abort, abort_dist / 2.);
+  const double nu_cmf_abort = dummypkt_abort.nu_cmf;
+  assert_testmodeonly(nu_cmf_abort <= pkt_ptr->nu_cmf);
+  const double d_nu_on_d_l = (nu_cmf_abort - pkt_ptr->nu_cmf) / abort_dist;
+
+  calculate_chi_rpkt_cont(pkt_ptr->nu_cmf, &globals::chi_rpkt_cont[tid], modelgridindex, true);
+  const double dopplerfactor = doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
+  const double chi_cont = globals::chi_rpkt_cont[tid].total * dopplerfactor;
 
-  // should have already returned somewhere!
-  assert_always(false);
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  const double *chi_expansion =
+      &cell_expansionopacity[static_cast<size_t>(nonemptymgi) * EXPANSION_OPACITIES_NBINS];
+
+  double tau = 0.;
+  double dist = 0.;
+  int bin = get_expansionopacity_bin(pkt_ptr->nu_cmf);
+  while (true) {
+    // the segment of the path within the current bin (or above or below the binned range)
+    double chi_expansion_bin = 0.;
+    double nu_segend = 0.;
+    if (bin >= EXPANSION_OPACITIES_NBINS) {
+      nu_segend = get_expansionopacity_bin_nu_lower(EXPANSION_OPACITIES_NBINS);
+    } else if (bin >= 0) {
+      chi_expansion_bin = chi_expansion[bin] * dopplerfactor;
+      nu_segend = get_expansionopacity_bin_nu_lower(bin);
+    }
+
+    const bool reaches_abort = (nu_segend <= nu_cmf_abort);
+    const double dist_segend =
+        reaches_abort ? abort_dist
+                      : get_linedistance(pkt_ptr->prop_time, pkt_ptr->nu_cmf, nu_segend, d_nu_on_d_l);
+    const double chi = chi_cont + chi_expansion_bin;
+
+    if (tau + chi * (dist_segend - dist) >= tau_rnd) {
+      // the event lies within this segment
+      *rpkt_eventtype = (chi_expansion_bin > 0. && rng_uniform() * chi < chi_expansion_bin)
+                            ? RPKT_EVENTTYPE_EXPANSIONOPACITY
+                            : RPKT_EVENTTYPE_CONT;
+      *event_bin = bin;
+      return dist + (tau_rnd - tau) / chi;
+    }
+
+    if (reaches_abort) {
+      return std::numeric_limits<double>::max();
+    }
+
+    tau += chi * (dist_segend - dist);
+    dist = dist_segend;
+    bin = std::min(bin, EXPANSION_OPACITIES_NBINS) - 1;
+  }
 }
 
 static void electron_scatter_rpkt(struct packet *pkt_ptr) {
@@ -362,6 +905,33 @@ static void electron_scatter_rpkt(struct packet *pkt_ptr) {
   pkt_ptr->e_rf = pkt_ptr->e_cmf / dopplerfactor;
 }
 
+// With USE_LUT_CONTOPACITY, each cell has a table of the free-free and bound-free opacities at CONTOPACITY_LUT_NPTS
+// frequencies spaced evenly in log(nu) between NU_MIN_R and NU_MAX_R, followed by a row for each point with the
+// cumulative bound-free opacity over the continua with nu_edge <= nu (allcont is sorted by nu_edge), which replaces
+// phixslist chi_bf_sum for selecting the continuum of a bound-free event
+static double contopacity_lut_delta_lognu = 0.;
+static std::vector<size_t> contopacity_lut_bfrowstart;  // [k] is the offset of the bound-free row of point k
+
+static auto get_contopacity_lut_nu(const int point) -> double {
+  return NU_MIN_R * std::exp(point * contopacity_lut_delta_lognu);
+}
+
+static auto get_contopacity_lut_bfrowlength(const int point) -> int {
+  return static_cast<int>(contopacity_lut_bfrowstart[point + 1] - contopacity_lut_bfrowstart[point]);
+}
+
+static auto select_bfcontinuum_from_lut(const int point, const double zrand) -> int
+// select the continuum of a bound-free event from the cumulative row of a table point of the current cell
+{
+  const double *bfrow = &globals::cellhistory[tid].contopacity_lut[contopacity_lut_bfrowstart[point]];
+  const int bfrowlength = get_contopacity_lut_bfrowlength(point);
+  assert_always(bfrowlength > 0);
+  const double chi_bf_rand = zrand * bfrow[bfrowlength - 1];
+
+  // first bfrow[i] such that bfrow[i] > chi_bf_rand
+  return static_cast<int>(std::distance(bfrow, std::upper_bound(bfrow, bfrow + bfrowlength - 1, chi_bf_rand)));
+}
+
 static void rpkt_event_continuum(struct packet *pkt_ptr,
                                  struct rpkt_continuum_absorptioncoeffs chi_rpkt_cont_thisthread, int modelgridindex) {
   const double nu = pkt_ptr->nu_cmf;
@@ -417,17 +987,22 @@ static void rpkt_event_continuum(struct packet *pkt_ptr,
 
     pkt_ptr->absorptiontype = -2;
 
-    const double chi_bf_inrest = chi_rpkt_cont_thisthread.bf;
-    assert_always(globals::phixslist[tid].chi_bf_sum[globals::nbfcontinua - 1] == chi_bf_inrest);
-
     /// Determine in which continuum the bf-absorption occurs
     const double zrand2 = rng_uniform();
-    const double chi_bf_rand = zrand2 * chi_bf_inrest;
+    int allcontindex = -1;
+    if (chi_rpkt_cont_thisthread.lutpoint >= 0) {
+      allcontindex = select_bfcontinuum_from_lut(chi_rpkt_cont_thisthread.lutpoint, zrand2);
+    } else {
+      const double chi_bf_inrest = chi_rpkt_cont_thisthread.bf;
+      assert_always(globals::phixslist[tid].chi_bf_sum[globals::nbfcontinua - 1] == chi_bf_inrest);
 
-    // first chi_bf_sum[i] such that chi_bf_sum[i] > chi_bf_rand
-    double *upperval = std::upper_bound(&globals::phixslist[tid].chi_bf_sum[0],
-                                        &globals::phixslist[tid].chi_bf_sum[globals::nbfcontinua - 1], chi_bf_rand);
-    const int allcontindex = std::distance(&globals::phixslist[tid].chi_bf_sum[0], upperval);
+      const double chi_bf_rand = zrand2 * chi_bf_inrest;
+
+      // first chi_bf_sum[i] such that chi_bf_sum[i] > chi_bf_rand
+      double *upperval = std::upper_bound(&globals::phixslist[tid].chi_bf_sum[0],
+                                          &globals::phixslist[tid].chi_bf_sum[globals::nbfcontinua - 1], chi_bf_rand);
+      allcontindex = std::distance(&globals::phixslist[tid].chi_bf_sum[0], upperval);
+    }
     assert_always(allcontindex < globals::nbfcontinua);
 
     const double nu_edge = globals::allcont[allcontindex].nu_edge;
@@ -514,6 +1089,73 @@ static void rpkt_event_boundbound(struct packet *pkt_ptr, const int mgi) {
   }
 }
 
+static void rpkt_event_expansionopacity(struct packet *pkt_ptr, const int mgi, const int bin)
+/// Event handling for the expansion opacity (EXPANSION_OPACITIES_ON). The packet is absorbed by one of the lines of
+/// the event's bin (from get_event_expansionopacity(), since the packet's nu_cmf can be at the edge of the
+/// neighbouring bin), chosen with probability proportional to 1 - exp(-tau_sobolev), which activates a macro atom in
+/// the upper level of the line as for a bound-bound event
+{
+  assert_always(bin >= 0 && bin < EXPANSION_OPACITIES_NBINS);
+  const double nu_bin_upper = get_expansionopacity_bin_nu_lower(bin + 1);
+  const double nu_bin_lower = get_expansionopacity_bin_nu_lower(bin);
+
+  // the bin edges are recalculated here, so the search range is widened slightly and then filtered by bin number
+  const int firstline = get_linelist_position(nu_bin_upper * (1. + 1e-8), 0);
+  const auto get_absorbprob_weight = [&](const int lineindex) -> double {
+    // binned as in update_cell_expansionopacities()
+    if (std::min(get_expansionopacity_bin(globals::linelist_nu[lineindex]), EXPANSION_OPACITIES_NBINS - 1) != bin) {
+      return 0.;
+    }
+    const auto &line = globals::linelist[lineindex];
+    const double n_u = get_levelpop(mgi, line.elementindex, line.ionindex, line.upperlevelindex);
+    const double n_l = get_levelpop(mgi, line.elementindex, line.ionindex, line.lowerlevelindex);
+    const double tau_sobolev =
+        std::max(0., (globals::linelist_B_lu[lineindex] * n_l - globals::linelist_B_ul[lineindex] * n_u) *
+                         HCLIGHTOVERFOURPI * pkt_ptr->prop_time);
+    return -std::expm1(-tau_sobolev);
+  };
+
+  int lastline = firstline;
+  double weight_sum = 0.;
+  for (; lastline < globals::nlines && globals::linelist_nu[lastline] >= nu_bin_lower * (1. - 1e-8); lastline++) {
+    weight_sum += get_absorbprob_weight(lastline);
+  }
+  assert_always(weight_sum > 0.);
+
+  const double weight_rand = rng_uniform() * weight_sum;
+  double weight_cumulative = 0.;
+  int lineindex = firstline;
+  for (; lineindex < lastline - 1; lineindex++) {
+    weight_cumulative += get_absorbprob_weight(lineindex);
+    if (weight_cumulative > weight_rand) {
+      break;
+    }
+  }
+
+  const auto &line = globals::linelist[lineindex];
+  pkt_ptr->mastate.element = line.elementindex;
+  pkt_ptr->mastate.ion = line.ionindex;
+  pkt_ptr->mastate.level = line.upperlevelindex;
+  pkt_ptr->mastate.activatingline = lineindex;
+  pkt_ptr->next_trans = lineindex + 1;
+
+  rpkt_event_boundbound(pkt_ptr, mgi);
+}
+
+static void rpkt_event_prunedlines(struct packet *pkt_ptr)
+/// Event handling for the pseudo-continuum of the pruned lines (ACTIVE_LINES_ON). These are weak lines that are not
+/// followed individually, so the interaction is treated as resonance scattering: the packet keeps its nu_cmf and
+/// is re-emitted isotropically in the comoving frame.
+{
+  pkt_ptr->interactions += 1;
+  pkt_ptr->nscatterings += 1;
+  pkt_ptr->last_event = 13;
+
+  emit_rpkt(pkt_ptr);
+  vec_copy(pkt_ptr->em_pos, pkt_ptr->pos);
+  pkt_ptr->em_time = pkt_ptr->prop_time;
+}
+
 static void rpkt_event_thickcell(struct packet *pkt_ptr)
 /// Event handling for optically thick cells. Those cells are treated in a grey
 /// approximation with electron scattering only.
@@ -550,7 +1192,8 @@ static void update_estimators(const struct packet *pkt_ptr, const double distanc
 
   /// ffheatingestimator does not depend on ion and element, so an array with gridsize is enough.
   /// quick and dirty solution: store info in element=ion=0, and leave the others untouched (i.e. zero)
-  safeadd(globals::ffheatingestimator[modelgridindex], distance_e_cmf * globals::chi_rpkt_cont[tid].ffheating);
+  safeadd_nodeshared(globals::ffheatingestimator[modelgridindex],
+                     distance_e_cmf * globals::chi_rpkt_cont[tid].ffheating);
 
   if constexpr (USE_LUT_PHOTOION || USE_LUT_BFHEATING) {
     const double distance_e_cmf_over_nu = distance_e_cmf / nu;
@@ -567,8 +1210,8 @@ static void update_estimators(const struct packet *pkt_ptr, const double distanc
           const int ionestimindex = get_ionestimindex_nonemptymgi(nonemptymgi, element, ion);
 
           if constexpr (USE_LUT_PHOTOION) {
-            safeadd(globals::gammaestimator[ionestimindex],
-                    globals::phixslist[tid].groundcont_gamma_contr[i] * distance_e_cmf_over_nu);
+            safeadd_nodeshared(globals::gammaestimator[ionestimindex],
+                               globals::phixslist[tid].groundcont_gamma_contr[i] * distance_e_cmf_over_nu);
 
             if (!std::isfinite(globals::gammaestimator[ionestimindex])) {
               printout(
@@ -581,8 +1224,9 @@ static void update_estimators(const struct packet *pkt_ptr, const double distanc
           }
 
           if constexpr (USE_LUT_BFHEATING) {
-            safeadd(globals::bfheatingestimator[ionestimindex],
-                    globals::phixslist[tid].groundcont_gamma_contr[i] * distance_e_cmf * (1. - nu_edge / nu));
+            safeadd_nodeshared(
+                globals::bfheatingestimator[ionestimindex],
+                globals::phixslist[tid].groundcont_gamma_contr[i] * distance_e_cmf * (1. - nu_edge / nu));
           }
         }
       } else {
@@ -603,7 +1247,7 @@ static auto do_rpkt_step(struct packet *pkt_ptr, const double t2) -> bool
   // if (pkt_ptr->next_trans > 0) {
   //   printout("[debug] do_rpkt: init: pkt_ptr->nu_cmf %g, nu(pkt_ptr->next_trans=%d)
   //   %g, nu(pkt_ptr->next_trans-1=%d) %g, pkt_ptr->where %d\n", pkt_ptr->nu_cmf, pkt_ptr->next_trans,
-  //   globals::linelist[pkt_ptr->next_trans].nu, pkt_ptr->next_trans-1, globals::linelist[pkt_ptr->next_trans-1].nu,
+  //   globals::linelist_nu[pkt_ptr->next_trans], pkt_ptr->next_trans-1, globals::linelist_nu[pkt_ptr->next_trans-1],
   //   pkt_ptr->where );
   // }
 
@@ -671,10 +1315,12 @@ static auto do_rpkt_step(struct packet *pkt_ptr, const double t2) -> bool
   /// Get distance to the next physical event (continuum or bound-bound)
   double edist = -1;
   int rpkt_eventtype = -1;
+  int expansionopacity_bin = -1;
   if (mgi == grid::get_npts_model()) {
     /// for empty cells no physical event occurs. The packets just propagate.
     edist = std::numeric_limits<double>::max();
-    pkt_ptr->next_trans = -1;  // skip over lines and search for line list position on the next non-empty cell
+    // skip over lines and search for line list position on the next non-empty cell
+    pkt_ptr->next_trans = get_next_trans_skiplines(pkt_ptr->next_trans);
   } else if (grid::modelgrid[mgi].thick == 1) {
     /// In the case of optically thick cells, we treat the packets in grey approximation to speed up the calculation
 
@@ -682,9 +1328,12 @@ static auto do_rpkt_step(struct packet *pkt_ptr, const double t2) -> bool
                          doppler_packet_nucmf_on_nurf(pkt_ptr->pos, pkt_ptr->dir, pkt_ptr->prop_time);
     const double tau_current = 0.0;
     edist = (tau_next - tau_current) / kappa;
-    pkt_ptr->next_trans = -1;
+    pkt_ptr->next_trans = get_next_trans_skiplines(pkt_ptr->next_trans);
   } else {
-    edist = get_event(mgi, pkt_ptr, &rpkt_eventtype, tau_next, fmin(tdist, sdist));
+    edist = EXPANSION_OPACITIES_ON
+                ? get_event_expansionopacity(mgi, pkt_ptr, &rpkt_eventtype, &expansionopacity_bin, tau_next,
+                                             fmin(tdist, sdist))
+                : get_event(mgi, pkt_ptr, &rpkt_eventtype, tau_next, fmin(tdist, sdist));
   }
   assert_always(edist >= 0);
 
@@ -718,6 +1367,10 @@ static auto do_rpkt_step(struct packet *pkt_ptr, const double t2) -> bool
       rpkt_event_boundbound(pkt_ptr, mgi);
     } else if (rpkt_eventtype == RPKT_EVENTTYPE_CONT) {
       rpkt_event_continuum(pkt_ptr, globals::chi_rpkt_cont[tid], mgi);
+    } else if (rpkt_eventtype == RPKT_EVENTTYPE_PRUNEDLINES) {
+      rpkt_event_prunedlines(pkt_ptr);
+    } else if (rpkt_eventtype == RPKT_EVENTTYPE_EXPANSIONOPACITY) {
+      rpkt_event_expansionopacity(pkt_ptr, mgi, expansionopacity_bin);
     } else {
       assert_always(false);
     }
@@ -824,6 +1477,18 @@ static auto calculate_chi_ff(const int modelgridindex, const double nu) -> doubl
   return chi_ff;
 }
 
+static auto bfcontinuum_included(const int modelgridindex, const int allcontindex, const double nnetot) -> bool
+// the bf process happens only if the current cell contains the involved atomic species
+{
+  const int element = globals::allcont[allcontindex].element;
+  if constexpr (DETAILED_BF_ESTIMATORS_ON) {
+    return grid::get_elem_abundance(modelgridindex, element) > 0;
+  }
+  const int ion = globals::allcont[allcontindex].ion;
+  const int level = globals::allcont[allcontindex].level;
+  return (get_nnion(modelgridindex, element, ion) / nnetot > 1.e-6) || (level == 0);
+}
+
 template <bool usecellhistupdatephixslist>
 auto calculate_chi_bf_gammacontr(const int modelgridindex, const double nu) -> double
 // bound-free opacity
@@ -855,11 +1520,7 @@ auto calculate_chi_bf_gammacontr(const int modelgridindex, const double nu) -> d
     const int element = globals::allcont[i].element;
     const int ion = globals::allcont[i].ion;
     const int level = globals::allcont[i].level;
-    /// The bf process happens only if the current cell contains
-    /// the involved atomic species
-
-    if ((DETAILED_BF_ESTIMATORS_ON && grid::get_elem_abundance(modelgridindex, element) > 0) ||
-        (!DETAILED_BF_ESTIMATORS_ON && ((get_nnion(modelgridindex, element, ion) / nnetot > 1.e-6) || (level == 0)))) {
+    if (bfcontinuum_included(modelgridindex, i, nnetot)) {
       const double nu_edge = globals::allcont[i].nu_edge;
       if (nu < nu_edge) {
         break;
@@ -952,6 +1613,153 @@ auto calculate_chi_bf_gammacontr(const int modelgridindex, const double nu) -> d
   return chi_bf_sum;
 }
 
+// continuum opacity tables for USE_LUT_CONTOPACITY (see above)
+
+auto init_contopacity_lut() -> size_t
+// set up the layout of the continuum opacity tables and return their size (number of doubles) for each cell
+{
+  static_assert(CONTOPACITY_LUT_NPTS >= 2);
+  contopacity_lut_delta_lognu = std::log(NU_MAX_R / NU_MIN_R) / (CONTOPACITY_LUT_NPTS - 1);
+  contopacity_lut_bfrowstart.resize(CONTOPACITY_LUT_NPTS + 1);
+
+  // chi_ff for each point, then chi_bf for each point, then the bound-free rows
+  size_t offset = 2 * CONTOPACITY_LUT_NPTS;
+  for (int point = 0; point < CONTOPACITY_LUT_NPTS; point++) {
+    contopacity_lut_bfrowstart[point] = offset;
+    const double nu = get_contopacity_lut_nu(point);
+    auto *firstabove =
+        std::upper_bound(globals::allcont_nu_edge, globals::allcont_nu_edge + globals::nbfcontinua, nu);
+    offset += std::distance(globals::allcont_nu_edge, firstabove);
+  }
+  contopacity_lut_bfrowstart[CONTOPACITY_LUT_NPTS] = offset;
+
+  printout("[info] continuum opacity tables have %d points with dlog(nu) %g and %zu bound-free entries per cell\n",
+           CONTOPACITY_LUT_NPTS, contopacity_lut_delta_lognu, offset - 2 * CONTOPACITY_LUT_NPTS);
+
+  return offset;
+}
+
+void calculate_contopacity_lut(const int modelgridindex, double *lut)
+// fill the continuum opacity table of a cell (see init_contopacity_lut())
+{
+  const auto T_e = grid::get_Te(modelgridindex);
+  const auto nne = grid::get_nne(modelgridindex);
+  const auto nnetot = grid::get_nnetot(modelgridindex);
+
+  // the lower level populations and departure ratios do not depend on frequency. nnlevel stays zero for continua
+  // that are not included in the cell
+  std::vector<double> nnlevel(globals::nbfcontinua, 0.);
+  std::vector<double> departure_ratio(globals::nbfcontinua, 0.);
+  for (int i = 0; i < globals::nbfcontinua; i++) {
+    if (!bfcontinuum_included(modelgridindex, i, nnetot)) {
+      continue;
+    }
+    const int element = globals::allcont[i].element;
+    const int ion = globals::allcont[i].ion;
+    const int level = globals::allcont[i].level;
+    nnlevel[i] = get_levelpop(modelgridindex, element, ion, level);
+    if (!SEPARATE_STIMRECOMB && nnlevel[i] > 0) {
+      const int upper = globals::allcont[i].upperlevel;
+      const double nnupperionlevel = get_levelpop(modelgridindex, element, ion + 1, upper);
+      const double sf = calculate_sahafact(element, ion, level, upper, T_e, H * globals::allcont[i].nu_edge);
+      departure_ratio[i] = nnupperionlevel / nnlevel[i] * nne * sf;
+    }
+  }
+
+  for (int point = 0; point < CONTOPACITY_LUT_NPTS; point++) {
+    const double nu = get_contopacity_lut_nu(point);
+    lut[point] = calculate_chi_ff(modelgridindex, nu);
+
+    const double expfactor = exp(-HOVERKB * nu / T_e);
+    double *bfrow = &lut[contopacity_lut_bfrowstart[point]];
+    double chi_bf_sum = 0.;
+    for (int i = 0; i < get_contopacity_lut_bfrowlength(point); i++) {
+      const double nu_edge = globals::allcont[i].nu_edge;
+      if (nnlevel[i] > 0 && nu <= nu_edge * last_phixs_nuovernuedge) {
+        const double sigma_bf = photoionization_crosssection_fromtable(globals::allcont[i].photoion_xs, nu_edge, nu);
+        const double corrfactor = SEPARATE_STIMRECOMB ? 1. : std::max(0., 1 - departure_ratio[i] * expfactor);
+        chi_bf_sum += nnlevel[i] * sigma_bf * globals::allcont[i].probability * corrfactor;
+      }
+      bfrow[i] = chi_bf_sum;
+    }
+    lut[CONTOPACITY_LUT_NPTS + point] = chi_bf_sum;
+  }
+}
+
+static void set_phixslist_contr_from_lut(const int modelgridindex, const int point)
+// the estimators need the contribution of each continuum, which is the difference between neighbouring entries of
+// the cumulative bound-free row divided by the lower level population
+{
+  const double *bfrow = &globals::cellhistory[tid].contopacity_lut[contopacity_lut_bfrowstart[point]];
+  const int bfrowlength = get_contopacity_lut_bfrowlength(point);
+
+  if constexpr (USE_LUT_PHOTOION || USE_LUT_BFHEATING) {
+    std::fill_n(globals::phixslist[tid].groundcont_gamma_contr, globals::nbfcontinua_ground, 0.);
+  }
+
+  for (int i = 0; i < globals::nbfcontinua; i++) {
+    double sigma_contr = 0.;
+    if (i < bfrowlength) {
+      const double chi_bf_contr = bfrow[i] - ((i > 0) ? bfrow[i - 1] : 0.);
+      if (chi_bf_contr > 0.) {
+        sigma_contr = chi_bf_contr / get_levelpop(modelgridindex, globals::allcont[i].element, globals::allcont[i].ion,
+                                                  globals::allcont[i].level);
+      }
+    }
+
+    if constexpr (USE_LUT_PHOTOION || USE_LUT_BFHEATING) {
+      if (globals::allcont[i].level == 0) {
+        globals::phixslist[tid].groundcont_gamma_contr[globals::allcont[i].index_in_groundphixslist] += sigma_contr;
+      }
+    }
+
+    if constexpr (DETAILED_BF_ESTIMATORS_ON) {
+      globals::phixslist[tid].gamma_contr[i] = sigma_contr;
+    }
+  }
+}
+
+static auto get_chi_cont_from_lut(const int modelgridindex, const double nu_cmf,
+                                  struct rpkt_continuum_absorptioncoeffs *chi_rpkt_cont_thisthread, double *chi_ff,
+                                  double *chi_bf) -> bool
+// interpolate the free-free and bound-free opacities from the cell's table. Returns false if the cell has no table
+// or nu_cmf is outside of it.
+{
+  const double *lut = globals::cellhistory[tid].contopacity_lut;
+  if (lut == nullptr) {
+    return false;
+  }
+  const double x = std::log(nu_cmf / NU_MIN_R) / contopacity_lut_delta_lognu;
+  if (!(x >= 0.) || x > CONTOPACITY_LUT_NPTS - 1) {
+    return false;
+  }
+  const int lower = std::min(static_cast<int>(x), CONTOPACITY_LUT_NPTS - 2);
+  const double frac = x - lower;
+  const double *lut_bf = &lut[CONTOPACITY_LUT_NPTS];
+
+  // bound-free events and the estimators use the row of the point below nu_cmf, which only has continua with
+  // nu_edge <= nu_cmf. If that row is empty but the upper point has bound-free opacity (an edge between the points),
+  // the opacity is calculated directly
+  const int point = lower;
+  if (lut_bf[lower] <= 0. && lut_bf[lower + 1] > 0.) {
+    return false;
+  }
+
+  *chi_ff = (1. - frac) * lut[lower] + frac * lut[lower + 1];
+  *chi_bf = (1. - frac) * lut_bf[lower] + frac * lut_bf[lower + 1];
+
+  const bool point_changed = (chi_rpkt_cont_thisthread->lutpoint != point) ||
+                             (chi_rpkt_cont_thisthread->modelgridindex != modelgridindex) ||
+                             chi_rpkt_cont_thisthread->recalculate_required;
+  chi_rpkt_cont_thisthread->lutpoint = point;
+  if constexpr (DETAILED_BF_ESTIMATORS_ON || USE_LUT_PHOTOION || USE_LUT_BFHEATING) {
+    if (point_changed) {
+      set_phixslist_contr_from_lut(modelgridindex, point);
+    }
+  }
+  return true;
+}
+
 void calculate_chi_rpkt_cont(const double nu_cmf, struct rpkt_continuum_absorptioncoeffs *chi_rpkt_cont_thisthread,
                              const int modelgridindex, const bool usecellhistupdatephixslist) {
   assert_testmodeonly(modelgridindex != grid::get_npts_model());
@@ -978,13 +1786,18 @@ void calculate_chi_rpkt_cont(const double nu_cmf, struct rpkt_continuum_absorpti
     // sigma_cmf = 0. * nne;
     // sigma *= 0.1;
 
-    /// Second contribution: free-free absorption
-    chi_ff = calculate_chi_ff(modelgridindex, nu_cmf);
-    chi_ffheating = chi_ff;
+    if (!USE_LUT_CONTOPACITY || !usecellhistupdatephixslist ||
+        !get_chi_cont_from_lut(modelgridindex, nu_cmf, chi_rpkt_cont_thisthread, &chi_ff, &chi_bf)) {
+      chi_rpkt_cont_thisthread->lutpoint = -1;
+
+      /// Second contribution: free-free absorption
+      chi_ff = calculate_chi_ff(modelgridindex, nu_cmf);
 
-    /// Third contribution: bound-free absorption
-    chi_bf = usecellhistupdatephixslist ? calculate_chi_bf_gammacontr<true>(modelgridindex, nu_cmf)
-                                        : calculate_chi_bf_gammacontr<false>(modelgridindex, nu_cmf);
+      /// Third contribution: bound-free absorption
+      chi_bf = usecellhistupdatephixslist ? calculate_chi_bf_gammacontr<true>(modelgridindex, nu_cmf)
+                                          : calculate_chi_bf_gammacontr<false>(modelgridindex, nu_cmf);
+    }
+    chi_ffheating = chi_ff;
 
     // const double pkt_lambda = 1e8 * CLIGHT / nu_cmf;
     // if (pkt_lambda < 4000)
@@ -1,6 +1,8 @@
 #ifndef RPKT_H
 #define RPKT_H
 
+#include <vector>
+
 #include "artisoptions.h"
 #include "constants.h"
 #include "grid.h"
@@ -8,6 +10,18 @@
 
 void do_rpkt(struct packet *pkt_ptr, double t2);
 void emit_rpkt(struct packet *pkt_ptr);
+void setup_linelist_buckets();
+void init_activelines();
+void update_cell_activelines(int modelgridindex, double t_mid);
+void finish_cell_activelines_update();
+void mpi_pack_cell_activelines(std::vector<char> &buffer, int modelgridindex);
+void mpi_unpack_cell_activelines(const char *buffer, size_t &position, int modelgridindex, bool write_nodeshared);
+void init_expansionopacities();
+void update_cell_expansionopacities(int modelgridindex, double t_mid);
+void mpi_pack_cell_expansionopacities(std::vector<char> &buffer, int modelgridindex);
+void mpi_unpack_cell_expansionopacities(const char *buffer, size_t &position, int modelgridindex);
+auto init_contopacity_lut() -> size_t;
+void calculate_contopacity_lut(int modelgridindex, double *lut);
 auto closest_transition(double nu_cmf, int next_trans) -> int;
 auto calculate_chi_bf_gammacontr(int modelgridindex, double nu) -> double;
 void calculate_chi_rpkt_cont(double nu_cmf, struct rpkt_continuum_absorptioncoeffs *chi_rpkt_cont_thisthread,
@@ -33,6 +47,18 @@ constexpr auto get_linedistance(const double prop_time, const double nu_cmf, con
   return CLIGHT * prop_time * (nu_cmf / nu_trans - 1);
 }
 
+[[nodiscard]] inline auto get_next_trans_skiplines(const int next_trans) -> int
+// next_trans for a packet passing through a region where lines are skipped (empty cells or grey opacity).
+// The line must be searched for again afterwards, but the current position in the line list is kept as
+// -1 - lineindex to start that search from
+{
+  if (next_trans > 0 && next_trans < globals::nlines) {
+    return -1 - next_trans;
+  }
+  // 0 or negative (already a search start) or past the last line
+  return next_trans;
+}
+
 [[nodiscard]] inline auto get_ionestimindex_nonemptymgi(const int nonemptymgi, const int element, const int ion)
     -> int {
   assert_testmodeonly(ion >= 0);
@@ -12,7 +12,13 @@
 
 #include "sn3d.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <numeric>
+#include <thread>
+#include <vector>
 
 #include "artisoptions.h"
 #include "atomic.h"
@@ -21,6 +27,8 @@
 #include "globals.h"
 #include "grid.h"
 #include "input.h"
+#include "kpkt.h"
+#include "md5.h"
 #include "nltepop.h"
 #include "nonthermal.h"
 #include "radfield.h"
@@ -36,7 +44,7 @@
 // threadprivate variables
 int tid;
 bool use_cellhist;
-std::mt19937 stdrng(std::random_device{}());
+struct rngstate rngstate;
 gsl_integration_workspace *gslworkspace = nullptr;
 FILE *output_file = nullptr;
 static FILE *linestat_file = nullptr;
@@ -44,8 +52,19 @@ static time_t real_time_start = -1;
 static time_t time_timestep_start = -1;  // this will be set after the first update of the grid and before packet prop
 static FILE *estimators_file = nullptr;
 
-size_t mpi_grid_buffer_size = 0;
-char *mpi_grid_buffer = nullptr;
+// the packets restart file is written by a background thread from a snapshot copy of the packets at the start of the
+// timestep, so that propagation can continue while the write finishes
+constexpr int PACKETS_CHECKPOINT_MAXATTEMPTS = 10;
+struct packetscheckpoint {
+  std::vector<struct packet> snapshot;
+  std::thread writer;
+  int timestep = -1;
+  int write_attempts = 0;
+  bool write_verified = false;
+  time_t time_start = 0;
+  time_t time_finished = 0;
+};
+static struct packetscheckpoint pktcheckpoint;
 
 static void initialise_linestat_file() {
   if (globals::simulation_continued_from_saved && !RECORD_LINESTAT) {
@@ -56,7 +75,7 @@ static void initialise_linestat_file() {
   linestat_file = fopen_required("linestat.out", "w");
 
   for (int i = 0; i < globals::nlines; i++) {
-    fprintf(linestat_file, "%g ", CLIGHT / globals::linelist[i].nu);
+    fprintf(linestat_file, "%g ", CLIGHT / globals::linelist_nu[i]);
   }
   fprintf(linestat_file, "\n");
 
@@ -84,7 +103,7 @@ static void initialise_linestat_file() {
   // setvbuf(linestat_file,nullptr, _IOLBF, 1); // flush after every line makes it slow!
 }
 
-static void write_deposition_file(const int nts, const int my_rank, const int nstart, const int ndo) {
+static void write_deposition_file(const int nts, const int my_rank) {
   printout("Calculating deposition rates...\n");
   time_t const time_write_deposition_file_start = time(nullptr);
   double mtot = 0.;
@@ -103,7 +122,7 @@ static void write_deposition_file(const int nts, const int my_rank, const int ns
     globals::timesteps[i].qdot_alpha = 0.;
     globals::timesteps[i].qdot_total = 0.;
 
-    for (int mgi = nstart; mgi < (nstart + ndo); mgi++)
+    for (const int mgi : grid::get_rank_modelcells(my_rank))
     // for (int mgi = 0; mgi < grid::get_npts_model(); mgi++)
     {
       if (grid::get_numassociatedcells(mgi) > 0) {
@@ -190,153 +209,242 @@ static void write_deposition_file(const int nts, const int my_rank, const int ns
 }
 
 #ifdef MPI_ON
-static void mpi_communicate_grid_properties(const int my_rank, const int nprocs, const int nstart, const int ndo,
-                                            char *mpi_grid_buffer, const size_t mpi_grid_buffer_size) {
-  int position = 0;
-  for (int root = 0; root < nprocs; root++) {
-    MPI_Barrier(MPI_COMM_WORLD);
-    int root_nstart = nstart;
-    MPI_Bcast(&root_nstart, 1, MPI_INT, root, MPI_COMM_WORLD);
-    int root_ndo = ndo;
-    MPI_Bcast(&root_ndo, 1, MPI_INT, root, MPI_COMM_WORLD);
-    int root_node_id = globals::node_id;
-    MPI_Bcast(&root_node_id, 1, MPI_INT, root, MPI_COMM_WORLD);
-
-    for (int modelgridindex = root_nstart; modelgridindex < (root_nstart + root_ndo); modelgridindex++) {
-      if (grid::get_numassociatedcells(modelgridindex) < 1) {
-        continue;
-      }
+static void mpi_pack_cell_properties(std::vector<char> &buffer, const int mgi) {
+  radfield::mpi_pack_cell(buffer, mgi);
+  nonthermal::mpi_pack_cell(buffer, mgi);
 
-      radfield::do_MPI_Bcast(modelgridindex, root, root_node_id);
+  if constexpr (ACTIVE_LINES_ON) {
+    mpi_pack_cell_activelines(buffer, mgi);
+  }
 
-      nonthermal::nt_MPI_Bcast(modelgridindex, root);
-      if (globals::total_nlte_levels > 0 && globals::rank_in_node == 0) {
-        MPI_Bcast(grid::modelgrid[modelgridindex].nlte_pops, globals::total_nlte_levels, MPI_DOUBLE, root_node_id,
-                  globals::mpi_comm_internode);
-      }
+  if constexpr (EXPANSION_OPACITIES_ON) {
+    mpi_pack_cell_expansionopacities(buffer, mgi);
+  }
 
-      if constexpr (USE_LUT_PHOTOION) {
-        const auto nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
-        assert_always(globals::corrphotoionrenorm != nullptr);
-        if (globals::rank_in_node == 0) {
-          MPI_Bcast(&globals::corrphotoionrenorm[nonemptymgi * get_includedions()], get_includedions(), MPI_DOUBLE,
-                    root_node_id, globals::mpi_comm_internode);
-        }
+  if (globals::total_nlte_levels > 0) {
+    mpi_pack_values(buffer, grid::modelgrid[mgi].nlte_pops, globals::total_nlte_levels);
+  }
 
-        assert_always(globals::gammaestimator != nullptr);
-        MPI_Bcast(&globals::gammaestimator[nonemptymgi * get_includedions()], get_includedions(), MPI_DOUBLE, root,
-                  MPI_COMM_WORLD);
-      }
+  if constexpr (USE_LUT_PHOTOION) {
+    const auto nonemptymgi = grid::get_modelcell_nonemptymgi(mgi);
+    assert_always(globals::corrphotoionrenorm != nullptr);
+    mpi_pack_values(buffer, &globals::corrphotoionrenorm[nonemptymgi * get_includedions()], get_includedions());
+    assert_always(globals::gammaestimator != nullptr);
+    mpi_pack_values(buffer, &globals::gammaestimator[nonemptymgi * get_includedions()], get_includedions());
+  }
 
-      assert_always(grid::modelgrid[modelgridindex].elem_meanweight != nullptr);
-      if (globals::rank_in_node == 0) {
-        MPI_Bcast(grid::modelgrid[modelgridindex].elem_meanweight, get_nelements(), MPI_FLOAT, root_node_id,
-                  globals::mpi_comm_internode);
-      }
+  assert_always(grid::modelgrid[mgi].elem_meanweight != nullptr);
+  mpi_pack_values(buffer, grid::modelgrid[mgi].elem_meanweight, get_nelements());
+
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].Te, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].TR, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].TJ, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].W, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].rho, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].nne, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].nnetot, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].kappagrey, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].totalcooling, 1);
+  mpi_pack_values(buffer, &grid::modelgrid[mgi].thick, 1);
+
+  for (int element = 0; element < get_nelements(); element++) {
+    const int nions = get_nions(element);
+    if (nions > 0) {
+      mpi_pack_values(buffer, grid::modelgrid[mgi].composition[element].groundlevelpop, nions);
+      mpi_pack_values(buffer, grid::modelgrid[mgi].composition[element].partfunct, nions);
+      mpi_pack_values(buffer, grid::modelgrid[mgi].cooling_contrib_ion[element], nions);
     }
+  }
+}
 
-    if (root == my_rank) {
-      position = 0;
-      MPI_Pack(&ndo, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
-      for (int mgi = nstart; mgi < (nstart + ndo); mgi++) {
-        MPI_Pack(&mgi, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
-
-        if (grid::get_numassociatedcells(mgi) > 0) {
-          MPI_Pack(&grid::modelgrid[mgi].Te, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].TR, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].TJ, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].W, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].rho, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].nne, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].nnetot, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].kappagrey, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].totalcooling, 1, MPI_DOUBLE, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-          MPI_Pack(&grid::modelgrid[mgi].thick, 1, MPI_SHORT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
-
-          for (int element = 0; element < get_nelements(); element++) {
-            if (get_nions(element) > 0) {
-              MPI_Pack(grid::modelgrid[mgi].composition[element].groundlevelpop, get_nions(element), MPI_FLOAT,
-                       mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
-              MPI_Pack(grid::modelgrid[mgi].composition[element].partfunct, get_nions(element), MPI_FLOAT,
-                       mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
-              MPI_Pack(grid::modelgrid[mgi].cooling_contrib_ion[element], get_nions(element), MPI_DOUBLE,
-                       mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
-            }
-          }
-        }
-      }
-      printout("[info] mem_usage: MPI_BUFFER: used %d of %d bytes allocated to mpi_grid_buffer\n", position,
-               mpi_grid_buffer_size);
-      assert_always(static_cast<size_t>(position) <= mpi_grid_buffer_size);
+static void mpi_unpack_cell_properties(const char *buffer, size_t &position, const int mgi,
+                                       const bool write_nodeshared) {
+  radfield::mpi_unpack_cell(buffer, position, mgi, write_nodeshared);
+  nonthermal::mpi_unpack_cell(buffer, position, mgi);
+
+  if constexpr (ACTIVE_LINES_ON) {
+    mpi_unpack_cell_activelines(buffer, position, mgi, write_nodeshared);
+  }
+
+  if constexpr (EXPANSION_OPACITIES_ON) {
+    mpi_unpack_cell_expansionopacities(buffer, position, mgi);
+  }
+
+  if (globals::total_nlte_levels > 0) {
+    mpi_unpack_values(buffer, position, write_nodeshared ? grid::modelgrid[mgi].nlte_pops : nullptr,
+                      globals::total_nlte_levels);
+  }
+
+  if constexpr (USE_LUT_PHOTOION) {
+    const auto nonemptymgi = grid::get_modelcell_nonemptymgi(mgi);
+    mpi_unpack_values(buffer, position,
+                      write_nodeshared ? &globals::corrphotoionrenorm[nonemptymgi * get_includedions()] : nullptr,
+                      get_includedions());
+    const bool write_gammaestimator = !grid::get_estimators_nodeshared() || write_nodeshared;
+    mpi_unpack_values(buffer, position,
+                      write_gammaestimator ? &globals::gammaestimator[nonemptymgi * get_includedions()] : nullptr,
+                      get_includedions());
+  }
+
+  mpi_unpack_values(buffer, position, write_nodeshared ? grid::modelgrid[mgi].elem_meanweight : nullptr,
+                    get_nelements());
+
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].Te, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].TR, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].TJ, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].W, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].rho, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].nne, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].nnetot, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].kappagrey, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].totalcooling, 1);
+  mpi_unpack_values(buffer, position, &grid::modelgrid[mgi].thick, 1);
+
+  for (int element = 0; element < get_nelements(); element++) {
+    const int nions = get_nions(element);
+    if (nions > 0) {
+      mpi_unpack_values(buffer, position, grid::modelgrid[mgi].composition[element].groundlevelpop, nions);
+      mpi_unpack_values(buffer, position, grid::modelgrid[mgi].composition[element].partfunct, nions);
+      mpi_unpack_values(buffer, position, grid::modelgrid[mgi].cooling_contrib_ion[element], nions);
     }
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Bcast(mpi_grid_buffer, mpi_grid_buffer_size, MPI_PACKED, root, MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
+  }
+}
 
-    position = 0;
-    int nlp = 0;
-    MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &nlp, 1, MPI_INT, MPI_COMM_WORLD);
-    for (int nn = 0; nn < nlp; nn++) {
-      int mgi = 0;
-      MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &mgi, 1, MPI_INT, MPI_COMM_WORLD);
+// limit on the bytes received from all ranks together in each round of the grid property exchange
+constexpr size_t MPI_GRID_EXCHANGE_MAXBYTES_PERROUND = 256 * 1024 * 1024;
+
+// cells of another rank's segment that have been received but not yet unpacked
+struct grid_exchange_segment {
+  std::vector<char> pending;
+  size_t next_cellindex = 0;  // position in the rank's list of model cells
+  int node_id = -1;
+};
+
+static void mpi_unpack_received_cells(struct grid_exchange_segment &segment, const int root)
+// unpack every cell of the root's segment that has been received completely, and keep the rest for the next round
+{
+  size_t position = 0;
+  if (segment.node_id < 0) {
+    if (segment.pending.size() < sizeof(int)) {
+      return;
+    }
+    mpi_unpack_values(segment.pending.data(), position, &segment.node_id, 1);
+  }
 
-      if (grid::get_numassociatedcells(mgi) > 0) {
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].Te, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].TR, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].TJ, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].W, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].rho, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].nne, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].nnetot, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].kappagrey, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].totalcooling, 1, MPI_DOUBLE,
-                   MPI_COMM_WORLD);
-        MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].thick, 1, MPI_SHORT,
-                   MPI_COMM_WORLD);
-
-        for (int element = 0; element < get_nelements(); element++) {
-          if (get_nions(element) > 0) {
-            MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                       grid::modelgrid[mgi].composition[element].groundlevelpop, get_nions(element), MPI_FLOAT,
-                       MPI_COMM_WORLD);
-            MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                       grid::modelgrid[mgi].composition[element].partfunct, get_nions(element), MPI_FLOAT,
-                       MPI_COMM_WORLD);
-            MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                       grid::modelgrid[mgi].cooling_contrib_ion[element], get_nions(element), MPI_DOUBLE,
-                       MPI_COMM_WORLD);
-          }
-        }
+  // node-shared memory is written once per node, and the ranks on the root's node can already see the values
+  const bool write_nodeshared = (globals::rank_in_node == 0) && (segment.node_id != globals::node_id);
+
+  const auto &rootcells = grid::get_rank_modelcells(root);
+  while (segment.pending.size() - position >= sizeof(size_t)) {
+    size_t cellstart = position;
+    size_t cellsize = 0;
+    mpi_unpack_values(segment.pending.data(), cellstart, &cellsize, 1);
+    if (segment.pending.size() - cellstart < cellsize) {
+      break;
+    }
+
+    while (grid::get_numassociatedcells(rootcells[segment.next_cellindex]) < 1) {
+      segment.next_cellindex++;
+    }
+    const int mgi = rootcells[segment.next_cellindex];
+    segment.next_cellindex++;
+
+    position = cellstart;
+    mpi_unpack_cell_properties(segment.pending.data(), position, mgi, write_nodeshared);
+    assert_always(position == cellstart + cellsize);
+  }
+  segment.pending.erase(segment.pending.begin(), segment.pending.begin() + static_cast<ptrdiff_t>(position));
+}
+
+static void mpi_communicate_grid_properties(const int my_rank, const int nprocs)
+// each rank packs the updated properties of its own cells into one contiguous segment, with each cell prefixed by its
+// size in bytes. The segments are exchanged with MPI_Allgatherv in rounds, in which each rank sends the next chunk of
+// its segment, so that the receive buffer stays below MPI_GRID_EXCHANGE_MAXBYTES_PERROUND for any grid size. Every rank
+// has the same cell to rank assignments, so the cells of each segment are known without sending their indices
+{
+  std::vector<char> sendbuffer;
+  mpi_pack_values(sendbuffer, &globals::node_id, 1);
+  for (const int mgi : grid::get_rank_modelcells(my_rank)) {
+    if (grid::get_numassociatedcells(mgi) > 0) {
+      const size_t sizeposition = sendbuffer.size();
+      size_t cellsize = 0;
+      mpi_pack_values(sendbuffer, &cellsize, 1);
+      mpi_pack_cell_properties(sendbuffer, mgi);
+      cellsize = sendbuffer.size() - sizeposition - sizeof(size_t);
+      std::memcpy(&sendbuffer[sizeposition], &cellsize, sizeof(size_t));
+    }
+  }
+
+  const uint64_t my_segment_size = sendbuffer.size();
+  std::vector<uint64_t> segment_sizes(nprocs);
+  MPI_Allgather(&my_segment_size, 1, MPI_UINT64_T, segment_sizes.data(), 1, MPI_UINT64_T, MPI_COMM_WORLD);
+
+  const size_t chunksize = std::max(MPI_GRID_EXCHANGE_MAXBYTES_PERROUND / nprocs, static_cast<size_t>(1));
+  const size_t max_segment_size = *std::ranges::max_element(segment_sizes);
+  const size_t nrounds = (max_segment_size + chunksize - 1) / chunksize;
+  printout("[info] mem_usage: MPI grid exchange of %.3f MB in %zu round(s) (this rank's segment %.3f MB)\n",
+           std::accumulate(segment_sizes.begin(), segment_sizes.end(), 0.) / 1024. / 1024., nrounds,
+           my_segment_size / 1024. / 1024.);
+
+  std::vector<struct grid_exchange_segment> segments(nprocs);
+  std::vector<int> chunk_sizes(nprocs);
+  std::vector<int> chunk_offsets(nprocs);
+  std::vector<char> recvbuffer;
+  for (size_t round = 0; round < nrounds; round++) {
+    const size_t segment_offset = round * chunksize;
+    int totalsize = 0;
+    for (int root = 0; root < nprocs; root++) {
+      chunk_offsets[root] = totalsize;
+      chunk_sizes[root] = (segment_sizes[root] > segment_offset)
+                              ? static_cast<int>(std::min(chunksize, segment_sizes[root] - segment_offset))
+                              : 0;
+      totalsize += chunk_sizes[root];
+    }
+    recvbuffer.resize(totalsize);
+
+    MPI_Allgatherv(sendbuffer.data() + std::min(segment_offset, sendbuffer.size()), chunk_sizes[my_rank], MPI_BYTE,
+                   recvbuffer.data(), chunk_sizes.data(), chunk_offsets.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+    for (int root = 0; root < nprocs; root++) {
+      if (root == my_rank || chunk_sizes[root] == 0) {
+        continue;
       }
+      auto &segment = segments[root];
+      segment.pending.insert(segment.pending.end(), recvbuffer.begin() + chunk_offsets[root],
+                             recvbuffer.begin() + chunk_offsets[root] + chunk_sizes[root]);
+      mpi_unpack_received_cells(segment, root);
     }
   }
+
+  for (int root = 0; root < nprocs; root++) {
+    assert_always(segments[root].pending.empty());
+  }
+
+  // the node-shared values must be in place before any rank on the node uses them
   MPI_Barrier(MPI_COMM_WORLD);
 }
 
+static void mpi_reduce_estimator_array(double *estimarray, const int count)
+// sum an estimator array over all ranks. If the estimators are node shared, the ranks on each node have already
+// accumulated into one copy, so only one rank per node takes part in the reduction
+{
+  if constexpr (grid::get_estimators_nodeshared()) {
+    MPI_Barrier(globals::mpi_comm_node);
+    if (globals::rank_in_node == 0) {
+      MPI_Allreduce(MPI_IN_PLACE, estimarray, count, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_internode);
+    }
+    MPI_Barrier(globals::mpi_comm_node);
+  } else {
+    MPI_Allreduce(MPI_IN_PLACE, estimarray, count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  }
+}
+
 static void mpi_reduce_estimators(int nts) {
-  radfield::reduce_estimators();
-  MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, globals::ffheatingestimator, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, globals::colheatingestimator, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM,
-                MPI_COMM_WORLD);
+  // the radiation field estimators are reduced in the background and are finished after the grey gamma and
+  // deposition output, none of which use them
+  radfield::start_reduce_estimators();
+  mpi_reduce_estimator_array(globals::ffheatingestimator, grid::get_npts_model());
+  mpi_reduce_estimator_array(globals::colheatingestimator, grid::get_npts_model());
   MPI_Barrier(MPI_COMM_WORLD);
 
   const int arraylen = grid::get_nonempty_npts_model() * get_includedions();
@@ -344,13 +452,13 @@ static void mpi_reduce_estimators(int nts) {
   if constexpr (USE_LUT_PHOTOION) {
     MPI_Barrier(MPI_COMM_WORLD);
     assert_always(globals::gammaestimator != nullptr);
-    MPI_Allreduce(MPI_IN_PLACE, globals::gammaestimator, arraylen, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    mpi_reduce_estimator_array(globals::gammaestimator, arraylen);
   }
 
   if constexpr (USE_LUT_BFHEATING) {
     MPI_Barrier(MPI_COMM_WORLD);
     assert_always(globals::bfheatingestimator != nullptr);
-    MPI_Allreduce(MPI_IN_PLACE, globals::bfheatingestimator, arraylen, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    mpi_reduce_estimator_array(globals::bfheatingestimator, arraylen);
   }
 
   if constexpr (RECORD_LINESTAT) {
@@ -362,7 +470,7 @@ static void mpi_reduce_estimators(int nts) {
   }
 
   assert_always(globals::rpkt_emiss != nullptr);
-  MPI_Allreduce(MPI_IN_PLACE, globals::rpkt_emiss, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  mpi_reduce_estimator_array(globals::rpkt_emiss, grid::get_npts_model());
 
   MPI_Barrier(MPI_COMM_WORLD);
 
@@ -393,32 +501,77 @@ static void mpi_reduce_estimators(int nts) {
 }
 #endif
 
-static void write_temp_packetsfile(const int timestep, const int my_rank, const struct packet *const pkt) {
-  // write packets binary file (and retry if the write fails)
+static auto md5_of_file(const char *filename, BYTE hash[MD5_BLOCK_SIZE]) -> bool
+// return false if the file could not be read
+{
+  FILE *infile = fopen(filename, "rb");
+  if (infile == nullptr) {
+    return false;
+  }
+
+  MD5_CTX ctx;
+  md5_init(&ctx);
+  std::vector<BYTE> buffer(1 << 20);
+  size_t numbytes = 0;
+  while ((numbytes = std::fread(buffer.data(), 1, buffer.size(), infile)) > 0) {
+    md5_update(&ctx, buffer.data(), numbytes);
+  }
+  const bool read_success = (ferror(infile) == 0);
+  fclose(infile);
+
+  md5_final(&ctx, hash);
+  return read_success;
+}
+
+static void write_temp_packetsfile(struct packetscheckpoint *checkpoint, const int my_rank)
+// runs on the checkpoint thread: write the packets snapshot and verify the file by comparing its md5 checksum with
+// that of the snapshot, retrying up to PACKETS_CHECKPOINT_MAXATTEMPTS times until they match. The outcome is reported
+// by finish_packets_checkpoint(). Must not call printout(), which uses thread-private state.
+{
   char filename[MAXFILENAMELENGTH];
-  snprintf(filename, MAXFILENAMELENGTH, "packets_%.4d_ts%d.tmp", my_rank, timestep);
+  snprintf(filename, MAXFILENAMELENGTH, "packets_%.4d_ts%d.tmp", my_rank, checkpoint->timestep);
+
+  const auto *snapshot_bytes = reinterpret_cast<const BYTE *>(checkpoint->snapshot.data());
+  const size_t snapshot_size = checkpoint->snapshot.size() * sizeof(struct packet);
 
-  bool write_success = false;
-  while (!write_success) {
-    printout("Writing %s...", filename);
+  MD5_CTX ctx;
+  md5_init(&ctx);
+  md5_update(&ctx, snapshot_bytes, snapshot_size);
+  BYTE snapshot_hash[MD5_BLOCK_SIZE];
+  md5_final(&ctx, snapshot_hash);
+
+  bool write_verified = false;
+  checkpoint->write_attempts = 0;
+  while (!write_verified && checkpoint->write_attempts < PACKETS_CHECKPOINT_MAXATTEMPTS) {
+    checkpoint->write_attempts++;
     FILE *packets_file = fopen(filename, "wb");
-    if (packets_file == nullptr) {
-      printout("ERROR: Could not open file '%s' for mode 'wb'. \n", filename);
-      write_success = false;
-    } else {
-      write_success = (std::fwrite(pkt, sizeof(struct packet), globals::npkts, packets_file) ==
-                       static_cast<size_t>(globals::npkts));
-      if (!write_success) {
-        printout("fwrite() FAILED! will retry...\n");
-      }
+    if (packets_file != nullptr) {
+      const bool write_success = (std::fwrite(snapshot_bytes, 1, snapshot_size, packets_file) == snapshot_size);
+      const bool close_success = (fclose(packets_file) == 0);
 
-      fclose(packets_file);
+      BYTE file_hash[MD5_BLOCK_SIZE];
+      write_verified = write_success && close_success && md5_of_file(filename, file_hash) &&
+                       std::equal(file_hash, file_hash + MD5_BLOCK_SIZE, snapshot_hash);
     }
 
-    if (write_success) {
-      printout("done\n");
+    if (!write_verified && checkpoint->write_attempts < PACKETS_CHECKPOINT_MAXATTEMPTS) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
     }
   }
+  checkpoint->write_verified = write_verified;
+  checkpoint->time_finished = time(nullptr);
+}
+
+static void start_packets_checkpoint(const int nts, const int my_rank, const struct packet *const packets) {
+  assert_always(!pktcheckpoint.writer.joinable());
+
+  // the snapshot buffer is reused for every timestep
+  pktcheckpoint.snapshot.assign(packets, packets + globals::npkts);
+  pktcheckpoint.timestep = nts;
+  pktcheckpoint.time_start = time(nullptr);
+  pktcheckpoint.writer = std::thread(write_temp_packetsfile, &pktcheckpoint, my_rank);
+
+  printout("Writing packets_%.4d_ts%d.tmp in the background\n", my_rank, nts);
 }
 
 static void remove_temp_packetsfile(const int timestep, const int my_rank) {
@@ -475,60 +628,54 @@ static auto walltime_sufficient_to_continue(const int nts, const int nts_prev, c
   return do_this_full_loop;
 }
 
-static void save_grid_and_packets(const int nts, const int my_rank, struct packet *packets) {
-#ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
-#endif
-
-  bool write_verified_sucess = false;
-  while (!write_verified_sucess) {
-    const time_t time_write_packets_file_start = time(nullptr);
-    printout("time before write temporary packets file %ld\n", time_write_packets_file_start);
-
-    // save packet state at start of current timestep (before propagation)
-    write_temp_packetsfile(nts, my_rank, packets);
+static void save_grid_and_packets(const int nts, const int my_rank, const struct packet *const packets) {
+  const time_t time_save_start = time(nullptr);
+  printout("time before saving restart data %ld\n", time_save_start);
 
-    vpkt_write_timestep(nts, my_rank, tid, false);
-
-    const time_t time_write_packets_file_finished = time(nullptr);
-
-#ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
-#endif
+  // save packet state at start of current timestep (before propagation)
+  start_packets_checkpoint(nts, my_rank, packets);
 
-    printout("time after write temporary packets file %ld (took %ld seconds, waited %ld s for other ranks)\n",
-             time(nullptr), time_write_packets_file_finished - time_write_packets_file_start,
-             time(nullptr) - time_write_packets_file_finished);
+  vpkt_write_timestep(nts, my_rank, tid, false);
 
-#ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
-#endif
+  if (my_rank == 0) {
+    grid::write_grid_restart_data(nts);
+  }
 
-    const time_t time_readback_packets_start = time(nullptr);
+  printout("time after starting packets checkpoint and writing grid restart data %ld (took %ld seconds)\n",
+           time(nullptr), time(nullptr) - time_save_start);
+}
 
-    printout("reading back temporary packets file to check validity...\n");
+static void finish_packets_checkpoint(const int my_rank)
+// wait for the packets checkpoint, then make it the restart point and delete the previous one
+{
+  if (!pktcheckpoint.writer.joinable()) {
+    return;
+  }
 
-    // read packets file back to check that the disk write didn't fail
-    write_verified_sucess = verify_temp_packetsfile(nts, my_rank, packets);
+  const time_t time_wait_start = time(nullptr);
+  pktcheckpoint.writer.join();
+  const int nts = pktcheckpoint.timestep;
+  if (!pktcheckpoint.write_verified) {
+    printout("ERROR: Packets file packets_%.4d_ts%d.tmp could not be written and md5 verified after %d attempts\n",
+             my_rank, nts, pktcheckpoint.write_attempts);
+    abort();
+  }
+  printout(
+      "Packets file for timestep %d was written and md5 verified after %d attempt(s) in %ld seconds (waited %ld s)\n",
+      nts, pktcheckpoint.write_attempts, pktcheckpoint.time_finished - pktcheckpoint.time_start,
+      time(nullptr) - time_wait_start);
 
+  // ensure new packets files have been written by all processes before the restart point moves and the old set is
+  // removed
 #ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(MPI_COMM_WORLD);
 #endif
 
-    printout("Verifying packets files for all ranks took %ld seconds.\n", time(nullptr) - time_readback_packets_start);
-  }
-
   if (my_rank == 0) {
-    grid::write_grid_restart_data(nts);
     update_parameterfile(nts);
   }
 
   if (!KEEP_ALL_RESTART_FILES) {
-// ensure new packets files have been written by all processes before we remove the old set
-#ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
-#endif
-
     if (my_rank == 0) {
       remove_grid_restart_data(nts - 1);
     }
@@ -543,17 +690,23 @@ static void zero_estimators() {
 #ifdef MPI_ON
   MPI_Barrier(MPI_COMM_WORLD);
 #endif
+  // node-shared estimators are zeroed by one rank per node
+  const bool zero_shared_estimators = !grid::get_estimators_nodeshared() || globals::rank_in_node == 0;
   for (int nonemptymgi = 0; nonemptymgi < grid::get_nonempty_npts_model(); nonemptymgi++) {
     const auto modelgridindex = grid::get_mgi_of_nonemptymgi(nonemptymgi);
     radfield::zero_estimators(modelgridindex);
 
-    globals::ffheatingestimator[modelgridindex] = 0.;
-    globals::colheatingestimator[modelgridindex] = 0.;
-
     if constexpr (TRACK_ION_STATS) {
       stats::reset_ion_stats(modelgridindex);
     }
 
+    if (!zero_shared_estimators) {
+      continue;
+    }
+
+    globals::ffheatingestimator[modelgridindex] = 0.;
+    globals::colheatingestimator[modelgridindex] = 0.;
+
     for (int element = 0; element < get_nelements(); element++) {
       for (int ion = 0; ion < (get_nions(element) - 1); ion++) {
         if constexpr (USE_LUT_PHOTOION) {
@@ -572,8 +725,8 @@ static void zero_estimators() {
 #endif
 }
 
-static auto do_timestep(const int nts, const int titer, const int my_rank, const int nstart, const int ndo,
-                        struct packet *packets, const int walltimelimitseconds) -> bool {
+static auto do_timestep(const int nts, const int titer, const int my_rank, struct packet *packets,
+                        const int walltimelimitseconds) -> bool {
   bool do_this_full_loop = true;
 
   const int nts_prev = (titer != 0 || nts == 0) ? nts : nts - 1;
@@ -599,21 +752,24 @@ static auto do_timestep(const int nts, const int titer, const int my_rank, const
 
   // Update the matter quantities in the grid for the new timestep.
 
-  update_grid(estimators_file, nts, nts_prev, my_rank, nstart, ndo, titer, real_time_start);
+  update_grid(estimators_file, nts, nts_prev, my_rank, titer, real_time_start);
 
   const time_t sys_time_start_communicate_grid = time(nullptr);
 
 /// Each process has now updated its own set of cells. The results now need to be communicated between processes.
 #ifdef MPI_ON
-  mpi_communicate_grid_properties(my_rank, globals::nprocs, nstart, ndo, mpi_grid_buffer, mpi_grid_buffer_size);
+  mpi_communicate_grid_properties(my_rank, globals::nprocs);
 #endif
 
+  // the next update_grid can use different cell assignments, now that every rank has the properties of all cells
+  grid::rebalance_modelcell_ranks();
+
   printout("timestep %d: time after grid properties have been communicated %ld (took %ld seconds)\n", nts,
            time(nullptr), time(nullptr) - sys_time_start_communicate_grid);
 
   /// If this is not the 0th time step of the current job step,
-  /// write out a snapshot of the grid properties for further restarts
-  /// and update input.txt accordingly
+  /// write out a snapshot of the grid properties and packets for further restarts.
+  /// input.txt is updated once the packets checkpoint has finished at the end of the timestep
   if (((nts - globals::timestep_initial) != 0)) {
     save_grid_and_packets(nts, my_rank, packets);
     do_this_full_loop = walltime_sufficient_to_continue(nts, nts_prev, walltimelimitseconds);
@@ -647,11 +803,13 @@ static auto do_timestep(const int nts, const int titer, const int my_rank, const
 
     gammapkt::normalise_grey(nts);
 
-    write_deposition_file(nts, my_rank, nstart, ndo);
+    write_deposition_file(nts, my_rank);
 
     write_partial_lightcurve_spectra(my_rank, nts, packets);
 
 #ifdef MPI_ON
+    radfield::finish_reduce_estimators();
+
     printout("timestep %d: time after estimators have been communicated %ld (took %ld seconds)\n", nts, time(nullptr),
              time(nullptr) - time_communicate_estimators_start);
 #endif
@@ -708,6 +866,9 @@ static auto do_timestep(const int nts, const int titer, const int my_rank, const
       // remove(filename);
     }
   }
+
+  finish_packets_checkpoint(my_rank);
+
   return !do_this_full_loop;
 }
 
@@ -789,9 +950,12 @@ auto main(int argc, char *argv[]) -> int {
     }
   }
 
-  auto *const packets = static_cast<struct packet *>(calloc(MPKTS, sizeof(struct packet)));
+  // packets are cache-line aligned so that the hot part of each packet occupies whole cache lines
+  auto *const packets =
+      static_cast<struct packet *>(std::aligned_alloc(alignof(struct packet), MPKTS * sizeof(struct packet)));
 
   assert_always(packets != nullptr);
+  std::memset(static_cast<void *>(packets), 0, MPKTS * sizeof(struct packet));
 
   printout("git branch %s\n", GIT_BRANCH);
 
@@ -870,6 +1034,12 @@ auto main(int argc, char *argv[]) -> int {
   printout("time grid_init %ld\n", time(nullptr));
   grid::grid_init(my_rank);
 
+  init_cellcache();
+  init_activelines();
+  init_expansionopacities();
+  init_macroatom_aliastables();
+  kpkt::init_cellcooling_cdf();
+
   printout("Simulation propagates %g packets per process (total %g with nprocs %d)\n", 1. * globals::npkts,
            1. * globals::npkts * globals::nprocs, globals::nprocs);
 
@@ -893,25 +1063,14 @@ auto main(int argc, char *argv[]) -> int {
   const int ndo_nonempty = grid::get_ndo_nonempty(my_rank);
   printout("process rank %d (global max rank %d) assigned %d modelgrid cells (%d nonempty)", my_rank,
            globals::nprocs - 1, ndo, ndo_nonempty);
-  if (ndo > 0) {
+  if (ndo > 0 && grid::get_rank_modelcells(my_rank).back() - grid::get_rank_modelcells(my_rank).front() + 1 == ndo) {
     printout(": cells [%d..%d] (model has max mgi %d)\n", nstart, nstart + ndo - 1, grid::get_npts_model() - 1);
+  } else if (ndo > 0) {
+    printout(": non-contiguous cells from the load balancing (model has max mgi %d)\n", grid::get_npts_model() - 1);
   } else {
     printout("\n");
   }
 
-#ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
-  const size_t maxndo = grid::get_maxndo();
-  /// Initialise the exchange buffer
-  /// The factor 4 comes from the fact that our buffer should contain elements of 4 byte
-  /// instead of 1 byte chars. But the MPI routines don't care about the buffers datatype
-  mpi_grid_buffer_size = 4 * ((12 + 4 * get_includedions()) * (maxndo) + 1);
-  printout("reserve mpi_grid_buffer_size %d space for MPI communication buffer\n", mpi_grid_buffer_size);
-  mpi_grid_buffer = static_cast<char *>(malloc(mpi_grid_buffer_size * sizeof(char)));
-  assert_always(mpi_grid_buffer != nullptr);
-  MPI_Barrier(MPI_COMM_WORLD);
-#endif
-
   int nts = globals::timestep_initial;
 
   macroatom_open_file(my_rank);
@@ -946,7 +1105,7 @@ auto main(int argc, char *argv[]) -> int {
     assert_always(globals::num_lte_timesteps > 0);  // The first time step must solve the ionisation balance in LTE
 
     for (int titer = 0; titer < globals::n_titer; titer++) {
-      terminate_early = do_timestep(nts, titer, my_rank, nstart, ndo, packets, walltimelimitseconds);
+      terminate_early = do_timestep(nts, titer, my_rank, packets, walltimelimitseconds);
 #ifdef DO_TITER
       /// No iterations over the zeroth timestep, set titer > n_titer
       if (nts == 0) titer = globals::n_titer + 1;
@@ -963,7 +1122,6 @@ auto main(int argc, char *argv[]) -> int {
 
 #ifdef MPI_ON
   MPI_Barrier(MPI_COMM_WORLD);
-  free(mpi_grid_buffer);
 #endif
 
   if (linestat_file != nullptr) {
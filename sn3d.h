@@ -6,14 +6,17 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <csignal>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <random>
+#include <vector>
 
 // #define _OPENMP
 #ifdef _OPENMP
@@ -28,12 +31,26 @@ extern FILE *output_file;
 extern int tid;
 extern bool use_cellhist;
 
-extern std::mt19937 stdrng;
+// number of uniform deviates generated at once (two per Philox block)
+constexpr int RNG_BATCHSIZE = 8;
+
+struct rngstate {
+  std::array<uint32_t, 2> key;  // from the random number seed
+  uint32_t streamid;            // packet number, or a per-thread id for draws that do not belong to a packet
+  uint32_t rank;
+  uint64_t blockcounter;  // index of the next Philox block in this stream
+  uint32_t threadstreamid;
+  uint64_t threadblockcounter;  // where the thread's stream continues after packet streams have been used
+  std::array<double, RNG_BATCHSIZE> batch;
+  int batchindex;  // next unused entry of batch
+};
+
+extern struct rngstate rngstate;
 
 extern gsl_integration_workspace *gslworkspace;
 
 #ifdef _OPENMP
-#pragma omp threadprivate(tid, use_cellhist, stdrng, gslworkspace, output_file)
+#pragma omp threadprivate(tid, use_cellhist, rngstate, gslworkspace, output_file)
 #endif
 
 #define __artis_assert(e)                                                                                              \
@@ -127,6 +144,20 @@ inline void safeadd(T &var, T val) {
 
 #define safeincrement(var) safeadd((var), 1)
 
+template <typename T>
+inline void safeadd_nodeshared(T &var, T val)
+// add to an estimator that may be in node-shared memory (NODESHARED_ESTIMATORS_ON), where other ranks on the node
+// are updating it as well as other threads
+{
+#ifdef MPI_ON
+  if constexpr (NODESHARED_ESTIMATORS_ON) {
+    std::atomic_ref<T>(var).fetch_add(val, std::memory_order_relaxed);
+    return;
+  }
+#endif
+  safeadd(var, val);
+}
+
 // #define DO_TITER
 
 static inline void gsl_error_handler_printout(const char *reason, const char *file, int line, int gsl_errno) {
@@ -204,25 +235,112 @@ inline auto get_thread_num() -> int {
 #endif
 }
 
-inline auto rng_uniform() -> float {
-  const auto zrand = std::generate_canonical<float, std::numeric_limits<float>::digits>(stdrng);
-  if (zrand == 1.) {
-    return rng_uniform();
+// Philox4x32-10 counter-based generator (Salmon et al. 2011, Parallel random numbers: as easy as 1, 2, 3).
+// The output is a pure function of the key and counter, so each packet gets its own stream keyed on the seed, rank and
+// packet number. The position in the stream is stored in the packet between activations, which makes the random
+// numbers of a packet independent of the thread count and of the order in which packets are processed.
+constexpr auto philox4x32_10(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key) -> std::array<uint32_t, 4> {
+  constexpr uint64_t PHILOX_M0 = 0xD2511F53;
+  constexpr uint64_t PHILOX_M1 = 0xCD9E8D57;
+  constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+  constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+  for (int round = 0; round < 10; round++) {
+    const uint64_t prod0 = PHILOX_M0 * ctr[0];
+    const uint64_t prod1 = PHILOX_M1 * ctr[2];
+    ctr = {static_cast<uint32_t>(prod1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(prod1),
+           static_cast<uint32_t>(prod0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(prod0)};
+    key[0] += PHILOX_W0;
+    key[1] += PHILOX_W1;
   }
-  return zrand;
+  return ctr;
+}
+
+inline void rng_fill_batch() {
+  for (int b = 0; b < RNG_BATCHSIZE / 2; b++) {
+    const uint64_t block = rngstate.blockcounter + b;
+    const auto bits = philox4x32_10(
+        {rngstate.streamid, rngstate.rank, static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32)},
+        rngstate.key);
+    // use the top 53 bits of each 64-bit pair to get doubles in [0, 1)
+    rngstate.batch[2 * b] = static_cast<double>(((static_cast<uint64_t>(bits[0]) << 32) | bits[1]) >> 11) * 0x1p-53;
+    rngstate.batch[2 * b + 1] =
+        static_cast<double>(((static_cast<uint64_t>(bits[2]) << 32) | bits[3]) >> 11) * 0x1p-53;
+  }
+  rngstate.blockcounter += RNG_BATCHSIZE / 2;
+  rngstate.batchindex = 0;
+}
+
+inline auto rng_uniform() -> double
+// uniform deviate in [0, 1)
+{
+  if (rngstate.batchindex >= RNG_BATCHSIZE) {
+    rng_fill_batch();
+  }
+  return rngstate.batch[rngstate.batchindex++];
 }
 
-inline auto rng_uniform_pos() -> float {
-  const auto zrand = std::generate_canonical<float, std::numeric_limits<float>::digits>(stdrng);
-  if (zrand <= 0.) {
-    return rng_uniform_pos();
+inline auto rng_uniform_pos() -> double
+// uniform deviate in (0, 1)
+{
+  double zrand = 0.;
+  while (zrand <= 0.) {
+    zrand = rng_uniform();
   }
   return zrand;
 }
 
-inline void rng_init(const uint_fast64_t zseed) {
-  printout("rng is a std::mt19937 generator\n");
-  stdrng.seed(zseed);
+inline void rng_set_stream(const uint32_t streamid, const uint64_t blockcounter)
+// switch to the stream of a packet, continuing from a block counter previously returned by rng_get_blockcounter()
+{
+  if (rngstate.streamid == rngstate.threadstreamid) {
+    rngstate.threadblockcounter = rngstate.blockcounter;
+  }
+  rngstate.streamid = streamid;
+  rngstate.blockcounter = blockcounter;
+  rngstate.batchindex = RNG_BATCHSIZE;
+}
+
+inline auto rng_get_blockcounter() -> uint64_t
+// position to resume the current stream from. Any unused deviates of the current batch are skipped.
+{
+  return rngstate.blockcounter;
+}
+
+inline void rng_set_thread_stream()
+// switch back to the thread's own stream after using packet streams, so that later draws that do not belong to a
+// packet do not depend on which packets the thread updated
+{
+  if (rngstate.streamid != rngstate.threadstreamid) {
+    rng_set_stream(rngstate.threadstreamid, rngstate.threadblockcounter);
+  }
+}
+
+inline void rng_init(const uint_fast64_t zseed, const int rank, const int thread) {
+  printout("rng is a Philox4x32-10 counter-based generator\n");
+  rngstate.key = {static_cast<uint32_t>(zseed), static_cast<uint32_t>(zseed >> 32)};
+  rngstate.rank = rank;
+  // packet numbers count up from zero, so the per-thread streams count down from the top
+  rngstate.threadstreamid = UINT32_MAX - thread;
+  rngstate.streamid = rngstate.threadstreamid;
+  rng_set_stream(rngstate.threadstreamid, 0);
+}
+
+template <typename T>
+inline void mpi_pack_values(std::vector<char> &buffer, const T *values, const size_t count)
+// append values to a byte buffer for exchange between ranks (all ranks share the same binary representation)
+{
+  const auto *bytes = reinterpret_cast<const char *>(values);
+  buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <typename T>
+inline void mpi_unpack_values(const char *buffer, size_t &position, T *values, const size_t count)
+// read values written by mpi_pack_values(), or skip over them if values is nullptr
+{
+  if (values != nullptr && count > 0) {
+    std::memcpy(static_cast<void *>(values), &buffer[position], count * sizeof(T));
+  }
+  position += count * sizeof(T);
 }
 
 inline auto is_pid_running(pid_t pid) -> bool {
@@ -79,7 +79,7 @@ static void printout_tracemission_stats() {
         const int lineindex = traceemissionabsorption[i].lineindex;
         const int element = globals::linelist[lineindex].elementindex;
         const int ion = globals::linelist[lineindex].ionindex;
-        const double linelambda = 1e8 * CLIGHT / globals::linelist[lineindex].nu;
+        const double linelambda = 1e8 * CLIGHT / globals::linelist_nu[lineindex];
         // flux-weighted average radial velocity of emission in km/s
         double v_rad = NAN;
         if (mode == 0) {
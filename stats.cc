@@ -164,8 +164,9 @@ void increment(enum eventcounters i) {
 }
 
 void pkt_action_counters_reset() {
-  for (int i = 0; i < COUNTER_COUNT; i++) {
-    eventstats[tid][i] = 0;
+  // called outside of the parallel region, so reset the counters of every thread
+  for (auto &threadstats : eventstats) {
+    threadstats.fill(0);
   }
 
   nonthermal::nt_reset_stats();
@@ -175,12 +176,18 @@ void pkt_action_counters_reset() {
 auto get_counter(enum eventcounters i) -> int {
   assert_always(i < COUNTER_COUNT);
   int count = 0;
-  for (int t = 0; t < get_num_threads(); t++) {
-    count += eventstats[t][i];
+  for (const auto &threadstats : eventstats) {
+    count += threadstats[i];
   }
   return count;
 }
 
+auto get_counter_thread(enum eventcounters i, const int thread) -> int {
+  assert_always(i < COUNTER_COUNT);
+  assert_always(thread < static_cast<int>(eventstats.size()));
+  return eventstats[thread][i];
+}
+
 void pkt_action_counters_printout(const struct packet *const pkt, const int nts) {
   u_int64_t allpktinteractions = 0;
   for (int i = 0; i < globals::npkts; i++) {
@@ -235,6 +242,12 @@ void pkt_action_counters_printout(const struct packet *const pkt, const int nts)
 
   printout("upscatterings  = %d\n", get_counter(COUNTER_UPSCATTER));
   printout("downscatterings  = %d\n", get_counter(COUNTER_DOWNSCATTER));
+
+  printout("cellsteals  = %d\n", get_counter(COUNTER_CELLSTEALS));
+  for (int t = 0; t < static_cast<int>(eventstats.size()); t++) {
+    printout("  thread %3d: updatecellcounter %7d cellsteals %7d\n", t, get_counter_thread(COUNTER_UPDATECELL, t),
+             get_counter_thread(COUNTER_CELLSTEALS, t));
+  }
 }
 
 void reduce_estimators() {
@@ -78,7 +78,8 @@ enum eventcounters {
   COUNTER_UPDATECELL = 31,
   COUNTER_COOLINGRATECALCCOUNTER = 32,
   COUNTER_NESC = 33,
-  COUNTER_COUNT = 34,
+  COUNTER_CELLSTEALS = 34,
+  COUNTER_COUNT = 35,
 };
 
 void init();
@@ -103,6 +104,8 @@ void pkt_action_counters_reset();
 
 auto get_counter(enum eventcounters i) -> int;
 
+auto get_counter_thread(enum eventcounters i, int thread) -> int;
+
 void pkt_action_counters_printout(const struct packet *pkt, int nts);
 
 void reduce_estimators();
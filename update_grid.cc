@@ -1,6 +1,11 @@
 #include "update_grid.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <limits>
+#include <vector>
 
 #include "artisoptions.h"
 #include "atomic.h"
@@ -21,6 +26,224 @@
 #include "thermalbalance.h"
 #include "vpkt.h"
 
+// Node-shared cache of the level populations, and the line optical depths if they fit, of every non-empty cell.
+// A cell is filled by the first thread on the node that needs it after each grid update and is then read by all
+// threads and ranks on the node, so the work and memory no longer scale with the number of threads. The size is
+// limited by CELLCACHE_MAXBYTES.
+
+static int cellcache_nlevels = 0;  // total number of levels of all ions of all elements
+static int cellcache_nlineblocks = 0;
+static int cellcache_generation = 0;  // incremented on every grid update
+
+// populations indexed by [nonemptymgi * cellcache_nlevels + uniquelevelindex]
+static double *cellcache_levelpops = nullptr;
+// for each cell, cellcache_generation if the populations are valid, or -cellcache_generation while they are calculated
+static int *cellcache_levelpops_stamp = nullptr;
+// Sobolev optical depth divided by time indexed by [nonemptymgi * nlines + lineindex]
+static double *cellcache_tau_line_over_t = nullptr;
+// stamps as above, for each block of LINE_TAUBLOCKSIZE lines in each cell
+static int *cellcache_tau_line_blockstamp = nullptr;
+// continuum opacity tables (USE_LUT_CONTOPACITY) indexed by [nonemptymgi * cellcache_contopacity_size + i]
+static size_t cellcache_contopacity_size = 0;
+static double *cellcache_contopacity = nullptr;
+static int *cellcache_contopacity_stamp = nullptr;
+
+// thread-private storage used instead when the shared cache would exceed CELLCACHE_MAXBYTES
+struct cellcache_thread {
+  std::vector<double> levelpops;
+  std::vector<double> tau_line_over_t;
+  std::vector<int> tau_line_blockstamp;
+  int tau_line_stamp{0};
+};
+static std::vector<struct cellcache_thread> cellcache_threads;
+
+template <typename T>
+static auto alloc_cellcache_nodeshared(const size_t count_per_cell) -> T * {
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  T *ptr = nullptr;
+#ifdef MPI_ON
+  size_t my_rank_cells_nonempty = npts_nonempty / globals::node_nprocs;
+  // rank_in_node 0 gets any remainder
+  if (globals::rank_in_node == 0) {
+    my_rank_cells_nonempty += npts_nonempty - (my_rank_cells_nonempty * globals::node_nprocs);
+  }
+  MPI_Aint size = my_rank_cells_nonempty * count_per_cell * sizeof(T);
+  int disp_unit = sizeof(T);
+  MPI_Win mpiwin = MPI_WIN_NULL;
+  assert_always(MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &ptr, &mpiwin) ==
+                MPI_SUCCESS);
+  assert_always(MPI_Win_shared_query(mpiwin, 0, &size, &disp_unit, &ptr) == MPI_SUCCESS);
+#else
+  ptr = static_cast<T *>(malloc(npts_nonempty * count_per_cell * sizeof(T)));
+#endif
+  assert_always(ptr != nullptr);
+  return ptr;
+}
+
+void init_cellcache()
+// should be called after the atomic data and model grid are set up
+{
+  cellcache_nlevels = 0;
+  for (int element = 0; element < get_nelements(); element++) {
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      cellcache_nlevels += get_nlevels(element, ion);
+    }
+  }
+  cellcache_nlineblocks = (globals::nlines + LINE_TAUBLOCKSIZE - 1) / LINE_TAUBLOCKSIZE;
+
+  const size_t npts_nonempty = grid::get_nonempty_npts_model();
+  const size_t mem_usage_levelpops = npts_nonempty * (cellcache_nlevels * sizeof(double) + sizeof(int));
+  const size_t mem_usage_tau_line =
+      npts_nonempty * (globals::nlines * sizeof(double) + cellcache_nlineblocks * sizeof(int));
+  const bool share_levelpops = mem_usage_levelpops <= CELLCACHE_MAXBYTES;
+  const bool share_tau_line = share_levelpops && (mem_usage_levelpops + mem_usage_tau_line) <= CELLCACHE_MAXBYTES;
+  // with ACTIVE_LINES_ON, the line optical depths are kept with the active line list of each cell instead
+  const bool use_tau_line_cache = !ACTIVE_LINES_ON;
+
+  if (share_levelpops) {
+    cellcache_levelpops = alloc_cellcache_nodeshared<double>(cellcache_nlevels);
+    cellcache_levelpops_stamp = alloc_cellcache_nodeshared<int>(1);
+    if (globals::rank_in_node == 0) {
+      std::fill_n(cellcache_levelpops_stamp, npts_nonempty, 0);
+    }
+    printout("[info] mem_usage: cell level population cache occupies %.3f MB (node shared memory)\n",
+             mem_usage_levelpops / 1024. / 1024.);
+  }
+
+  if (use_tau_line_cache && share_tau_line) {
+    cellcache_tau_line_over_t = alloc_cellcache_nodeshared<double>(globals::nlines);
+    cellcache_tau_line_blockstamp = alloc_cellcache_nodeshared<int>(cellcache_nlineblocks);
+    if (globals::rank_in_node == 0) {
+      std::fill_n(cellcache_tau_line_blockstamp, npts_nonempty * cellcache_nlineblocks, 0);
+    }
+    printout("[info] mem_usage: cell line optical depth cache occupies %.3f MB (node shared memory)\n",
+             mem_usage_tau_line / 1024. / 1024.);
+  }
+  if constexpr (USE_LUT_CONTOPACITY) {
+    // there is no thread-private fallback, because the tables would be rebuilt every time a thread enters a cell.
+    // If the tables don't fit, the continuum opacities are calculated directly instead.
+    cellcache_contopacity_size = init_contopacity_lut();
+    const size_t mem_usage_contopacity = npts_nonempty * (cellcache_contopacity_size * sizeof(double) + sizeof(int));
+    if (mem_usage_contopacity <= CELLCACHE_MAXBYTES) {
+      cellcache_contopacity = alloc_cellcache_nodeshared<double>(cellcache_contopacity_size);
+      cellcache_contopacity_stamp = alloc_cellcache_nodeshared<int>(1);
+      if (globals::rank_in_node == 0) {
+        std::fill_n(cellcache_contopacity_stamp, npts_nonempty, 0);
+      }
+      printout("[info] mem_usage: cell continuum opacity tables occupy %.3f MB (node shared memory)\n",
+               mem_usage_contopacity / 1024. / 1024.);
+    } else {
+      printout(
+          "WARNING: cell continuum opacity tables would occupy %.3f MB, exceeding CELLCACHE_MAXBYTES of %.3f MB. "
+          "Continuum opacities will be calculated directly instead of from the tables.\n",
+          mem_usage_contopacity / 1024. / 1024., CELLCACHE_MAXBYTES / 1024. / 1024.);
+    }
+  }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+
+  cellcache_threads.resize(get_max_threads());
+  for (auto &threadcache : cellcache_threads) {
+    if (!share_levelpops) {
+      threadcache.levelpops.resize(cellcache_nlevels);
+    }
+    if (use_tau_line_cache && !share_tau_line) {
+      threadcache.tau_line_over_t.resize(globals::nlines);
+      threadcache.tau_line_blockstamp.resize(cellcache_nlineblocks, 0);
+    }
+  }
+  if (!share_levelpops || (use_tau_line_cache && !share_tau_line)) {
+    printout(
+        "[info] mem_usage: shared cell cache would exceed %.3f MB, using thread-private level populations (%s) and "
+        "line optical depths (%s), %.3f MB per thread\n",
+        CELLCACHE_MAXBYTES / 1024. / 1024., share_levelpops ? "no" : "yes",
+        (use_tau_line_cache && !share_tau_line) ? "yes" : "no",
+        (cellcache_threads[0].levelpops.size() * sizeof(double) +
+         cellcache_threads[0].tau_line_over_t.size() * sizeof(double) +
+         cellcache_threads[0].tau_line_blockstamp.size() * sizeof(int)) /
+            1024. / 1024.);
+  }
+}
+
+static void calculate_cell_levelpops(const int modelgridindex, double *levelpops) {
+  for (int element = 0; element < get_nelements(); element++) {
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      const int nlevels = get_nlevels(element, ion);
+      for (int level = 0; level < nlevels; level++) {
+        levelpops[globals::elements[element].ions[ion].levels[level].uniquelevelindex] =
+            calculate_levelpop(modelgridindex, element, ion, level);
+      }
+    }
+  }
+}
+
+static auto get_cellcache_levelpops(const int modelgridindex) -> const double * {
+  if (cellcache_levelpops == nullptr) {
+    double *levelpops = cellcache_threads[tid].levelpops.data();
+    calculate_cell_levelpops(modelgridindex, levelpops);
+    return levelpops;
+  }
+
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  double *levelpops = &cellcache_levelpops[nonemptymgi * cellcache_nlevels];
+  std::atomic_ref<int> stamp(cellcache_levelpops_stamp[nonemptymgi]);
+  int stampvalue = stamp.load(std::memory_order_acquire);
+  while (stampvalue != cellcache_generation) {
+    if (stampvalue != -cellcache_generation &&
+        stamp.compare_exchange_weak(stampvalue, -cellcache_generation, std::memory_order_acquire)) {
+      calculate_cell_levelpops(modelgridindex, levelpops);
+      stamp.store(cellcache_generation, std::memory_order_release);
+      break;
+    }
+    // another thread or rank on this node is calculating the populations of this cell
+    stampvalue = stamp.load(std::memory_order_acquire);
+  }
+  return levelpops;
+}
+
+static auto get_cellcache_contopacity(const int modelgridindex) -> const double *
+// the table is built from the level populations, so they must already be in the cellhistory
+{
+  const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  double *lut = &cellcache_contopacity[nonemptymgi * cellcache_contopacity_size];
+  std::atomic_ref<int> stamp(cellcache_contopacity_stamp[nonemptymgi]);
+  int stampvalue = stamp.load(std::memory_order_acquire);
+  while (stampvalue != cellcache_generation) {
+    if (stampvalue != -cellcache_generation &&
+        stamp.compare_exchange_weak(stampvalue, -cellcache_generation, std::memory_order_acquire)) {
+      calculate_contopacity_lut(modelgridindex, lut);
+      stamp.store(cellcache_generation, std::memory_order_release);
+      break;
+    }
+    // another thread or rank on this node is building the table of this cell
+    stampvalue = stamp.load(std::memory_order_acquire);
+  }
+  return lut;
+}
+
+static void set_cellhistory_tau_line_cache(const int modelgridindex) {
+  auto &chist = globals::cellhistory[tid];
+  if (cellcache_tau_line_over_t != nullptr) {
+    const size_t nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+    chist.tau_line_over_t = &cellcache_tau_line_over_t[nonemptymgi * globals::nlines];
+    chist.tau_line_blockstamp = &cellcache_tau_line_blockstamp[nonemptymgi * cellcache_nlineblocks];
+    chist.tau_line_stamp = cellcache_generation;
+    return;
+  }
+
+  // the thread-private blocks are invalidated by changing the stamp on every reset
+  auto &threadcache = cellcache_threads[tid];
+  if (threadcache.tau_line_stamp == std::numeric_limits<int>::max()) {
+    std::ranges::fill(threadcache.tau_line_blockstamp, 0);
+    threadcache.tau_line_stamp = 0;
+  }
+  threadcache.tau_line_stamp++;
+  chist.tau_line_over_t = threadcache.tau_line_over_t.data();
+  chist.tau_line_blockstamp = threadcache.tau_line_blockstamp.data();
+  chist.tau_line_stamp = threadcache.tau_line_stamp;
+}
+
 static void write_to_estimators_file(FILE *estimators_file, const int mgi, const int timestep, const int titer,
                                      const struct heatingcoolingrates *heatingcoolingrates) {
   // return; disable for better performance (if estimators files are not needed)
@@ -680,6 +903,16 @@ void cellhistory_reset(const int modelgridindex, const bool new_timestep) {
 
   globals::cellhistory[tid].cellnumber = modelgridindex;
 
+  if (modelgridindex >= 0) {
+    globals::cellhistory[tid].levelpops = get_cellcache_levelpops(modelgridindex);
+    set_cellhistory_tau_line_cache(modelgridindex);
+  } else {
+    globals::cellhistory[tid].levelpops = nullptr;
+    globals::cellhistory[tid].tau_line_over_t = nullptr;
+    globals::cellhistory[tid].tau_line_blockstamp = nullptr;
+    globals::cellhistory[tid].contopacity_lut = nullptr;
+  }
+
   //  int nlevels_with_processrates = 0;
   // const double T_e = modelgridindex >= 0 ? grid ::get_Te(modelgridindex) : 0.;
   const int nelements = get_nelements();
@@ -687,14 +920,6 @@ void cellhistory_reset(const int modelgridindex, const bool new_timestep) {
     const int nions = get_nions(element);
     for (int ion = 0; ion < nions; ion++) {
       globals::cellhistory[tid].cooling_contrib[kpkt::get_coolinglistoffset(element, ion)] = COOLING_UNDEFINED;
-
-      if (modelgridindex >= 0) {
-        const int nlevels = get_nlevels(element, ion);
-        for (int level = 0; level < nlevels; level++) {
-          globals::cellhistory[tid].chelements[element].chions[ion].chlevels[level].population =
-              calculate_levelpop(modelgridindex, element, ion, level);
-        }
-      }
     }
 
     for (int ion = 0; ion < nions; ion++) {
@@ -762,6 +987,12 @@ void cellhistory_reset(const int modelgridindex, const bool new_timestep) {
   if (modelgridindex >= 0) {
     const int nbfcont = globals::nbfcontinua;
     std::fill_n(globals::cellhistory[tid].ch_allcont_departureratios, nbfcont, -1);
+
+    const bool use_contopacity_lut =
+        USE_LUT_CONTOPACITY && cellcache_contopacity != nullptr && globals::opacity_case == 4 &&
+        grid::modelgrid[modelgridindex].thick != 1;
+    globals::cellhistory[tid].contopacity_lut =
+        use_contopacity_lut ? get_cellcache_contopacity(modelgridindex) : nullptr;
   }
   // printout("nlevels_with_processrates %d\n", nlevels_with_processrates);
 
@@ -1174,6 +1405,14 @@ static void update_grid_cell(const int mgi, const int nts, const int nts_prev, c
       printout("took %ld seconds\n", time(nullptr) - sys_time_start_calc_kpkt_rates);
     }
 
+    if constexpr (ACTIVE_LINES_ON) {
+      update_cell_activelines(mgi, globals::timesteps[nts].mid);
+    }
+
+    if constexpr (EXPANSION_OPACITIES_ON) {
+      update_cell_expansionopacities(mgi, globals::timesteps[nts].mid);
+    }
+
     const int update_grid_cell_seconds = time(nullptr) - sys_time_start_update_cell;
     if (update_grid_cell_seconds > 0) {
       printout("update_grid_cell for cell %d timestep %d took %ld seconds\n", mgi, nts, update_grid_cell_seconds);
@@ -1188,8 +1427,8 @@ static void update_grid_cell(const int mgi, const int nts, const int nts_prev, c
   }
 }
 
-void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const int my_rank, const int nstart,
-                 const int ndo, const int titer, const time_t real_time_start)
+void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const int my_rank, const int titer,
+                 const time_t real_time_start)
 // Subroutine to update the matter quantities in the grid cells at the start
 //   of the new timestep.
 /// nts timestep
@@ -1220,6 +1459,12 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
     mps[i] = 1.e35;
   }
 
+  // the cell properties are about to change, so invalidate every cell of the shared cache
+  cellcache_generation++;
+  if constexpr (KPKT_COOLING_CDF_ON) {
+    kpkt::invalidate_cellcooling_cdfs();
+  }
+
   /// Calculate the critical opacity at which opacity_case 3 switches from a
   /// regime proportional to the density to a regime independent of the density
   /// This is done by solving for tau_sobolev == 1
@@ -1253,13 +1498,20 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
     for (int mgi = 0; mgi < grid::get_npts_model(); mgi++) {
       /// Check if this task should work on the current model grid cell.
       /// If yes, update the cell and write out the estimators
-      if (mgi >= nstart && mgi < nstart + ndo) {
+      if (grid::get_modelcell_rank(mgi) == my_rank) {
         // use_cellhist = false;
         // cellhistory_reset(-99, true);
 
+        const auto time_cell_start = std::chrono::steady_clock::now();
+
         struct heatingcoolingrates heatingcoolingrates = {};
         update_grid_cell(mgi, nts, nts_prev, titer, tratmid, deltat, &heatingcoolingrates);
 
+        if constexpr (DYNAMIC_LOAD_BALANCING_ON) {
+          grid::set_modelcell_update_seconds(
+              mgi, std::chrono::duration<double>(std::chrono::steady_clock::now() - time_cell_start).count());
+        }
+
         // maybe want to add omp ordered here if the modelgrid cells should be output in order
         // use_cellhist = true;
         // cellhistory_reset(mgi, true);
@@ -1272,7 +1524,8 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
         /// else, only reset gammaestimator to zero. This allows us to do a global MPI
         /// communication after update_grid to synchronize gammaestimator
         /// and write a contiguous restart file with grid properties
-        if constexpr (USE_LUT_PHOTOION) {
+        /// (node-shared values belong to the rank updating the cell and must be left alone)
+        if constexpr (USE_LUT_PHOTOION && !grid::get_estimators_nodeshared()) {
           zero_gammaestimator(mgi);
         }
       }
@@ -1283,6 +1536,8 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
     use_cellhist = true;
   }  /// end OpenMP parallel section
 
+  finish_cell_activelines_update();
+
   // alterative way to write out estimators. this keeps the modelgrid cells in order but
   // heatingrates are not valid. #ifdef _OPENMP for (int n = nstart; n < nstart+nblock; n++)
   // {
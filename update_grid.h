@@ -4,8 +4,8 @@
 #include <cstdio>
 #include <ctime>
 
-void update_grid(FILE *estimators_file, int nts, int nts_prev, int my_rank, int nstart, int ndo, int titer,
-                 time_t real_time_start);
+void update_grid(FILE *estimators_file, int nts, int nts_prev, int my_rank, int titer, time_t real_time_start);
 void cellhistory_reset(int modelgridindex, bool new_timestep);
+void init_cellcache();
 
 #endif  // UPDATE_GRID_H
@@ -1,6 +1,10 @@
 #include "update_packets.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <vector>
 
 #include "decay.h"
 #include "gammapkt.h"
@@ -201,45 +205,199 @@ static void do_packet(struct packet *const pkt_ptr, const double t2, const int n
   }
 }
 
-static auto std_compare_packets_bymodelgriddensity(const struct packet &p1, const struct packet &p2) -> bool {
-  // return true if packet p1 goes before p2
+static auto get_cellorder_bydensity() -> std::vector<int>
+// rank of each modelgrid cell (including the empty cell npts_model) when ordered by descending density
+{
+  const int npts_model = grid::get_npts_model();
+  std::vector<int> mgi_sorted(npts_model + 1);
+  std::iota(mgi_sorted.begin(), mgi_sorted.end(), 0);
+  std::stable_sort(mgi_sorted.begin(), mgi_sorted.end(),
+                   [](const int mgi1, const int mgi2) { return grid::get_rho(mgi1) > grid::get_rho(mgi2); });
+
+  std::vector<int> cellorder(npts_model + 1);
+  for (int i = 0; i <= npts_model; i++) {
+    cellorder[mgi_sorted[i]] = i;
+  }
+  return cellorder;
+}
+
+static inline auto get_packet_cellkey(const struct packet &pkt, const std::vector<int> &cellorder) -> int {
+  return cellorder[grid::get_cell_modelgridindex(pkt.where)];
+}
+
+static void sort_packets_bycell(struct packet *packets, const int npkts_active, const std::vector<int> &cellorder)
+// in-place counting sort (American flag sort) of the active packets by cell, with cells ordered by descending
+// density. Each packet is moved at most once, so this is O(N) instead of the O(N log N) comparison sort
+{
+  const size_t nkeys = cellorder.size();
+  std::vector<int> bucketnext(nkeys + 1, 0);
+  for (int n = 0; n < npkts_active; n++) {
+    bucketnext[get_packet_cellkey(packets[n], cellorder) + 1]++;
+  }
+  std::partial_sum(bucketnext.begin(), bucketnext.end(), bucketnext.begin());
+  const std::vector<int> bucketend(bucketnext.begin() + 1, bucketnext.end());
+
+  for (size_t bucket = 0; bucket < nkeys; bucket++) {
+    while (bucketnext[bucket] < bucketend[bucket]) {
+      const int n = bucketnext[bucket];
+      const int key = get_packet_cellkey(packets[n], cellorder);
+      if (static_cast<size_t>(key) != bucket) {
+        std::swap(packets[n], packets[bucketnext[key]]);
+      }
+      bucketnext[key]++;
+    }
+  }
+}
 
-  // move escaped packets to the end of the list for better performance
-  const bool esc1 = (p1.type == TYPE_ESCAPE);
-  const bool esc2 = (p2.type == TYPE_ESCAPE);
+static void sort_queue_bycell(std::vector<int> &queue, const struct packet *packets, const std::vector<int> &cellorder)
+// counting sort of a list of packet indices by the (density-ordered) cell of each packet
+{
+  std::vector<int> bucketnext(cellorder.size() + 1, 0);
+  for (const int n : queue) {
+    bucketnext[get_packet_cellkey(packets[n], cellorder) + 1]++;
+  }
+  std::partial_sum(bucketnext.begin(), bucketnext.end(), bucketnext.begin());
 
-  if (!esc1 && esc2) {
-    return true;
+  std::vector<int> queue_sorted(queue.size());
+  for (const int n : queue) {
+    queue_sorted[bucketnext[get_packet_cellkey(packets[n], cellorder)]++] = n;
   }
-  if (esc1 && !esc2) {
-    return false;
+  queue.swap(queue_sorted);
+}
+
+struct celltask {
+  int queuestart;  // range of the packet queue that belongs to this task
+  int queueend;
+};
+
+static auto get_celltasks(const std::vector<int> &queue, const struct packet *packets) -> std::vector<struct celltask>
+// split the cell-bucketed packet queue into tasks that each contain the pending packets of one cell.
+// Cells with very many packets are split into several tasks so that e.g. a single-zone model can still use all
+// threads, at the cost of one extra cellhistory reset per extra task.
+{
+  const int nqueue = static_cast<int>(queue.size());
+  const int maxtasksize = std::max(256, nqueue / (8 * get_max_threads()));
+
+  std::vector<struct celltask> celltasks;
+  int taskmgi = -1;
+  for (int i = 0; i < nqueue; i++) {
+    const int mgi = grid::get_cell_modelgridindex(packets[queue[i]].where);
+    if (celltasks.empty() || mgi != taskmgi || (i - celltasks.back().queuestart) >= maxtasksize) {
+      celltasks.push_back({i, i + 1});
+      taskmgi = mgi;
+    } else {
+      celltasks.back().queueend = i + 1;
+    }
   }
-  if (esc1 && esc2) {
-    return false;
+  return celltasks;
+}
+
+// each thread owns a contiguous range of cell tasks. The owner takes tasks from the front and idle threads steal
+// whole tasks from the back. Head and tail are packed into one 64-bit word so that both ends can be updated with
+// compare-and-swap.
+struct alignas(64) threadtaskrange {
+  std::atomic<uint64_t> headtail{0};
+};
+
+constexpr auto pack_taskrange(const uint64_t head, const uint64_t tail) -> uint64_t { return (tail << 32) | head; }
+
+static auto get_tasks_remaining(const struct threadtaskrange &range) -> int {
+  const uint64_t headtail = range.headtail.load(std::memory_order_relaxed);
+  const auto head = static_cast<int>(headtail & 0xFFFFFFFFU);
+  const auto tail = static_cast<int>(headtail >> 32);
+  return tail - head;
+}
+
+static auto pop_own_task(struct threadtaskrange &range) -> int {
+  uint64_t headtail = range.headtail.load();
+  while (true) {
+    const uint64_t head = headtail & 0xFFFFFFFFU;
+    const uint64_t tail = headtail >> 32;
+    if (head >= tail) {
+      return -1;
+    }
+    if (range.headtail.compare_exchange_weak(headtail, pack_taskrange(head + 1, tail))) {
+      return static_cast<int>(head);
+    }
   }
+}
 
-  // for both non-escaped packets, order by descending cell density
-  const int mgi1 = grid::get_cell_modelgridindex(p1.where);
-  const int mgi2 = grid::get_cell_modelgridindex(p2.where);
-  if (grid::get_rho(mgi1) > grid::get_rho(mgi2)) {
-    return true;
+static auto steal_task(struct threadtaskrange &range) -> int {
+  uint64_t headtail = range.headtail.load();
+  while (true) {
+    const uint64_t head = headtail & 0xFFFFFFFFU;
+    const uint64_t tail = headtail >> 32;
+    if (head >= tail) {
+      return -1;
+    }
+    if (range.headtail.compare_exchange_weak(headtail, pack_taskrange(head, tail - 1))) {
+      return static_cast<int>(tail - 1);
+    }
   }
+}
 
-  if (grid::get_rho(mgi1) == grid::get_rho(mgi2) && (mgi1 < mgi2)) {
-    return true;
+static auto steal_task_from_busiest_thread(std::vector<struct threadtaskrange> &taskranges) -> int
+// steal the last task of the thread with the most remaining tasks, or return -1 if there is no work left anywhere
+{
+  while (true) {
+    int victim = -1;
+    int victim_remaining = 0;
+    for (int t = 0; t < static_cast<int>(taskranges.size()); t++) {
+      const int remaining = get_tasks_remaining(taskranges[t]);
+      if (remaining > victim_remaining) {
+        victim = t;
+        victim_remaining = remaining;
+      }
+    }
+    if (victim < 0) {
+      return -1;
+    }
+    const int task = steal_task(taskranges[victim]);
+    if (task >= 0) {
+      return task;
+    }
   }
+}
 
-  // same cell, order by type
-  if ((mgi1 == mgi2) && (p1.type < p2.type)) {
-    return true;
+static void assign_celltasks_to_threads(const std::vector<struct celltask> &celltasks,
+                                        std::vector<struct threadtaskrange> &taskranges)
+// give each thread a contiguous range of tasks with roughly equal packet counts
+{
+  const int nthreads = static_cast<int>(taskranges.size());
+  const int ntasks = static_cast<int>(celltasks.size());
+  const int64_t npkts_total = ntasks > 0 ? celltasks.back().queueend : 0;
+  int task = 0;
+  for (int t = 0; t < nthreads; t++) {
+    const int taskstart = task;
+    const int64_t pkt_end = npkts_total * (t + 1) / nthreads;
+    while (task < ntasks && (celltasks[task].queuestart < pkt_end || t == nthreads - 1)) {
+      task++;
+    }
+    taskranges[t].headtail.store(pack_taskrange(taskstart, task));
   }
+}
+
+static auto get_npkts_active(struct packet *packets, const int nts) -> int
+// escaped packets are moved to the end of the packet list, so that they are never visited again
+{
+  static int npkts_active = -1;
+  static int nts_last = -1;
+
+  // after a restart or when a timestep is repeated (packets reloaded from the temp packets file), any packet may be
+  // escaped, otherwise only the packets that were active at the start of the previous timestep need to be checked
+  const int npkts_checked = (npkts_active >= 0 && nts == nts_last + 1) ? npkts_active : globals::npkts;
 
-  // same cell and type, order by decreasing frequency
-  if ((mgi1 == mgi2) && (p1.type == p2.type) && (p1.nu_cmf > p2.nu_cmf)) {
-    return true;
+  struct packet *activeend = std::partition(packets, packets + npkts_checked,
+                                            [](const struct packet &pkt) { return pkt.type != TYPE_ESCAPE; });
+  npkts_active = static_cast<int>(std::distance(packets, activeend));
+  nts_last = nts;
+
+  // the interaction counts are per timestep, so reset them for the packets that escaped in the previous timestep
+  for (int n = npkts_active; n < npkts_checked; n++) {
+    packets[n].interactions = 0;
   }
 
-  return false;
+  return npkts_active;
 }
 
 void update_packets(const int my_rank, const int nts, struct packet *packets)
@@ -255,77 +413,108 @@ void update_packets(const int my_rank, const int nts, struct packet *packets)
 
   const time_t time_update_packets_start = time(nullptr);
   printout("timestep %d: start update_packets at time %ld\n", nts, time_update_packets_start);
+
+  // the packet list is bucketed by cell once per timestep. Each later pass only visits the packets that did not
+  // finish the timestep in the previous pass (i.e., they changed cell), bucketed by their new cell
+  const std::vector<int> cellorder = get_cellorder_bydensity();
+  const int npkts_active = get_npkts_active(packets, nts);
+  sort_packets_bycell(packets, npkts_active, cellorder);
+  printout("timestep %d: %d active packets (%d escaped packets skipped), bucketed by cell in %lds\n", nts, npkts_active,
+           globals::npkts - npkts_active, time(nullptr) - time_update_packets_start);
+
+  std::vector<int> queue(npkts_active);
+  std::iota(queue.begin(), queue.end(), 0);
+  std::vector<int> queue_next(npkts_active);
+
   bool timestepcomplete = false;
   int passnumber = 0;
   while (!timestepcomplete) {
-    timestepcomplete = true;  // will be set false if any packets did not finish propagating in this pass
-
     const time_t sys_time_start_pass = time(nullptr);
 
-    // printout("sorting packets...");
-
-    std::sort(packets, packets + globals::npkts, std_compare_packets_bymodelgriddensity);
+    if (passnumber > 0) {
+      sort_queue_bycell(queue, packets, cellorder);
+    }
 
-    // printout("took %lds\n", time(nullptr) - sys_time_start_pass);
+    printout("  update_packets timestep %d pass %3d: started at %ld (%zu packets queued, bucketing took %lds)\n", nts,
+             passnumber, sys_time_start_pass, queue.size(), time(nullptr) - sys_time_start_pass);
 
-    printout("  update_packets timestep %d pass %3d: started at %ld\n", nts, passnumber, sys_time_start_pass);
+    const std::vector<struct celltask> celltasks = get_celltasks(queue, packets);
+    std::vector<struct threadtaskrange> taskranges(get_max_threads());
+    assign_celltasks_to_threads(celltasks, taskranges);
 
     int count_pktupdates = 0;
+    std::atomic<int> nqueue_next = 0;
     const int updatecellcounter_beforepass = stats::get_counter(stats::COUNTER_UPDATECELL);
+    const int stealcounter_beforepass = stats::get_counter(stats::COUNTER_CELLSTEALS);
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(nonmonotonic : dynamic)
+#pragma omp parallel reduction(+ : count_pktupdates)
 #endif
-    for (int n = 0; n < globals::npkts; n++) {
-      struct packet *pkt_ptr = &packets[n];
-
-      // if (pkt_ptr->type == TYPE_ESCAPE)
-      // {
-      //   printout("packet index %d already escaped. Skipping rest of packets (which are all escaped).\n", n);
-      //   // for (int n2 = n; n2 < globals::npkts; n2++)
-      //   // {
-      //   //   assert_always(packets[n2].type == TYPE_ESCAPE);
-      //   // }
-      //   break;
-      // }
-      // pkt_ptr->timestep = nts;
-
-      if (passnumber == 0) {
-        pkt_ptr->interactions = 0;
-      }
-
-      if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->prop_time < (ts + tw)) {
-        const int cellindex = pkt_ptr->where;
-        const int mgi = grid::get_cell_modelgridindex(cellindex);
-        /// for non empty cells update the global available level populations and cooling terms
-        /// Reset cellhistory if packet starts up in another than the last active cell
-        if (mgi != grid::get_npts_model() && globals::cellhistory[tid].cellnumber != mgi &&
-            grid::modelgrid[mgi].thick != 1) {
-          stats::increment(stats::COUNTER_UPDATECELL);
-          cellhistory_reset(mgi, false);
-        }
-
-        // enum packet_type oldtype = pkt_ptr->type;
-        int newmgi = mgi;
-        bool workedonpacket = false;
-        while ((newmgi == mgi || newmgi == grid::get_npts_model()) && pkt_ptr->prop_time < (ts + tw) &&
-               pkt_ptr->type != TYPE_ESCAPE) {
-          workedonpacket = true;
-          do_packet(pkt_ptr, ts + tw, nts);
-          const int newcellnum = pkt_ptr->where;
-          newmgi = grid::get_cell_modelgridindex(newcellnum);
+    {
+      while (true) {
+        int task = (tid < static_cast<int>(taskranges.size())) ? pop_own_task(taskranges[tid]) : -1;
+        if (task < 0) {
+          task = steal_task_from_busiest_thread(taskranges);
+          if (task < 0) {
+            break;
+          }
+          stats::increment(stats::COUNTER_CELLSTEALS);
         }
-        count_pktupdates += workedonpacket ? 1 : 0;
 
-        if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->prop_time < (ts + tw)) {
-          timestepcomplete = false;
+        for (int i = celltasks[task].queuestart; i < celltasks[task].queueend; i++) {
+          const int n = queue[i];
+          struct packet *pkt_ptr = &packets[n];
+
+          if (passnumber == 0) {
+            pkt_ptr->interactions = 0;
+          }
+
+          if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->prop_time < (ts + tw)) {
+            const int cellindex = pkt_ptr->where;
+            const int mgi = grid::get_cell_modelgridindex(cellindex);
+            /// for non empty cells update the global available level populations and cooling terms
+            /// Reset cellhistory if packet starts up in another than the last active cell
+            if (mgi != grid::get_npts_model() && globals::cellhistory[tid].cellnumber != mgi &&
+                grid::modelgrid[mgi].thick != 1) {
+              stats::increment(stats::COUNTER_UPDATECELL);
+              cellhistory_reset(mgi, false);
+            }
+
+            // continue the packet's own random number stream, so that it does not matter which thread updates it
+            rng_set_stream(pkt_ptr->number, pkt_ptr->rngblockcounter);
+
+            // enum packet_type oldtype = pkt_ptr->type;
+            int newmgi = mgi;
+            bool workedonpacket = false;
+            while ((newmgi == mgi || newmgi == grid::get_npts_model()) && pkt_ptr->prop_time < (ts + tw) &&
+                   pkt_ptr->type != TYPE_ESCAPE) {
+              workedonpacket = true;
+              do_packet(pkt_ptr, ts + tw, nts);
+              const int newcellnum = pkt_ptr->where;
+              newmgi = grid::get_cell_modelgridindex(newcellnum);
+            }
+            pkt_ptr->rngblockcounter = rng_get_blockcounter();
+            count_pktupdates += workedonpacket ? 1 : 0;
+
+            if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->prop_time < (ts + tw)) {
+              queue_next[nqueue_next++] = n;
+            }
+          }
         }
       }
+      rng_set_thread_stream();
     }
     const int cellhistresets = stats::get_counter(stats::COUNTER_UPDATECELL) - updatecellcounter_beforepass;
+    const int cellsteals = stats::get_counter(stats::COUNTER_CELLSTEALS) - stealcounter_beforepass;
     printout(
-        "  update_packets timestep %d pass %3d: finished at %ld packetsupdated %7d cellhistoryresets %7d (took %lds)\n",
-        nts, passnumber, time(nullptr), count_pktupdates, cellhistresets, time(nullptr) - sys_time_start_pass);
+        "  update_packets timestep %d pass %3d: finished at %ld packetsupdated %7d celltasks %7zu cellhistoryresets %7d "
+        "cellsteals %7d (took %lds)\n",
+        nts, passnumber, time(nullptr), count_pktupdates, celltasks.size(), cellhistresets, cellsteals,
+        time(nullptr) - sys_time_start_pass);
+
+    // packets that did not finish propagating in this pass are queued for the next one
+    queue.assign(queue_next.begin(), queue_next.begin() + nqueue_next);
+    timestepcomplete = queue.empty();
 
     passnumber++;
   }
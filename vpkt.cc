@@ -279,7 +279,7 @@ static void rlc_emiss_vpkt(const struct packet *const pkt_ptr, const double t_cu
     const double s_cont = sdist * t_current * t_current * t_current / (t_future * t_future * t_future);
 
     if (mgi == grid::get_npts_model()) {
-      vpkt.next_trans = -1;
+      vpkt.next_trans = get_next_trans_skiplines(vpkt.next_trans);
     } else {
       calculate_chi_rpkt_cont(vpkt.nu_cmf, &chi_vpkt_cont, mgi, false);
 
@@ -318,7 +318,7 @@ static void rlc_emiss_vpkt(const struct packet *const pkt_ptr, const double t_cu
         if (lineindex < 0) {
           vpkt.next_trans = globals::nlines + 1;
         } else {
-          const double nutrans = globals::linelist[lineindex].nu;
+          const double nutrans = globals::linelist_nu[lineindex];
 
           vpkt.next_trans = lineindex + 1;
 
@@ -339,10 +339,8 @@ static void rlc_emiss_vpkt(const struct packet *const pkt_ptr, const double t_cu
           const int ion = globals::linelist[lineindex].ionindex;
           const int upper = globals::linelist[lineindex].upperlevelindex;
           const int lower = globals::linelist[lineindex].lowerlevelindex;
-          const auto A_ul = globals::linelist[lineindex].einstein_A;
-
-          const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nutrans, 3) * A_ul;
-          const double B_lu = stat_weight(element, ion, upper) / stat_weight(element, ion, lower) * B_ul;
+          const double B_ul = globals::linelist_B_ul[lineindex];
+          const double B_lu = globals::linelist_B_lu[lineindex];
 
           const auto n_u = calculate_levelpop(mgi, element, ion, upper);
           const auto n_l = calculate_levelpop(mgi, element, ion, lower);